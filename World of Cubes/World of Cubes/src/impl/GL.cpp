@@ -1,21 +1,207 @@
 #include "support/GL.h"
 
+#include <opengl/glew.h>
 #include <opengl/glut.h>
+#include <atomic>
 #include <iostream>
 #include <string>
 
+#include "support/mpsc_queue.h"
 
+
+namespace
+{
+	// Errors a context keeps at once, one per kind at most
+	constexpr int32_t MAX_ERRORS = 8;
+
+	bool initiated = false;
+	std::atomic<bool> debugEnabled{ false };
+	MpscQueue<gl::DebugMessage> debugMessages;
+
+	void GLAPIENTRY debug_callback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void*)
+	{
+		// Only copies, this may run on a driver thread in the middle of a GL call
+		std::string text = length >= 0 ? std::string{ message, static_cast<size_t>(length) } : std::string{ message };
+		debugMessages.push({ source, type, id, severity, std::move(text) });
+	}
+
+	const char* source_name(uint32_t source)
+	{
+		switch (source)
+		{
+			case GL_DEBUG_SOURCE_API: return "API";
+			case GL_DEBUG_SOURCE_WINDOW_SYSTEM: return "window system";
+			case GL_DEBUG_SOURCE_SHADER_COMPILER: return "shader compiler";
+			case GL_DEBUG_SOURCE_THIRD_PARTY: return "third party";
+			case GL_DEBUG_SOURCE_APPLICATION: return "application";
+			default: return "other";
+		}
+	}
+
+	const char* type_name(uint32_t type)
+	{
+		switch (type)
+		{
+			case GL_DEBUG_TYPE_ERROR: return "error";
+			case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated";
+			case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "undefined behavior";
+			case GL_DEBUG_TYPE_PORTABILITY: return "portability";
+			case GL_DEBUG_TYPE_PERFORMANCE: return "performance";
+			case GL_DEBUG_TYPE_MARKER: return "marker";
+			default: return "other";
+		}
+	}
+
+	const char* severity_name(uint32_t severity)
+	{
+		switch (severity)
+		{
+			case GL_DEBUG_SEVERITY_HIGH: return "high";
+			case GL_DEBUG_SEVERITY_MEDIUM: return "medium";
+			case GL_DEBUG_SEVERITY_LOW: return "low";
+			default: return "notification";
+		}
+	}
+}
+
+bool gl::is_initiated() { return initiated; }
+
+bool gl::initiate()
+{
+	if (initiated)
+		return true;
+
+	// Core profiles only list extensions through glGetStringi, which GLEW skips otherwise
+	glewExperimental = GL_TRUE;
+	const GLenum result = glewInit();
+	if (result != GLEW_OK)
+	{
+		std::cerr << "OpenGL initiation error: " << reinterpret_cast<const char*>(glewGetErrorString(result)) << std::endl;
+		return false;
+	}
+
+	// glewInit may leave an error behind on core profiles
+	glGetError();
+	initiated = true;
+	return true;
+}
+
+void gl::quit()
+{
+	disable_debug_output();
+	initiated = false;
+}
+
+#ifndef NDEBUG
 bool gl::check_errors()
 {
-	GLenum errCode;
-	const GLubyte* errString;
+	bool ok = true;
+	for (int32_t i = 0; i < MAX_ERRORS; ++i)
+	{
+		const GLenum errCode = glGetError();
+		if (errCode == GL_NO_ERROR)
+			break;
 
-	if ((errCode = glGetError()) != GL_NO_ERROR)
+		std::cerr << "OpenGL error: " << reinterpret_cast<const char*>(gluErrorString(errCode)) << std::endl;
+		ok = false;
+	}
+	return ok;
+}
+#endif
+
+bool gl::enable_debug_output(bool synchronous)
+{
+	if (!GLEW_KHR_debug && !GLEW_VERSION_4_3)
 	{
-		errString = gluErrorString(errCode);
-		std::cerr << "OpenGL error: " << reinterpret_cast<const char*>(errString) << std::endl;
+		std::cerr << "OpenGL error: debug output is not supported" << std::endl;
 		return false;
 	}
 
+	glDebugMessageCallback(debug_callback, nullptr);
+	glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, GL_TRUE);
+	glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, GL_FALSE);
+	glEnable(GL_DEBUG_OUTPUT);
+	if (synchronous)
+		glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+	else
+		glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+
+	debugEnabled.store(true, std::memory_order_relaxed);
 	return true;
 }
+
+void gl::disable_debug_output()
+{
+	if (!debugEnabled.exchange(false, std::memory_order_relaxed))
+		return;
+
+	glDisable(GL_DEBUG_OUTPUT);
+	glDebugMessageCallback(nullptr, nullptr);
+}
+
+bool gl::is_debug_output_enabled()
+{
+	return debugEnabled.load(std::memory_order_relaxed);
+}
+
+size_t gl::drain_debug_messages(std::vector<DebugMessage>* messages)
+{
+	size_t count = 0;
+	DebugMessage message;
+	while (debugMessages.pop(message))
+	{
+		++count;
+		std::cerr << to_string(message) << std::endl;
+		if (messages)
+			messages->push_back(std::move(message));
+	}
+	return count;
+}
+
+std::string gl::to_string(const DebugMessage& message)
+{
+	return std::string{ "OpenGL " } + type_name(message.type) + " (" + source_name(message.source) + ", " +
+		severity_name(message.severity) + ", " + std::to_string(message.id) + "): " + message.text;
+}
+
+
+
+void GLRenderBackend::useProgram(uint32_t program)
+{
+	glUseProgram(program);
+}
+
+void GLRenderBackend::bindTexture(uint32_t texture)
+{
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+}
+
+void GLRenderBackend::bindVertexArray(uint32_t vertexArray)
+{
+	glBindVertexArray(vertexArray);
+}
+
+void GLRenderBackend::setDepth(bool test, bool write)
+{
+	if (test)
+		glEnable(GL_DEPTH_TEST);
+	else
+		glDisable(GL_DEPTH_TEST);
+	glDepthMask(write ? GL_TRUE : GL_FALSE);
+}
+
+void GLRenderBackend::setBlend(bool enabled)
+{
+	if (enabled)
+	{
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	}
+	else
+		glDisable(GL_BLEND);
+}
+
+void GLRenderBackend::draw(uint32_t first, uint32_t count)
+{
+	glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(count), GL_UNSIGNED_INT, reinterpret_cast<const void*>(static_cast<uintptr_t>(first) * sizeof(GLuint)));
+}
@@ -0,0 +1,491 @@
+#include "support/async_io.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#ifdef __linux__
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#define WOC_ASYNC_IO_URING
+#endif
+
+namespace
+{
+	class ThreadPoolIO : public AsyncIO
+	{
+	private:
+		std::vector<std::thread> _threads;
+		std::vector<Request> _staged;
+
+		std::mutex _lock;
+		std::condition_variable _work;
+		std::condition_variable _finished;
+		std::deque<Request> _queue;
+		std::vector<Completion> _done;
+		bool _stopping;
+
+	public:
+		ThreadPoolIO(uint32_t queueDepth, uint32_t threads) :
+			AsyncIO{ queueDepth },
+			_threads{},
+			_staged{},
+			_lock{},
+			_work{},
+			_finished{},
+			_queue{},
+			_done{},
+			_stopping{ false }
+		{
+			for (uint32_t i = 0; i < threads; ++i)
+				_threads.emplace_back(&ThreadPoolIO::run, this);
+		}
+
+		~ThreadPoolIO()
+		{
+			{
+				std::lock_guard<std::mutex> lock{ _lock };
+				_stopping = true;
+			}
+			_work.notify_all();
+			for (std::thread& thread : _threads)
+				thread.join();
+		}
+
+		const char* getName() const override { return "thread pool"; }
+
+	protected:
+		// Blocking reads and writes gain nothing from pinned memory
+		bool pinBuffers(const std::vector<Buffer>&) override { return false; }
+
+		void enqueue(const Request& request) override { _staged.push_back(request); }
+
+		void flush() override
+		{
+			{
+				std::lock_guard<std::mutex> lock{ _lock };
+				_queue.insert(_queue.end(), _staged.begin(), _staged.end());
+			}
+			if (_staged.size() == 1)
+				_work.notify_one();
+			else _work.notify_all();
+			_staged.clear();
+		}
+
+		void reap(std::vector<Completion>& completions, bool block) override
+		{
+			std::unique_lock<std::mutex> lock{ _lock };
+			if (block)
+				_finished.wait(lock, [this]() { return !_done.empty(); });
+			completions.insert(completions.end(), _done.begin(), _done.end());
+			_done.clear();
+		}
+
+	private:
+		void run()
+		{
+			std::unique_lock<std::mutex> lock{ _lock };
+			for (;;)
+			{
+				_work.wait(lock, [this]() { return _stopping || !_queue.empty(); });
+				if (_queue.empty())
+					return;
+
+				Request request = _queue.front();
+				_queue.pop_front();
+				lock.unlock();
+
+				errno = 0;
+				const size_t bytes = request.op == Op::Read
+					? request.file->readAt(request.offset, request.buffer, request.size)
+					: request.file->writeAt(request.offset, request.buffer, request.size);
+				// The blocking calls stop short on errors: report one, like io_uring does
+				const int64_t result = bytes < request.size ? -static_cast<int64_t>(errno != 0 ? errno : EIO) : static_cast<int64_t>(bytes);
+
+				lock.lock();
+				_done.push_back({ request.slot, result });
+				_finished.notify_one();
+			}
+		}
+	};
+
+
+#ifdef WOC_ASYNC_IO_URING
+	/*
+	 * io_uring through the raw system calls: one submission and completion ring pair,
+	 * shared with the kernel through mmap. Only the owning thread touches the rings.
+	 */
+	class UringIO : public AsyncIO
+	{
+	private:
+		int _ring;
+		void* _sqMemory;
+		size_t _sqMemorySize;
+		void* _cqMemory;
+		size_t _cqMemorySize;
+		io_uring_sqe* _sqes;
+		size_t _sqesSize;
+
+		unsigned* _sqHead;
+		unsigned* _sqTail;
+		unsigned _sqMask;
+		unsigned* _sqArray;
+		unsigned* _cqHead;
+		unsigned* _cqTail;
+		unsigned _cqMask;
+		io_uring_cqe* _cqes;
+
+		unsigned _unsubmitted;
+		std::vector<Completion> _rejected;	// Requests the kernel refused, completed by the next reap()
+		std::vector<bool> _submitted;		// Slots handed to the kernel and not completed yet
+		int _error;							// Once the ring failed, every request fails with it
+
+	public:
+		explicit UringIO(uint32_t queueDepth) :
+			AsyncIO{ queueDepth },
+			_ring{ -1 },
+			_sqMemory{ MAP_FAILED },
+			_sqMemorySize{ 0 },
+			_cqMemory{ MAP_FAILED },
+			_cqMemorySize{ 0 },
+			_sqes{ nullptr },
+			_sqesSize{ 0 },
+			_sqHead{ nullptr },
+			_sqTail{ nullptr },
+			_sqMask{ 0 },
+			_sqArray{ nullptr },
+			_cqHead{ nullptr },
+			_cqTail{ nullptr },
+			_cqMask{ 0 },
+			_cqes{ nullptr },
+			_unsubmitted{ 0 },
+			_rejected{},
+			_submitted{},
+			_error{ 0 }
+		{}
+
+		~UringIO()
+		{
+			if (_sqes)
+				munmap(_sqes, _sqesSize);
+			if (_cqMemory != MAP_FAILED && _cqMemory != _sqMemory)
+				munmap(_cqMemory, _cqMemorySize);
+			if (_sqMemory != MAP_FAILED)
+				munmap(_sqMemory, _sqMemorySize);
+			if (_ring >= 0)
+				::close(_ring);
+		}
+
+		bool init()
+		{
+			io_uring_params params;
+			std::memset(&params, 0, sizeof(params));
+			_ring = static_cast<int>(syscall(__NR_io_uring_setup, getQueueDepth(), &params));
+			if (_ring < 0)
+				return false;
+
+			_sqMemorySize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+			_cqMemorySize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+			const bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+			if (singleMap)
+				_sqMemorySize = _cqMemorySize = std::max(_sqMemorySize, _cqMemorySize);
+
+			_sqMemory = mmap(nullptr, _sqMemorySize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring, IORING_OFF_SQ_RING);
+			if (_sqMemory == MAP_FAILED)
+				return false;
+			_cqMemory = singleMap ? _sqMemory : mmap(nullptr, _cqMemorySize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring, IORING_OFF_CQ_RING);
+			if (_cqMemory == MAP_FAILED)
+				return false;
+
+			_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+			void* sqes = mmap(nullptr, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring, IORING_OFF_SQES);
+			if (sqes == MAP_FAILED)
+				return false;
+			_sqes = static_cast<io_uring_sqe*>(sqes);
+
+			uint8_t* sq = static_cast<uint8_t*>(_sqMemory);
+			_sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+			_sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+			_sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+			_sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+			uint8_t* cq = static_cast<uint8_t*>(_cqMemory);
+			_cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+			_cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+			_cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+			_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+			return true;
+		}
+
+		const char* getName() const override { return "io_uring"; }
+
+	protected:
+		bool pinBuffers(const std::vector<Buffer>& buffers) override
+		{
+			std::vector<iovec> iovecs;
+			for (const Buffer& buffer : buffers)
+				iovecs.push_back({ buffer.first, buffer.second });
+
+			return syscall(__NR_io_uring_register, _ring, IORING_REGISTER_BUFFERS, iovecs.data(), static_cast<unsigned>(iovecs.size())) == 0;
+		}
+
+		void enqueue(const Request& request) override
+		{
+			const unsigned tail = *_sqTail;
+			const unsigned index = tail & _sqMask;
+
+			io_uring_sqe& sqe = _sqes[index];
+			std::memset(&sqe, 0, sizeof(sqe));
+			if (request.bufferIndex >= 0)
+			{
+				sqe.opcode = request.op == Op::Read ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+				sqe.buf_index = static_cast<uint16_t>(request.bufferIndex);
+			}
+			else sqe.opcode = request.op == Op::Read ? IORING_OP_READ : IORING_OP_WRITE;
+			sqe.fd = request.file->nativeHandle();
+			sqe.off = request.offset;
+			sqe.addr = reinterpret_cast<uint64_t>(request.buffer);
+			sqe.len = static_cast<uint32_t>(request.size);
+			sqe.user_data = request.slot;
+			if (request.slot >= _submitted.size())
+				_submitted.resize(request.slot + 1, false);
+			_submitted[request.slot] = true;
+
+			_sqArray[index] = index;
+			__atomic_store_n(_sqTail, tail + 1, __ATOMIC_RELEASE);
+			++_unsubmitted;
+		}
+
+		void flush() override
+		{
+			while (_unsubmitted > 0 && _error == 0)
+			{
+				long submitted = syscall(__NR_io_uring_enter, _ring, _unsubmitted, 0, 0, nullptr, 0);
+				if (submitted < 0)
+				{
+					if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+						continue;
+					const int error = errno;
+					std::cerr << "Async I/O error: io_uring_enter failed: " << std::strerror(error) << std::endl;
+					reject(error);
+					return;
+				}
+				_unsubmitted -= static_cast<unsigned>(submitted);
+			}
+			if (_unsubmitted > 0)
+				reject(_error);
+		}
+
+		void reap(std::vector<Completion>& completions, bool block) override
+		{
+			completions.insert(completions.end(), _rejected.begin(), _rejected.end());
+			_rejected.clear();
+
+			while (_error == 0)
+			{
+				unsigned head = *_cqHead;
+				const unsigned tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+				for (; head != tail; ++head)
+				{
+					const io_uring_cqe& cqe = _cqes[head & _cqMask];
+					_submitted[cqe.user_data] = false;
+					completions.push_back({ static_cast<uint32_t>(cqe.user_data), static_cast<int64_t>(cqe.res) });
+				}
+				__atomic_store_n(_cqHead, head, __ATOMIC_RELEASE);
+
+				if (!block || !completions.empty())
+					return;
+
+				if (syscall(__NR_io_uring_enter, _ring, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR)
+				{
+					// The ring is unusable: fail what the kernel holds, so that drain() ends
+					_error = errno;
+					std::cerr << "Async I/O error: io_uring_enter failed: " << std::strerror(_error) << std::endl;
+					for (uint32_t slot = 0; slot < _submitted.size(); ++slot)
+						if (_submitted[slot])
+						{
+							_submitted[slot] = false;
+							completions.push_back({ slot, -static_cast<int64_t>(_error) });
+						}
+				}
+			}
+		}
+
+	private:
+		// The kernel did not consume the unsubmitted entries: takes them back and fails their
+		// requests, so that nobody waits for them
+		void reject(int error)
+		{
+			const unsigned tail = *_sqTail;
+			for (unsigned i = tail - _unsubmitted; i != tail; ++i)
+			{
+				const uint32_t slot = static_cast<uint32_t>(_sqes[_sqArray[i & _sqMask]].user_data);
+				_submitted[slot] = false;
+				_rejected.push_back({ slot, -static_cast<int64_t>(error) });
+			}
+			__atomic_store_n(_sqTail, tail - _unsubmitted, __ATOMIC_RELEASE);
+			_unsubmitted = 0;
+		}
+	};
+#endif
+}
+
+std::unique_ptr<AsyncIO> AsyncIO::create(uint32_t queueDepth, Backend backend)
+{
+	queueDepth = std::max<uint32_t>(1, queueDepth);
+
+#ifdef WOC_ASYNC_IO_URING
+	if (backend != Backend::ThreadPool)
+	{
+		std::unique_ptr<UringIO> uring{ new UringIO{ queueDepth } };
+		if (uring->init())
+			return uring;
+		if (backend == Backend::Uring)
+		{
+			std::cerr << "Async I/O error: io_uring is not available" << std::endl;
+			return nullptr;
+		}
+	}
+#else
+	if (backend == Backend::Uring)
+	{
+		std::cerr << "Async I/O error: io_uring is not available" << std::endl;
+		return nullptr;
+	}
+#endif
+
+	const uint32_t threads = std::min<uint32_t>(queueDepth, 32);
+	return std::unique_ptr<AsyncIO>{ new ThreadPoolIO{ queueDepth, threads } };
+}
+
+AsyncIO::AsyncIO(uint32_t queueDepth) :
+	_depth{ queueDepth },
+	_inFlight{ 0 },
+	_callbacks{},
+	_freeSlots{},
+	_buffers{},
+	_backlog{},
+	_completions{}
+{}
+
+AsyncIO::~AsyncIO() {}
+
+bool AsyncIO::registerBuffers(const std::vector<Buffer>& buffers)
+{
+	if (!_buffers.empty() || buffers.empty() || !pinBuffers(buffers))
+		return false;
+
+	_buffers = buffers;
+	return true;
+}
+
+void AsyncIO::read(const File& file, uint64_t offset, void* buffer, size_t size, Callback callback)
+{
+	queue(Op::Read, const_cast<File&>(file), offset, buffer, size, std::move(callback));
+}
+
+void AsyncIO::write(File& file, uint64_t offset, const void* buffer, size_t size, Callback callback)
+{
+	queue(Op::Write, file, offset, const_cast<void*>(buffer), size, std::move(callback));
+}
+
+size_t AsyncIO::submit()
+{
+	size_t count = 0;
+	while (!_backlog.empty() && _inFlight < _depth)
+	{
+		enqueue(_backlog.front());
+		_backlog.pop_front();
+		++_inFlight;
+		++count;
+	}
+
+	if (count > 0)
+		flush();
+	return count;
+}
+
+size_t AsyncIO::poll()
+{
+	if (_inFlight > 0)
+		reap(_completions, false);
+	return dispatch();
+}
+
+size_t AsyncIO::wait()
+{
+	if (_inFlight == 0 && submit() == 0)
+		return 0;
+
+	reap(_completions, true);
+	return dispatch();
+}
+
+void AsyncIO::drain()
+{
+	while (getPending() > 0)
+		wait();
+}
+
+void AsyncIO::queue(Op op, File& file, uint64_t offset, void* buffer, size_t size, Callback callback)
+{
+	uint32_t slot;
+	if (_freeSlots.empty())
+	{
+		slot = static_cast<uint32_t>(_callbacks.size());
+		_callbacks.push_back(std::move(callback));
+	}
+	else
+	{
+		slot = _freeSlots.back();
+		_freeSlots.pop_back();
+		_callbacks[slot] = std::move(callback);
+	}
+
+	_backlog.push_back({ op, &file, offset, buffer, size, findBuffer(buffer, size), slot });
+}
+
+int32_t AsyncIO::findBuffer(const void* buffer, size_t size) const
+{
+	const uint8_t* begin = static_cast<const uint8_t*>(buffer);
+	for (size_t i = 0; i < _buffers.size(); ++i)
+	{
+		const uint8_t* base = static_cast<const uint8_t*>(_buffers[i].first);
+		if (begin >= base && begin + size <= base + _buffers[i].second)
+			return static_cast<int32_t>(i);
+	}
+	return -1;
+}
+
+size_t AsyncIO::dispatch()
+{
+	// Callbacks may queue new requests, so they run from a local copy
+	std::vector<Completion> completions;
+	completions.swap(_completions);
+
+	for (const Completion& completion : completions)
+	{
+		--_inFlight;
+		Callback callback = std::move(_callbacks[completion.slot]);
+		_callbacks[completion.slot] = nullptr;
+		_freeSlots.push_back(completion.slot);
+		if (callback)
+			callback(completion.result);
+	}
+
+	submit();
+
+	// Keep the capacity around for the next reap
+	const size_t count = completions.size();
+	completions.clear();
+	if (_completions.empty())
+		_completions.swap(completions);
+	return count;
+}
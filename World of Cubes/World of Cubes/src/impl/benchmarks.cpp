@@ -0,0 +1,1387 @@
+#include "engine/benchmarks.h"
+
+#include <opengl/glew.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <thread>
+#include <unordered_map>
+
+#include "engine/block_registry.h"
+#include "engine/terrain_generator.h"
+#include "engine/region_file.h"
+#include "engine/chunk_serializer.h"
+#include "engine/world.h"
+#include "engine/world_saver.h"
+#include "engine/chunk_streamer.h"
+#include "engine/chunk_mesher.h"
+#include "engine/mesh_pipeline.h"
+#include "engine/lod_mesher.h"
+#include "engine/software_rasterizer.h"
+#include "engine/occlusion_culler.h"
+#include "engine/section_visibility.h"
+#include "engine/block_textures.h"
+#include "engine/heightmap.h"
+#include "support/clock.h"
+#include "support/async_io.h"
+#include "support/pool.h"
+#include "support/render_commands.h"
+#include "support/stream_buffer.h"
+#include "support/GL.h"
+#include "support/SDL.h"
+
+namespace
+{
+	constexpr int32_t AREA_CHUNKS = 32;
+	constexpr int32_t AREA_HEIGHT = 4;
+
+	bool load_registry(BlockRegistry& registry)
+	{
+		if (registry.load("data/blocks.json", "data/blocks.cache"))
+			return true;
+
+		std::cerr << "Benchmark error: cannot load the block definitions" << std::endl;
+		return false;
+	}
+
+	inline std::string arg(const std::vector<std::string>& args, size_t index, const std::string& defaultValue)
+	{
+		return index < args.size() ? args[index] : defaultValue;
+	}
+
+	bool save_area(const std::string& directory, const TerrainGenerator& generator)
+	{
+		RegionStorage storage{ directory };
+		for (int32_t y = 0; y < AREA_HEIGHT; ++y)
+			for (int32_t z = 0; z < AREA_CHUNKS; ++z)
+				for (int32_t x = 0; x < AREA_CHUNKS; ++x)
+				{
+					Chunk chunk{ { x, y, z } };
+					generator.generate(chunk);
+					if (!storage.saveChunk(chunk.snapshot()))
+						return false;
+				}
+		return storage.syncAll();
+	}
+
+	// Chunks 0 to area - 1 on x and z, 0 to AREA_HEIGHT - 1 on y, with generated terrain
+	void generate_area(World& world, TerrainGenerator& generator, int32_t area, bool dirty = false)
+	{
+		for (int32_t y = 0; y < AREA_HEIGHT; ++y)
+			for (int32_t z = 0; z < area; ++z)
+				for (int32_t x = 0; x < area; ++x)
+				{
+					std::unique_ptr<Chunk> chunk{ new Chunk{ { x, y, z } } };
+					generator.generate(*chunk);
+					world.addChunk(std::move(chunk), dirty);
+				}
+	}
+
+	// Mesher inputs of a generated area but its outer ring, which only provides neighbors
+	std::vector<ChunkNeighborhood> gather_inner(const World& world, int32_t area)
+	{
+		std::vector<ChunkNeighborhood> inputs;
+		inputs.reserve(static_cast<size_t>(area - 2) * (area - 2) * AREA_HEIGHT);
+		for (int32_t y = 0; y < AREA_HEIGHT; ++y)
+			for (int32_t z = 1; z < area - 1; ++z)
+				for (int32_t x = 1; x < area - 1; ++x)
+				{
+					inputs.emplace_back();
+					ChunkNeighborhood::gather(world, { x, y, z }, inputs.back());
+				}
+		return inputs;
+	}
+
+	void print_time(const char* label, const Time& time, size_t count)
+	{
+		std::cout << std::fixed << std::setprecision(2)
+			<< "  " << std::left << std::setw(12) << label << std::right
+			<< std::setw(10) << time.asMicroseconds() / 1000.0 << " ms"
+			<< std::setw(10) << static_cast<double>(time.asMicroseconds()) / count << " us/chunk" << std::endl;
+	}
+}
+
+bool bench::run(const std::string& name, const std::vector<std::string>& args)
+{
+	if (name == "region_load")
+		return region_load(arg(args, 0, "bench-world"));
+	if (name == "chunk_codec")
+		return chunk_codec();
+	if (name == "autosave")
+		return autosave(arg(args, 0, "bench-world"));
+	if (name == "streaming")
+		return streaming(std::stof(arg(args, 0, "40")));
+	if (name == "async_io")
+		return async_io(arg(args, 0, "bench-world"), static_cast<uint32_t>(std::stoul(arg(args, 1, "128"))));
+	if (name == "meshing")
+		return meshing();
+	if (name == "remeshing")
+		return remeshing(static_cast<uint32_t>(std::stoul(arg(args, 0, "200"))));
+	if (name == "lod")
+		return lod(std::stoi(arg(args, 0, "8")));
+	if (name == "render")
+		return render(static_cast<uint32_t>(std::stoul(arg(args, 0, "0"))), arg(args, 1, ""));
+	if (name == "occlusion")
+		return occlusion(static_cast<size_t>(std::stoul(arg(args, 0, "64"))));
+	if (name == "caves")
+		return caves(std::stoi(arg(args, 0, "16")));
+	if (name == "commands")
+		return commands(static_cast<size_t>(std::stoul(arg(args, 0, "20000"))));
+	if (name == "uploads")
+		return uploads(static_cast<size_t>(std::stoul(arg(args, 0, "2000"))));
+	if (name == "textures")
+		return textures(static_cast<uint32_t>(std::stoul(arg(args, 0, "256"))), static_cast<uint32_t>(std::stoul(arg(args, 1, "0"))));
+	if (name == "gl_debug")
+		return gl_debug(static_cast<size_t>(std::stoul(arg(args, 0, "100000"))));
+
+	std::cerr << "Benchmark error: unknown benchmark '" << name << "'" << std::endl;
+	list();
+	return false;
+}
+
+void bench::list()
+{
+	std::cout << "Benchmarks:" << std::endl
+		<< "  region_load [directory]" << std::endl
+		<< "  chunk_codec" << std::endl
+		<< "  autosave [directory]" << std::endl
+		<< "  async_io [directory] [queue depth]" << std::endl
+		<< "  streaming [blocks per second]" << std::endl
+		<< "  meshing" << std::endl
+		<< "  remeshing [edits]" << std::endl
+		<< "  lod [full detail radius]" << std::endl
+		<< "  render [threads] [image.ppm]" << std::endl
+		<< "  occlusion [occluder chunks]" << std::endl
+		<< "  caves [radius in sections]" << std::endl
+		<< "  commands [draws]" << std::endl
+		<< "  uploads [meshes]" << std::endl
+		<< "  textures [size] [threads]" << std::endl
+		<< "  gl_debug [calls]" << std::endl;
+}
+
+bool bench::region_load(const std::string& directory)
+{
+	BlockRegistry registry;
+	if (!load_registry(registry))
+		return false;
+
+	TerrainGenerator generator{ registry, 1337 };
+	const size_t count = static_cast<size_t>(AREA_CHUNKS) * AREA_CHUNKS * AREA_HEIGHT;
+
+	Clock clock;
+	if (!save_area(directory, generator))
+		return false;
+	std::cout << "region_load: " << AREA_CHUNKS << "x" << AREA_CHUNKS << "x" << AREA_HEIGHT << " chunks" << std::endl;
+	print_time("generate+save", clock.reset(), count);
+
+	RegionStorage storage{ directory };
+	auto loadAll = [&storage](size_t& blocks) {
+		Chunk chunk;
+		for (int32_t y = 0; y < AREA_HEIGHT; ++y)
+			for (int32_t z = 0; z < AREA_CHUNKS; ++z)
+				for (int32_t x = 0; x < AREA_CHUNKS; ++x)
+				{
+					if (!storage.loadChunk({ x, y, z }, chunk))
+						return false;
+					blocks += chunk.getBlock(0, 0, 0);
+				}
+		return true;
+	};
+
+	// Open every region first so that the cold pass measures page faults, not file opens
+	size_t checksum = 0;
+	for (int32_t y = 0; y <= (AREA_HEIGHT - 1) >> RegionFile::SIZE_BITS; ++y)
+		for (int32_t z = 0; z <= (AREA_CHUNKS - 1) >> RegionFile::SIZE_BITS; ++z)
+			for (int32_t x = 0; x <= (AREA_CHUNKS - 1) >> RegionFile::SIZE_BITS; ++x)
+				storage.getRegion({ x, y, z }, false);
+	storage.dropCaches();
+
+	clock.reset();
+	if (!loadAll(checksum))
+		return false;
+	Time cold = clock.reset();
+	if (!loadAll(checksum))
+		return false;
+	Time warm = clock.reset();
+
+	print_time("cold load", cold, count);
+	print_time("warm load", warm, count);
+	std::cout << "  cold/warm   " << std::setw(10) << static_cast<double>(cold.asMicroseconds()) / std::max<int64_t>(warm.asMicroseconds(), 1) << "x"
+		<< "  (" << checksum << ")" << std::endl;
+	return true;
+}
+
+bool bench::chunk_codec()
+{
+	BlockRegistry registry;
+	if (!load_registry(registry))
+		return false;
+
+	constexpr int32_t area = 16;
+	constexpr int32_t decodePasses = 8;
+
+	TerrainGenerator generator{ registry, 1337 };
+	std::vector<ChunkSnapshot> snapshots;
+	for (int32_t y = 0; y < AREA_HEIGHT; ++y)
+		for (int32_t z = 0; z < area; ++z)
+			for (int32_t x = 0; x < area; ++x)
+			{
+				Chunk chunk{ { x, y, z } };
+				generator.generate(chunk);
+				snapshots.push_back(chunk.snapshot());
+			}
+
+	size_t rawBytes = 0;
+	for (const ChunkSnapshot& snapshot : snapshots)
+		for (int32_t i = 0; i < Chunk::SECTION_COUNT; ++i)
+			if (snapshot.getSection(i))
+				rawBytes += ChunkSection::VOLUME * sizeof(BlockId);
+
+	std::cout << "chunk_codec: " << snapshots.size() << " chunks, " << rawBytes / 1024 << " KB of non-empty sections" << std::endl;
+
+	const char* names[CHUNK_COMPRESSION_COUNT] = { "none", "run-length", "palette" };
+	std::vector<std::vector<uint8_t>> payloads{ snapshots.size() };
+	for (uint8_t c = 0; c < CHUNK_COMPRESSION_COUNT; ++c)
+	{
+		const ChunkCompression compression = static_cast<ChunkCompression>(c);
+
+		Clock clock;
+		size_t encodedBytes = 0;
+		for (size_t i = 0; i < snapshots.size(); ++i)
+		{
+			chunk_io::encode(snapshots[i], compression, payloads[i]);
+			encodedBytes += payloads[i].size();
+		}
+		Time encodeTime = clock.reset();
+
+		Chunk chunk;
+		for (int32_t pass = 0; pass < decodePasses; ++pass)
+			for (const std::vector<uint8_t>& payload : payloads)
+				if (!chunk_io::decode(payload.data(), payload.size(), compression, chunk))
+				{
+					std::cerr << "Benchmark error: " << names[c] << " failed to decode" << std::endl;
+					return false;
+				}
+		Time decodeTime = clock.reset() / static_cast<int64_t>(decodePasses);
+
+		auto throughput = [rawBytes](const Time& time) {
+			return static_cast<double>(rawBytes) / std::max<int64_t>(time.asMicroseconds(), 1);
+		};
+		std::cout << std::fixed << std::setprecision(2)
+			<< "  " << std::left << std::setw(12) << names[c] << std::right
+			<< std::setw(10) << encodedBytes / 1024 << " KB"
+			<< std::setw(9) << static_cast<double>(rawBytes) / encodedBytes << "x"
+			<< std::setw(10) << throughput(encodeTime) << " MB/s enc"
+			<< std::setw(10) << throughput(decodeTime) << " MB/s dec" << std::endl;
+	}
+	return true;
+}
+
+bool bench::autosave(const std::string& directory)
+{
+	BlockRegistry registry;
+	if (!load_registry(registry))
+		return false;
+
+	constexpr int32_t area = 16;
+	constexpr int32_t rounds = 10;
+	constexpr int32_t editsPerRound = 2000;
+
+	TerrainGenerator generator{ registry, 1337 };
+	World world;
+	generate_area(world, generator, area, true);
+
+	RegionStorage storage{ directory };
+	WorldSaver saver{ storage, directory + "/world.journal" };
+	if (!saver.recover() || !saver.start())
+		return false;
+
+	std::cout << "autosave: " << world.getChunkCount() << " chunks, " << rounds << " rounds of " << editsPerRound << " random edits" << std::endl;
+
+	std::mt19937 random{ 42 };
+	std::uniform_int_distribution<int32_t> horizontal{ 0, area * Chunk::SIZE - 1 };
+	std::uniform_int_distribution<int32_t> vertical{ 0, AREA_HEIGHT * Chunk::SIZE - 1 };
+	const BlockId stone = registry.find("stone");
+
+	Time totalStall, maxStall;
+	for (int32_t round = 0; round <= rounds; ++round)
+	{
+		// Round 0 saves the whole freshly generated area
+		if (round > 0)
+			for (int32_t i = 0; i < editsPerRound; ++i)
+				world.setBlock({ horizontal(random), vertical(random), horizontal(random) }, i & 1 ? stone : blocks::AIR);
+
+		const size_t dirty = world.getDirtyCount();
+		Time stall = saver.autosave(world);
+		if (!saver.flush())
+			return false;
+
+		SaveStats stats = saver.getStats();
+		std::cout << std::fixed << std::setprecision(3)
+			<< "  round " << std::setw(2) << round << ": " << std::setw(5) << dirty << " chunks, stall "
+			<< std::setw(7) << stall.asMicroseconds() / 1000.0 << " ms, background "
+			<< std::setw(8) << stats.lastBatch.asMicroseconds() / 1000.0 << " ms" << std::endl;
+
+		if (round > 0)
+		{
+			totalStall += stall;
+			maxStall = std::max(maxStall, stall);
+		}
+	}
+
+	saver.stop();
+	SaveStats stats = saver.getStats();
+	std::cout << "  stall avg " << (totalStall / static_cast<int64_t>(rounds)).asMicroseconds() / 1000.0
+		<< " ms, max " << maxStall.asMicroseconds() / 1000.0 << " ms; "
+		<< stats.chunks << " chunks in " << stats.batches << " batches, " << stats.checkpoints << " checkpoints" << std::endl;
+	return true;
+}
+
+bool bench::async_io(const std::string& directory, uint32_t queueDepth)
+{
+	BlockRegistry registry;
+	if (!load_registry(registry))
+		return false;
+
+	RegionStorage storage{ directory };
+	if (!storage.getRegion({ 0, 0, 0 }, false))
+	{
+		TerrainGenerator generator{ registry, 1337 };
+		if (!save_area(directory, generator))
+			return false;
+	}
+
+	struct Record
+	{
+		const RegionFile* region;
+		uint64_t offset;
+		size_t size;
+	};
+	std::vector<Record> records;
+	for (int32_t y = 0; y < AREA_HEIGHT; ++y)
+		for (int32_t z = 0; z < AREA_CHUNKS; ++z)
+			for (int32_t x = 0; x < AREA_CHUNKS; ++x)
+			{
+				Record record;
+				record.region = storage.getRegion(RegionFile::regionCoords({ x, y, z }), false);
+				if (record.region && record.region->getRecordSpan(RegionFile::localCoords({ x, y, z }), record.offset, record.size))
+					records.push_back(record);
+			}
+
+	constexpr size_t bufferSize = 64 << 10;
+	std::cout << "async_io: " << records.size() << " chunk records, queue depth " << queueDepth << ", cold page cache" << std::endl;
+
+	// The blocking baseline: one read() per chunk on the calling thread
+	{
+		std::vector<uint8_t> buffer;
+		Chunk chunk;
+		storage.dropCaches();
+		Clock clock;
+		for (const Record& record : records)
+		{
+			buffer.resize(record.size);
+			if (record.region->getFile().readAt(record.offset, buffer.data(), record.size) != record.size ||
+				!RegionFile::decodeRecord(buffer.data(), record.size, chunk))
+				return false;
+		}
+		print_time("blocking", clock.getElapsedTime(), records.size());
+	}
+
+	const AsyncIO::Backend backends[] = { AsyncIO::Backend::ThreadPool, AsyncIO::Backend::Uring };
+	for (AsyncIO::Backend backend : backends)
+	{
+		std::unique_ptr<AsyncIO> io = AsyncIO::create(queueDepth, backend);
+		if (!io)
+			continue;
+
+		SlabPool buffers{ bufferSize, 4 << 20 };
+		buffers.reserve(queueDepth);
+		bool registered = io->registerBuffers(buffers.getSlabs());
+
+		Chunk chunk;
+		size_t failures = 0;
+		size_t next = 0;
+		storage.dropCaches();
+		Clock clock;
+		while (next < records.size() || io->getPending() > 0)
+		{
+			for (; next < records.size() && io->getPending() < queueDepth; ++next)
+			{
+				const Record& record = records[next];
+				uint8_t* buffer = record.size <= bufferSize ? static_cast<uint8_t*>(buffers.allocate()) : nullptr;
+				if (!buffer)
+				{
+					++failures;
+					continue;
+				}
+
+				io->read(record.region->getFile(), record.offset, buffer, record.size, [&, buffer, record](int64_t result) {
+					if (result != static_cast<int64_t>(record.size) || !RegionFile::decodeRecord(buffer, record.size, chunk))
+						++failures;
+					buffers.deallocate(buffer);
+				});
+			}
+			io->submit();
+			io->wait();
+		}
+
+		std::string label = std::string{ io->getName() } + (registered ? "*" : "");
+		print_time(label.c_str(), clock.getElapsedTime(), records.size());
+		if (failures > 0)
+		{
+			std::cerr << "Benchmark error: " << failures << " reads failed with " << io->getName() << std::endl;
+			return false;
+		}
+	}
+	std::cout << "  (* registered buffers)" << std::endl;
+	return true;
+}
+
+bool bench::streaming(float speed)
+{
+	BlockRegistry registry;
+	if (!load_registry(registry))
+		return false;
+
+	constexpr int32_t frames = 1200;
+	const Time frameTime = Time::microseconds(16667);
+
+	TerrainGenerator generator{ registry, 1337 };
+	World world;
+	const uint32_t workers = std::max(1u, std::thread::hardware_concurrency() / 2);
+	ChunkStreamer streamer{ world, nullptr, generator, workers };
+	streamer.setRadius(6, 8);
+	streamer.setVerticalRange(0, 3);
+
+	StreamBudget budget;
+	budget.load = Time::milliseconds(1);
+	budget.generate = Time::milliseconds(4);
+	budget.mesh = Time::milliseconds(1);
+	budget.unload = Time::microseconds(500);
+
+	std::vector<StreamObserver> observers(1);
+	observers[0].position = { 0.0f, 80.0f, 0.0f };
+	observers[0].velocity = { speed, 0.0f, 0.0f };
+	observers[0].direction = { 1.0f, 0.0f, 0.0f };
+
+	std::cout << "streaming: " << frames << " frames at " << speed << " blocks/s, radius "
+		<< streamer.getLoadRadius() << "/" << streamer.getUnloadRadius() << ", " << workers << " workers" << std::endl;
+
+	Time total, worst;
+	size_t generated = 0, unloaded = 0;
+	int32_t minAhead = streamer.getLoadRadius();
+	for (int32_t frame = 0; frame < frames; ++frame)
+	{
+		Clock clock;
+		streamer.update(observers, budget);
+		Time elapsed = clock.getElapsedTime();
+		total += elapsed;
+		worst = std::max(worst, elapsed);
+		generated += streamer.getStats().generated;
+		unloaded += streamer.getStats().unloaded;
+
+		// Ready chunks straight ahead of the observer, measured once the initial area had time to fill
+		const vec3i here = Chunk::chunkCoords({ static_cast<int32_t>(observers[0].position.x), 80, 0 });
+		int32_t ahead = 0;
+		while (ahead < streamer.getLoadRadius() && streamer.getState({ here.x + ahead, here.y, here.z }) == ChunkStreamer::State::Ready)
+			++ahead;
+		if (frame >= 120)
+			minAhead = std::min(minAhead, ahead);
+
+		observers[0].position += observers[0].velocity * frameTime.asSeconds();
+
+		// Real time pacing, the worker threads generate while the frame would be rendered
+		Time remaining = frameTime - clock.getElapsedTime();
+		if (remaining > Time::microseconds(0))
+			std::this_thread::sleep_for(std::chrono::microseconds{ remaining.asMicroseconds() });
+	}
+
+	std::cout << std::fixed << std::setprecision(3)
+		<< "  update avg " << (total / static_cast<int64_t>(frames)).asMicroseconds() / 1000.0 << " ms, max "
+		<< worst.asMicroseconds() / 1000.0 << " ms" << std::endl
+		<< "  " << generated << " chunks generated, " << unloaded << " unloaded, " << world.getChunkCount() << " resident" << std::endl
+		<< "  ready chunks ahead after warm-up: at least " << minAhead << std::endl;
+	return true;
+}
+
+bool bench::meshing()
+{
+	BlockRegistry registry;
+	if (!load_registry(registry))
+		return false;
+
+	constexpr int32_t area = 10;
+	constexpr int32_t passes = 4;
+
+	TerrainGenerator generator{ registry, 1337 };
+	World world{ &registry };
+	generate_area(world, generator, area);
+
+	const std::vector<ChunkNeighborhood> inputs = gather_inner(world, area);
+
+	ChunkMesher mesher{ registry };
+	ChunkMesh mesh;
+	size_t quads = 0, faces = 0, nonEmpty = 0, vertices = 0;
+	Clock clock;
+	for (int32_t pass = 0; pass < passes; ++pass)
+		for (const ChunkNeighborhood& input : inputs)
+		{
+			mesher.build(input, mesh);
+			if (pass == 0)
+			{
+				quads += mesh.quads.size();
+				faces += mesher.getFaceCount();
+				vertices += mesh.vertices.size();
+				nonEmpty += mesh.quads.empty() ? 0 : 1;
+			}
+		}
+	Time elapsed = clock.getElapsedTime() / static_cast<int64_t>(passes);
+
+	std::cout << "meshing: " << inputs.size() << " chunks, " << nonEmpty << " with faces" << std::endl;
+	print_time("greedy", elapsed, inputs.size());
+	std::cout << std::fixed << std::setprecision(1)
+		<< "  " << static_cast<double>(faces) / inputs.size() << " faces/chunk -> "
+		<< static_cast<double>(quads) / inputs.size() << " quads/chunk ("
+		<< static_cast<double>(faces) / std::max<size_t>(quads, 1) << "x fewer)" << std::endl;
+
+	// Against a float position, normal and UV, a color and a texture layer per vertex
+	constexpr size_t unpackedSize = sizeof(vec3f) * 2 + sizeof(vec2f) + sizeof(Color) + sizeof(uint32_t);
+	std::cout << "  vertices   " << std::setw(10) << vertices * sizeof(PackedVertex) / 1024 << " KB packed, "
+		<< vertices * unpackedSize / 1024 << " KB unpacked" << std::endl;
+	return true;
+}
+
+bool bench::remeshing(uint32_t edits)
+{
+	BlockRegistry registry;
+	if (!load_registry(registry))
+		return false;
+
+	constexpr int32_t area = 6;
+	const BlockId stone = registry.find("stone");
+
+	TerrainGenerator generator{ registry, 1337 };
+	World world{ &registry };
+	generate_area(world, generator, area);
+
+	MeshPipeline pipeline{ registry, 2 };
+	const MeshBudget unlimited{ SIZE_MAX, Time::seconds(1.0f) };
+	auto drain = [&pipeline, &unlimited]() {
+		do
+		{
+			std::this_thread::yield();
+			pipeline.update(unlimited);
+		}
+		while (!pipeline.isIdle());
+	};
+
+	for (int32_t y = 0; y < AREA_HEIGHT; ++y)
+		for (int32_t z = 0; z < area; ++z)
+			for (int32_t x = 0; x < area; ++x)
+				pipeline.request(world, { x, y, z });
+	drain();
+
+	// Alternately dig the top block of a random column and put it back, like a player would
+	std::mt19937 random{ 42 };
+	std::uniform_int_distribution<int32_t> column{ 0, area * Chunk::SIZE - 1 };
+	Time total, worst;
+	size_t done = 0, sections = 0;
+	for (uint32_t i = 0; i < edits; ++i)
+	{
+		const int32_t x = column(random), z = column(random);
+		const int32_t height = world.getHeight(HeightmapType::Opaque, x, z);
+		if (height == Heightmaps::NONE || height + 1 >= AREA_HEIGHT * Chunk::SIZE)
+			continue;
+
+		const vec3i position{ x, i % 2 ? height + 1 : height, z };
+		Clock clock;
+		world.setBlock(position, i % 2 ? stone : blocks::AIR);
+		pipeline.requestBlock(world, position, height);
+		size_t uploaded = 0;
+		do
+		{
+			std::this_thread::yield();
+			pipeline.update(unlimited);
+			uploaded += pipeline.getStats().uploadedSections;
+		}
+		while (!pipeline.isIdle());
+
+		const Time elapsed = clock.getElapsedTime();
+		total += elapsed;
+		worst = std::max(worst, elapsed);
+		sections += uploaded;
+		++done;
+	}
+
+	// What the same edit costs one worker per section against the whole chunk
+	ChunkMesher mesher{ registry };
+	ChunkNeighborhood input;
+	ChunkMesh mesh;
+	ChunkNeighborhood::gather(world, { area / 2, 1, area / 2 }, input);
+	constexpr int32_t passes = 50;
+	Clock clock;
+	for (int32_t pass = 0; pass < passes; ++pass)
+		mesher.build(input, mesh);
+	const Time whole = clock.reset() / static_cast<int64_t>(passes);
+	for (int32_t pass = 0; pass < passes; ++pass)
+	{
+		mesher.prepare(input);
+		mesher.buildSection(pass % Chunk::SECTION_COUNT, mesh);
+	}
+	const Time section = clock.getElapsedTime() / static_cast<int64_t>(passes);
+
+	done = std::max<size_t>(done, 1);
+	std::cout << "remeshing: " << done << " edits, " << area << "x" << area << "x" << AREA_HEIGHT << " chunks" << std::endl
+		<< std::fixed << std::setprecision(3)
+		<< "  place-to-visible avg " << (total / static_cast<int64_t>(done)).asMicroseconds() / 1000.0
+		<< " ms, max " << worst.asMicroseconds() / 1000.0 << " ms" << std::endl
+		<< std::setprecision(1)
+		<< "  " << static_cast<double>(sections) / done << " sections remeshed per edit" << std::endl
+		<< "  one section " << section.asMicroseconds() << " us, whole chunk " << whole.asMicroseconds() << " us" << std::endl;
+	return true;
+}
+
+bool bench::lod(int32_t fullRadius)
+{
+	BlockRegistry registry;
+	if (!load_registry(registry))
+		return false;
+
+	constexpr int32_t area = 10;
+	constexpr int32_t levels = 4;
+
+	TerrainGenerator generator{ registry, 1337 };
+	World world{ &registry };
+	generate_area(world, generator, area);
+
+	const std::vector<ChunkNeighborhood> inputs = gather_inner(world, area);
+
+	// Quads of a column of AREA_HEIGHT chunks at each level, skirts on one side out of three
+	// as a ring of chunks has on average
+	ChunkMesher mesher{ registry };
+	LodMesher lodMesher{ registry };
+	ChunkMesh mesh;
+	double columnQuads[levels];
+	std::cout << "lod: " << inputs.size() << " chunks" << std::endl;
+	for (int32_t level = 0; level < levels; ++level)
+	{
+		size_t quads = 0;
+		Clock clock;
+		for (size_t i = 0; i < inputs.size(); ++i)
+		{
+			if (level == 0)
+				mesher.build(inputs[i], mesh);
+			else lodMesher.build(inputs[i], level, static_cast<uint8_t>(1u << (i % 3 * 2)), mesh);
+			quads += mesh.quads.size();
+		}
+		const Time elapsed = clock.getElapsedTime();
+
+		columnQuads[level] = static_cast<double>(quads) * AREA_HEIGHT / inputs.size();
+		std::cout << "  level " << level << std::fixed << std::setprecision(1)
+			<< std::setw(10) << static_cast<double>(quads) / inputs.size() << " quads/chunk"
+			<< std::setw(10) << static_cast<double>(quads * 4 * sizeof(PackedVertex)) / inputs.size() / 1024 << " KB/chunk"
+			<< std::setw(10) << static_cast<double>(elapsed.asMicroseconds()) / inputs.size() << " us/chunk" << std::endl;
+	}
+
+	// Whole view distance, one column of chunks per square ring cell around the viewer
+	std::cout << "  view distance (chunks), quads with and without LOD, full detail radius " << fullRadius << ":" << std::endl;
+	for (int32_t scale = 1; scale <= 8; scale *= 2)
+	{
+		const int32_t radius = fullRadius * scale;
+		double full = 0, mixed = 0;
+		for (int32_t z = -radius; z <= radius; ++z)
+			for (int32_t x = -radius; x <= radius; ++x)
+			{
+				const int32_t level = LodMesher::levelForDistance(std::max(std::abs(x), std::abs(z)), fullRadius);
+				full += columnQuads[0];
+				mixed += columnQuads[std::min(level, levels - 1)];
+			}
+		std::cout << "    " << std::setw(4) << radius << std::setw(12) << static_cast<size_t>(mixed)
+			<< std::setw(12) << static_cast<size_t>(full) << std::endl;
+	}
+	return true;
+}
+
+bool bench::render(uint32_t threads, const std::string& imagePath)
+{
+	BlockRegistry registry;
+	if (!load_registry(registry))
+		return false;
+
+	constexpr int32_t area = 10;
+	constexpr int32_t width = 1280;
+	constexpr int32_t height = 720;
+	constexpr int32_t frames = 20;
+
+	TerrainGenerator generator{ registry, 1337 };
+	World world{ &registry };
+	generate_area(world, generator, area);
+
+	ChunkMesher mesher{ registry };
+	ChunkNeighborhood input;
+	std::vector<ChunkMesh> meshes;
+	meshes.reserve(static_cast<size_t>(area) * area * AREA_HEIGHT);
+	for (int32_t y = 0; y < AREA_HEIGHT; ++y)
+		for (int32_t z = 0; z < area; ++z)
+			for (int32_t x = 0; x < area; ++x)
+			{
+				ChunkNeighborhood::gather(world, { x, y, z }, input);
+				meshes.emplace_back();
+				mesher.build(input, meshes.back());
+			}
+
+	// Circles the area above the terrain, looking at its center
+	SoftwareRasterizer rasterizer{ registry, width, height, threads };
+	const float center = area * Chunk::SIZE * 0.5f;
+	const Matrix4x4 projection = Matrix4x4::perspectiveFov(1.2f, static_cast<float>(width) / height, 0.1f, 1000.f);
+	Time drawTime, flushTime;
+	size_t triangles = 0, culled = 0, pixels = 0;
+	for (int32_t frame = 0; frame < frames; ++frame)
+	{
+		const float angle = 6.2831853f * frame / frames;
+		const vec3f eye{ center + std::cos(angle) * center * 1.2f, AREA_HEIGHT * Chunk::SIZE * 1.2f, center + std::sin(angle) * center * 1.2f };
+		const Matrix4x4 viewProjection = Matrix4x4::lookAt(eye, { center, AREA_HEIGHT * Chunk::SIZE * 0.4f, center }, { 0.f, 1.f, 0.f }) * projection;
+
+		rasterizer.clear(Color{ 135, 206, 235 });
+		Clock clock;
+		for (const ChunkMesh& mesh : meshes)
+			rasterizer.draw(mesh, viewProjection);
+		drawTime += clock.reset();
+		rasterizer.flush();
+		flushTime += clock.getElapsedTime();
+
+		triangles += rasterizer.getStats().triangles;
+		culled += rasterizer.getStats().culled;
+		pixels += rasterizer.getStats().pixels;
+	}
+
+	std::cout << "render: " << meshes.size() << " chunks at " << width << "x" << height << ", " << frames << " frames" << std::endl
+		<< std::fixed << std::setprecision(2)
+		<< "  draw      " << std::setw(10) << drawTime.asMicroseconds() / 1000.0 / frames << " ms/frame" << std::endl
+		<< "  flush     " << std::setw(10) << flushTime.asMicroseconds() / 1000.0 / frames << " ms/frame" << std::endl
+		<< "  triangles " << std::setw(10) << triangles / frames << " per frame, " << culled * 100.0 / triangles << "% culled" << std::endl
+		<< "  pixels    " << std::setw(10) << pixels / frames << " per frame, overdraw " << static_cast<double>(pixels) / frames / (width * height) << std::endl;
+
+	return imagePath.empty() || rasterizer.savePPM(imagePath);
+}
+
+bool bench::occlusion(size_t occluders)
+{
+	BlockRegistry registry;
+	if (!load_registry(registry))
+		return false;
+
+	constexpr int32_t area = 10;
+	constexpr int32_t width = 640;
+	constexpr int32_t height = 360;
+	constexpr int32_t frames = 24;
+
+	TerrainGenerator generator{ registry, 1337 };
+	World world{ &registry };
+	generate_area(world, generator, area);
+
+	ChunkMesher mesher{ registry };
+	ChunkNeighborhood input;
+	std::vector<ChunkMesh> meshes;
+	meshes.reserve(static_cast<size_t>(area) * area * AREA_HEIGHT);
+	for (int32_t y = 0; y < AREA_HEIGHT; ++y)
+		for (int32_t z = 0; z < area; ++z)
+			for (int32_t x = 0; x < area; ++x)
+			{
+				ChunkNeighborhood::gather(world, { x, y, z }, input);
+				meshes.emplace_back();
+				mesher.build(input, meshes.back());
+			}
+
+	std::vector<const ChunkMesh*> all, visible;
+	for (const ChunkMesh& mesh : meshes)
+		if (!mesh.quads.empty())
+			all.push_back(&mesh);
+
+	// Walks a circle two blocks above the ground, looking ahead; the culled image is compared
+	// with the full one to catch chunks culled while visible
+	OcclusionCuller culler{ registry, 256, 128, occluders };
+	SoftwareRasterizer full{ registry, width, height, 0 };
+	SoftwareRasterizer culled{ registry, width, height, 0 };
+	const float center = area * Chunk::SIZE * 0.5f;
+	const Matrix4x4 projection = Matrix4x4::perspectiveFov(1.2f, static_cast<float>(width) / height, 0.1f, 1000.f);
+	Time rasterizeTime, testTime;
+	size_t tested = 0, outside = 0, hidden = 0, tileCulled = 0, different = 0;
+	for (int32_t frame = 0; frame < frames; ++frame)
+	{
+		const float angle = 6.2831853f * frame / frames;
+		const float x = center + std::cos(angle) * center * 0.6f, z = center + std::sin(angle) * center * 0.6f;
+		const int32_t ground = world.getHeight(HeightmapType::Opaque, static_cast<int32_t>(x), static_cast<int32_t>(z));
+		const vec3f eye{ x, static_cast<float>(std::max(ground, 0) + 2), z };
+		const vec3f at{ eye.x - std::sin(angle), eye.y, eye.z + std::cos(angle) };
+		const Matrix4x4 viewProjection = Matrix4x4::lookAt(eye, at, { 0.f, 1.f, 0.f }) * projection;
+
+		visible.clear();
+		culler.cull(all, eye, viewProjection, visible);
+		const OcclusionStats& stats = culler.getStats();
+		rasterizeTime += stats.rasterizeTime;
+		testTime += stats.testTime;
+		tested += stats.tested;
+		outside += stats.outside;
+		hidden += stats.culled;
+		tileCulled += stats.tileCulled;
+
+		full.clear(Color::BLACK);
+		culled.clear(Color::BLACK);
+		for (const ChunkMesh* mesh : all)
+			full.draw(*mesh, viewProjection);
+		for (const ChunkMesh* mesh : visible)
+			culled.draw(*mesh, viewProjection);
+		full.flush();
+		culled.flush();
+		for (int32_t py = 0; py < height; ++py)
+			for (int32_t px = 0; px < width; ++px)
+				different += full.getColor(px, py).rgba() != culled.getColor(px, py).rgba();
+	}
+
+	std::cout << "occlusion: " << all.size() << " non-empty chunks, " << occluders << " occluders, " << frames << " frames at ground level" << std::endl
+		<< std::fixed << std::setprecision(2)
+		<< "  rasterize " << std::setw(10) << rasterizeTime.asMicroseconds() / 1000.0 / frames << " ms/frame" << std::endl
+		<< "  test      " << std::setw(10) << testTime.asMicroseconds() / 1000.0 / frames << " ms/frame" << std::endl
+		<< "  off screen" << std::setw(10) << outside * 100.0 / tested << " %" << std::endl
+		<< "  hidden    " << std::setw(10) << hidden * 100.0 / tested << " %, " << tileCulled * 100.0 / std::max<size_t>(hidden, 1) << "% by tiles alone" << std::endl
+		<< "  drawn     " << std::setw(10) << (tested - outside - hidden) * 100.0 / tested << " %" << std::endl
+		<< "  pixels differing from the unculled image: " << different << std::endl;
+	return true;
+}
+
+bool bench::caves(int32_t radius)
+{
+	BlockRegistry registry;
+	if (!load_registry(registry))
+		return false;
+
+	constexpr int32_t area = 10;
+	constexpr int32_t width = 320;
+	constexpr int32_t height = 180;
+
+	TerrainGenerator generator{ registry, 1337 };
+	World world{ &registry };
+	generate_area(world, generator, area);
+
+	// Section meshes, their connectivity computed along
+	ChunkMesher mesher{ registry };
+	ChunkNeighborhood input;
+	VisibilityGraph graph;
+	std::unordered_map<uint64_t, ChunkMesh> meshes;
+	size_t solidSections = 0;
+	for (int32_t y = 0; y < AREA_HEIGHT; ++y)
+		for (int32_t z = 0; z < area; ++z)
+			for (int32_t x = 0; x < area; ++x)
+			{
+				ChunkNeighborhood::gather(world, { x, y, z }, input);
+				mesher.prepare(input);
+				for (int32_t i = 0; i < Chunk::SECTION_COUNT; ++i)
+				{
+					const vec3i section = VisibilityGraph::sectionCoords({ x, y, z }, i);
+					ChunkMesh& mesh = meshes[ChunkMap<Chunk>::pack(section)];
+					mesher.buildSection(i, mesh);
+					graph.setSection(section, mesh.connectivity);
+					solidSections += input.center().getSection(i) != nullptr;
+				}
+			}
+
+	// Connectivity alone, on the sections that have blocks
+	Clock clock;
+	for (int32_t y = 0; y < AREA_HEIGHT; ++y)
+		for (int32_t z = 0; z < area; ++z)
+			for (int32_t x = 0; x < area; ++x)
+			{
+				const Chunk* chunk = world.getChunk({ x, y, z });
+				for (int32_t i = 0; i < Chunk::SECTION_COUNT; ++i)
+					if (chunk->getSection(i))
+						section_visibility::compute(chunk->getSection(i), registry.opaqueTable());
+			}
+	const Time computeTime = clock.getElapsedTime();
+
+	// Viewpoints: the first open blocks found under at least 8 blocks of ground around the
+	// center, then the same columns 2 blocks above the surface
+	std::vector<vec3f> eyes;
+	const int32_t center = area * Chunk::SIZE / 2;
+	for (int32_t offset = 0; offset < center && eyes.size() < 4; offset += 7)
+	{
+		const int32_t x = center + offset, z = center - offset / 2;
+		const int32_t ground = world.getHeight(HeightmapType::Opaque, x, z);
+		for (int32_t y = 2; y < ground - 8; ++y)
+			if (world.getBlock({ x, y, z }) == blocks::AIR && world.getBlock({ x, y + 1, z }) == blocks::AIR)
+			{
+				eyes.push_back({ x + 0.5f, y + 1.5f, z + 0.5f });
+				break;
+			}
+	}
+	const size_t underground = eyes.size();
+	for (size_t i = 0; i < underground; ++i)
+	{
+		const int32_t x = static_cast<int32_t>(eyes[i].x), z = static_cast<int32_t>(eyes[i].z);
+		eyes.push_back({ eyes[i].x, world.getHeight(HeightmapType::Opaque, x, z) + 3.f, eyes[i].z });
+	}
+
+	std::cout << "caves: " << meshes.size() << " sections, " << solidSections << " with blocks, search radius " << radius << std::endl
+		<< std::fixed << std::setprecision(2)
+		<< "  connectivity " << static_cast<double>(computeTime.asMicroseconds()) / solidSections << " us/section" << std::endl;
+
+	// Each viewpoint looks in the four horizontal directions; drawing the reached sections only
+	// is compared with drawing all of them
+	SoftwareRasterizer full{ registry, width, height, 0 };
+	SoftwareRasterizer reached{ registry, width, height, 0 };
+	const Matrix4x4 projection = Matrix4x4::perspectiveFov(1.6f, static_cast<float>(width) / height, 0.1f, 1000.f);
+	std::vector<vec3i> visible;
+	for (size_t i = 0; i < eyes.size(); ++i)
+	{
+		const vec3f& eye = eyes[i];
+		visible.clear();
+		clock.reset();
+		if (!graph.findVisible(eye, radius, visible))
+			continue;
+		const Time searchTime = clock.getElapsedTime();
+
+		size_t different = 0;
+		for (int32_t direction = 0; direction < 4; ++direction)
+		{
+			const float angle = 1.5707963f * direction;
+			const Matrix4x4 viewProjection = Matrix4x4::lookAt(eye, { eye.x + std::cos(angle), eye.y - 0.3f, eye.z + std::sin(angle) }, { 0.f, 1.f, 0.f }) * projection;
+			full.clear(Color::BLACK);
+			reached.clear(Color::BLACK);
+			for (const auto& mesh : meshes)
+				full.draw(mesh.second, viewProjection);
+			for (const vec3i& section : visible)
+				reached.draw(meshes[ChunkMap<Chunk>::pack(section)], viewProjection);
+			full.flush();
+			reached.flush();
+			for (int32_t py = 0; py < height; ++py)
+				for (int32_t px = 0; px < width; ++px)
+					different += full.getColor(px, py).rgba() != reached.getColor(px, py).rgba();
+		}
+
+		std::cout << "  " << (i < underground ? "underground" : "surface    ") << " y " << std::setw(6) << eye.y
+			<< std::setw(8) << visible.size() << " sections reached (" << visible.size() * 100.0 / meshes.size() << "%)"
+			<< std::setw(8) << searchTime.asMicroseconds() / 1000.0 << " ms"
+			<< std::setw(8) << different << " pixels differing" << std::endl;
+	}
+	return true;
+}
+
+bool bench::commands(size_t draws)
+{
+	constexpr int32_t frames = 20;
+	constexpr uint32_t programs = 8;
+	constexpr uint32_t textures = 32;
+
+	// A frame of chunk meshes with up to three passes each, plus some blended overlays, recorded in
+	// the order a chunk walk would produce them
+	struct Draw
+	{
+		RenderPass pass;
+		uint32_t program;
+		uint32_t texture;
+		uint32_t vertexArray;
+		float depth;
+	};
+	std::mt19937 random{ 1337 };
+	std::vector<Draw> frame;
+	frame.reserve(draws);
+	for (size_t i = 0; i < draws; ++i)
+	{
+		const uint32_t roll = random() % 100;
+		const RenderPass pass = roll < 70 ? RenderPass::Opaque : roll < 85 ? RenderPass::Cutout : roll < 97 ? RenderPass::Translucent : RenderPass::Overlay;
+		frame.push_back({ pass, 1 + static_cast<uint32_t>(random() % programs), 1 + static_cast<uint32_t>(random() % textures), 1 + static_cast<uint32_t>(i / 3),
+			std::uniform_real_distribution<float>{ 0.f, 512.f }(random) });
+	}
+
+	RenderCommandBuffer buffer;
+	MockRenderBackend backend{ false };
+	RenderStateCache cache{ backend };
+	auto record = [&]() {
+		buffer.clear();
+		for (size_t i = 0; i < frame.size(); ++i)
+			buffer.draw(frame[i].pass, frame[i].program, frame[i].texture, frame[i].vertexArray, static_cast<uint32_t>(i) * 6, 6, frame[i].depth);
+	};
+
+	Clock clock;
+	Time recordTime, sortTime, submitTime;
+	for (int32_t i = 0; i < frames; ++i)
+	{
+		clock.reset();
+		record();
+		recordTime += clock.reset();
+		buffer.sort();
+		sortTime += clock.reset();
+		backend.reset();
+		cache.invalidate();
+		buffer.submit(cache);
+		submitTime += clock.reset();
+	}
+	const RenderCounters sorted = backend.getCounters();
+
+	record();
+	backend.reset();
+	cache.invalidate();
+	buffer.submit(cache);
+	const RenderCounters unsorted = backend.getCounters();
+
+	// Every draw once with the state of its command, opaque ones front to back within a state and
+	// blended ones back to front within a pass
+	MockRenderBackend checker;
+	RenderStateCache checkerCache{ checker };
+	buffer.sort();
+	buffer.submit(checkerCache);
+	std::vector<uint8_t> seen(frame.size(), 0);
+	size_t errors = 0;
+	for (size_t i = 0; i < checker.getDraws().size(); ++i)
+	{
+		const MockRenderBackend::Draw& draw = checker.getDraws()[i];
+		const size_t index = draw.first / 6;
+		const Draw& expected = frame[index];
+		const bool blend = expected.pass == RenderPass::Translucent || expected.pass == RenderPass::Overlay;
+		errors += seen[index]++ != 0 || draw.program != expected.program || draw.texture != expected.texture ||
+			draw.vertexArray != expected.vertexArray || draw.blend != blend || draw.depthWrite == blend ||
+			draw.depthTest != (expected.pass != RenderPass::Overlay);
+
+		if (i > 0)
+		{
+			const Draw& previous = frame[checker.getDraws()[i - 1].first / 6];
+			if (previous.pass == expected.pass && blend)
+				errors += previous.depth < expected.depth;
+			else if (previous.pass == expected.pass && previous.program == expected.program && previous.texture == expected.texture)
+				errors += previous.depth > expected.depth;
+		}
+	}
+
+	auto print_counters = [&](const char* label, const RenderCounters& counters) {
+		std::cout << "  " << std::left << std::setw(10) << label << std::right
+			<< std::setw(8) << counters.stateChanges() << " state changes: "
+			<< counters.programs << " programs, " << counters.textures << " textures, "
+			<< counters.vertexArrays << " vertex arrays, " << counters.depthStates + counters.blendStates << " depth/blend" << std::endl;
+	};
+
+	std::cout << "commands: " << draws << " draws, " << programs << " programs, " << textures << " textures" << std::endl;
+	print_counters("recorded", unsorted);
+	print_counters("sorted", sorted);
+	std::cout << std::fixed << std::setprecision(3)
+		<< "  record " << recordTime.asMicroseconds() / 1000.0 / frames << " ms, sort "
+		<< sortTime.asMicroseconds() / 1000.0 / frames << " ms, submit "
+		<< submitTime.asMicroseconds() / 1000.0 / frames << " ms per frame" << std::endl
+		<< "  " << checker.getDraws().size() << " draws checked, " << errors << " errors" << std::endl;
+	return errors == 0 && checker.getDraws().size() == frame.size();
+}
+
+bool bench::uploads(size_t meshCount)
+{
+	BlockRegistry registry;
+	if (!load_registry(registry))
+		return false;
+
+	constexpr int32_t area = 6;
+	constexpr int32_t frames = 30;
+	constexpr size_t uniformSize = 64;		// A matrix per mesh
+
+	// Vertices of a generated area, reused until there are enough meshes
+	TerrainGenerator generator{ registry, 1337 };
+	World world{ &registry };
+	generate_area(world, generator, area);
+
+	ChunkMesher mesher{ registry };
+	ChunkNeighborhood input;
+	ChunkMesh mesh;
+	std::vector<std::vector<PackedVertex>> areaMeshes;
+	for (int32_t y = 0; y < AREA_HEIGHT; ++y)
+		for (int32_t z = 0; z < area; ++z)
+			for (int32_t x = 0; x < area; ++x)
+			{
+				ChunkNeighborhood::gather(world, { x, y, z }, input);
+				mesher.build(input, mesh);
+				if (!mesh.vertices.empty())
+					areaMeshes.push_back(mesh.vertices);
+			}
+	if (areaMeshes.empty())
+		return false;
+
+	std::vector<const std::vector<PackedVertex>*> meshes;
+	std::vector<size_t> offsets;
+	size_t totalSize = 0;
+	for (size_t i = 0; i < meshCount; ++i)
+	{
+		meshes.push_back(&areaMeshes[i % areaMeshes.size()]);
+		offsets.push_back(totalSize);
+		totalSize += meshes.back()->size() * sizeof(PackedVertex);
+	}
+
+	SDL_Window* window = sdl::CreateWindow("World of Cubes benchmark", 0, 0, 64, 64);
+	SDL_GLContext context = window ? sdl::CreateContext(window) : nullptr;
+	StreamBuffer stream;
+	bool ok = context && gl::initiate();
+	if (!ok)
+		std::cerr << "Benchmark error: no OpenGL context" << std::endl;
+	else
+		ok = stream.create(totalSize + meshCount * std::max(uniformSize, size_t{ 256 }));
+
+	if (ok)
+	{
+		// Uploads are copied into one static buffer, which keeps the GPU reading the source of
+		// every upload like draws would
+		GLuint target = 0, staging = 0, uniforms = 0;
+		glGenBuffers(1, &target);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, target);
+		glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(totalSize), nullptr, GL_STATIC_DRAW);
+
+		const size_t uniformStride = std::max(uniformSize, stream.getUniformAlignment());
+
+		glGenBuffers(1, &staging);
+		glBindBuffer(GL_COPY_READ_BUFFER, staging);
+		glBufferData(GL_COPY_READ_BUFFER, static_cast<GLsizeiptr>(totalSize), nullptr, GL_STREAM_DRAW);
+		glGenBuffers(1, &uniforms);
+		glBindBuffer(GL_UNIFORM_BUFFER, uniforms);
+		glBufferData(GL_UNIFORM_BUFFER, static_cast<GLsizeiptr>(meshCount * uniformStride), nullptr, GL_STREAM_DRAW);
+		const uint8_t matrix[uniformSize] = {};
+
+		std::cout << "uploads: " << meshCount << " meshes, " << totalSize / 1024 << " KB per frame on "
+			<< reinterpret_cast<const char*>(glGetString(GL_RENDERER)) << std::endl;
+
+		auto print_upload = [&](const char* label, const Time& main, const Time& total) {
+			std::cout << std::fixed << std::setprecision(2)
+				<< "  " << std::left << std::setw(12) << label << std::right
+				<< std::setw(8) << main.asMicroseconds() / 1000.0 / frames << " ms main thread"
+				<< std::setw(8) << total.asMicroseconds() / 1000.0 / frames << " ms per frame"
+				<< std::setw(8) << static_cast<double>(totalSize) * frames / std::max<int64_t>(total.asMicroseconds(), 1) << " MB/s" << std::endl;
+		};
+
+		// glBufferSubData into a staging buffer the GPU may still be copying from
+		Clock clock;
+		for (int32_t frame = 0; frame < frames; ++frame)
+			for (size_t i = 0; i < meshCount; ++i)
+			{
+				const GLintptr offset = static_cast<GLintptr>(offsets[i]);
+				const GLsizeiptr size = static_cast<GLsizeiptr>(meshes[i]->size() * sizeof(PackedVertex));
+				glBufferSubData(GL_COPY_READ_BUFFER, offset, size, meshes[i]->data());
+				glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset, offset, size);
+				glBufferSubData(GL_UNIFORM_BUFFER, static_cast<GLintptr>(i * uniformStride), uniformSize, matrix);
+				glBindBufferRange(GL_UNIFORM_BUFFER, 0, uniforms, static_cast<GLintptr>(i * uniformStride), uniformSize);
+			}
+		glFinish();
+		const Time subData = clock.getElapsedTime();
+		print_upload("subdata", subData, subData);
+
+		// Workers write the ring, the main thread only issues the copies
+		const size_t workers = std::max<size_t>(1, std::min<size_t>(4, std::thread::hardware_concurrency()));
+		std::vector<StreamRange> vertexRanges(meshCount), uniformRanges(meshCount);
+		Time mainTime;
+		clock.reset();
+		for (int32_t frame = 0; frame < frames && ok; ++frame)
+		{
+			Clock mainClock;
+			stream.beginFrame();
+			mainTime += mainClock.reset();
+
+			std::vector<std::thread> threads;
+			for (size_t w = 0; w < workers; ++w)
+				threads.emplace_back([&, w]() {
+					for (size_t i = w; i < meshCount; i += workers)
+					{
+						const size_t size = meshes[i]->size() * sizeof(PackedVertex);
+						vertexRanges[i] = stream.allocate(size);
+						uniformRanges[i] = stream.allocate(uniformSize, stream.getUniformAlignment());
+						if (vertexRanges[i])
+							std::memcpy(vertexRanges[i].data, meshes[i]->data(), size);
+						if (uniformRanges[i])
+							std::memcpy(uniformRanges[i].data, matrix, uniformSize);
+					}
+				});
+			for (std::thread& thread : threads)
+				thread.join();
+
+			mainClock.reset();
+			glBindBuffer(GL_COPY_READ_BUFFER, stream.getBuffer());
+			for (size_t i = 0; i < meshCount; ++i)
+			{
+				if (!vertexRanges[i] || !uniformRanges[i])
+					continue;
+				glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(vertexRanges[i].offset),
+					static_cast<GLintptr>(offsets[i]), static_cast<GLsizeiptr>(vertexRanges[i].size));
+				glBindBufferRange(GL_UNIFORM_BUFFER, 0, stream.getBuffer(), static_cast<GLintptr>(uniformRanges[i].offset), uniformSize);
+			}
+			stream.endFrame();
+			glFlush();
+			mainTime += mainClock.getElapsedTime();
+			ok = stream.getStats().failed == 0;
+		}
+		glFinish();
+		const Time ring = clock.getElapsedTime();
+
+		if (ok)
+		{
+			print_upload("ring", mainTime, ring);
+			std::cout << "  " << stream.getStats().waits << " of " << stream.getStats().frames << " frames waited for a region, "
+				<< stream.getStats().waitTime.asMicroseconds() / 1000.0 << " ms" << std::endl;
+
+			// The last frame must have reached the static buffer unchanged
+			std::vector<uint8_t> readBack(totalSize);
+			glGetBufferSubData(GL_COPY_WRITE_BUFFER, 0, static_cast<GLsizeiptr>(totalSize), readBack.data());
+			size_t different = 0;
+			for (size_t i = 0; i < meshCount; ++i)
+				different += std::memcmp(readBack.data() + offsets[i], meshes[i]->data(), meshes[i]->size() * sizeof(PackedVertex)) != 0;
+			std::cout << "  " << different << " meshes differing after the copies" << std::endl;
+			ok = different == 0;
+		}
+		else
+			std::cerr << "Benchmark error: the stream buffer is too small" << std::endl;
+
+		stream.destroy();
+		glDeleteBuffers(1, &uniforms);
+		glDeleteBuffers(1, &staging);
+		glDeleteBuffers(1, &target);
+	}
+
+	if (context)
+	{
+		gl::quit();
+		SDL_GL_DeleteContext(context);
+	}
+	if (window)
+		SDL_DestroyWindow(window);
+	return ok;
+}
+
+bool bench::textures(uint32_t size, uint32_t threads)
+{
+	BlockRegistry registry;
+	if (!load_registry(registry))
+		return false;
+
+	const std::string cachePath = "bench-textures.cache";
+	std::remove(cachePath.c_str());
+
+	BlockTextures built{ registry, size };
+	if (!built.load("data/textures", cachePath, threads))
+		return false;
+	const BlockTexturesStats cold = built.getStats();
+
+	BlockTextures cached{ registry, size };
+	if (!cached.load("data/textures", cachePath, threads) || !cached.getStats().fromCache)
+	{
+		std::cerr << "Benchmark error: the texture cache was not reused" << std::endl;
+		std::remove(cachePath.c_str());
+		return false;
+	}
+	const BlockTexturesStats warm = cached.getStats();
+	std::remove(cachePath.c_str());
+
+	size_t errors = 0;
+	for (uint32_t level = 0; level < built.getLevelCount(); ++level)
+		for (size_t layer = 0; layer < built.getLayerCount(); ++layer)
+			errors += !std::equal(built.getLayer(level, layer), built.getLayer(level, layer) + built.getSize(level) * built.getSize(level),
+				cached.getLayer(level, layer), [](const Color& a, const Color& b) { return a.rgba() == b.rgba(); });
+
+	// A flat color must survive the trip through linear space, and transparent pixels must not
+	// darken the opaque ones next to them
+	for (int32_t value = 0; value < 256; ++value)
+	{
+		const Color flat{ value, 255 - value, value / 2, 255 };
+		const Color square[4] = { flat, flat, flat, flat };
+		Color result;
+		BlockTextures::downsample(square, 2, &result);
+		errors += result.rgba() != flat.rgba();
+	}
+	const Color cutout[4] = { Color{ 200, 40, 10, 255 }, Color{ 0, 0, 0, 0 }, Color{ 0, 0, 0, 0 }, Color{ 200, 40, 10, 255 } };
+	Color edge;
+	BlockTextures::downsample(cutout, 2, &edge);
+	errors += edge.rgba() != Color{ 200, 40, 10, 128 }.rgba();
+
+	// Filtering alone on one thread, then on every thread
+	Clock clock;
+	built.generateMips(1);
+	const Time single = clock.reset();
+	built.generateMips(threads);
+	const Time parallel = clock.reset();
+
+	size_t bytes = 0;
+	for (uint32_t level = 0; level < built.getLevelCount(); ++level)
+		bytes += built.getLayerCount() * built.getSize(level) * built.getSize(level) * sizeof(Color);
+
+	std::cout << "textures: " << built.getLayerCount() << " layers of " << size << "x" << size << ", "
+		<< built.getLevelCount() << " levels, " << bytes / 1024 << " KB, "
+		<< cold.loaded << " loaded, " << cold.generated << " placeholders" << std::endl
+		<< std::fixed << std::setprecision(2)
+		<< "  built   read " << cold.readTime.asMicroseconds() / 1000.0 << " ms, decode " << cold.decodeTime.asMicroseconds() / 1000.0
+		<< " ms, filter " << cold.filterTime.asMicroseconds() / 1000.0 << " ms, save " << cold.cacheTime.asMicroseconds() / 1000.0 << " ms" << std::endl
+		<< "  cached  read " << warm.readTime.asMicroseconds() / 1000.0 << " ms, load " << warm.cacheTime.asMicroseconds() / 1000.0 << " ms" << std::endl
+		<< "  filter  " << single.asMicroseconds() / 1000.0 << " ms on 1 thread, " << parallel.asMicroseconds() / 1000.0 << " ms on all" << std::endl
+		<< "  " << errors << " errors" << std::endl;
+	return errors == 0;
+}
+
+bool bench::gl_debug(size_t calls)
+{
+	SDL_Window* window = sdl::CreateWindow("World of Cubes benchmark", 0, 0, 64, 64);
+	SDL_GLContext context = window ? sdl::CreateContext(window) : nullptr;
+	bool ok = context && gl::initiate();
+	if (!ok)
+		std::cerr << "Benchmark error: no OpenGL context" << std::endl;
+	else if (!gl::enable_debug_output())
+	{
+		std::cerr << "Benchmark error: no debug output" << std::endl;
+		ok = false;
+	}
+
+	if (ok)
+	{
+		std::cout << "gl_debug: " << reinterpret_cast<const char*>(glGetString(GL_RENDERER)) << std::endl;
+
+		// Every invalid call must be queued, and printed by the drain
+		glEnable(0xdead);
+		glUseProgram(0xffff);
+		glBindVertexArray(0xffff);
+		std::vector<gl::DebugMessage> messages;
+		const size_t reported = gl::drain_debug_messages(&messages);
+		std::cout << "  " << reported << " messages for 3 invalid calls, " << gl::drain_debug_messages() << " left after the drain" << std::endl;
+		ok = reported >= 3;
+
+		gl::disable_debug_output();
+		glEnable(0xdead);
+		const size_t disabled = gl::drain_debug_messages();
+		while (glGetError() != GL_NO_ERROR);
+		std::cout << "  " << disabled << " messages once disabled" << std::endl;
+		ok = ok && disabled == 0;
+
+		// Cost per valid call of polling glGetError after it, against leaving it to the callback
+		Clock clock;
+		for (size_t i = 0; i < calls; ++i)
+		{
+			glUseProgram(0);
+			gl::check_errors();
+		}
+		const Time polled = clock.reset();
+		gl::enable_debug_output();
+		for (size_t i = 0; i < calls; ++i)
+			glUseProgram(0);
+		gl::drain_debug_messages();
+		const Time debug = clock.getElapsedTime();
+		gl::disable_debug_output();
+
+		std::cout << std::fixed << std::setprecision(1)
+#ifdef NDEBUG
+			<< "  polled      " << polled.asMicroseconds() * 1000.0 / calls << " ns/call (check_errors compiled out)" << std::endl
+#else
+			<< "  polled      " << polled.asMicroseconds() * 1000.0 / calls << " ns/call" << std::endl
+#endif
+			<< "  callback    " << debug.asMicroseconds() * 1000.0 / calls << " ns/call" << std::endl;
+	}
+
+	if (context)
+	{
+		gl::quit();
+		SDL_GL_DeleteContext(context);
+	}
+	if (window)
+		SDL_DestroyWindow(window);
+	return ok;
+}
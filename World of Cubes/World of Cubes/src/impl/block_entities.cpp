@@ -0,0 +1,40 @@
+#include "engine/block_entities.h"
+
+#include <algorithm>
+
+const BlockEntities::Entry* BlockEntities::find(uint16_t index) const
+{
+	auto it = lowerBound(index);
+	return it != _entries.end() && it->index == index ? &*it : nullptr;
+}
+
+BlockEntities::Entry* BlockEntities::find(uint16_t index)
+{
+	return const_cast<Entry*>(static_cast<const BlockEntities*>(this)->find(index));
+}
+
+BlockEntities::Entry& BlockEntities::set(uint16_t index, BlockEntityType type, const uint8_t* data, size_t size)
+{
+	auto it = _entries.begin() + (lowerBound(index) - _entries.cbegin());
+	if (it == _entries.end() || it->index != index)
+		it = _entries.insert(it, Entry{ index, type, {} });
+
+	it->type = type;
+	it->data.assign(data, data + size);
+	return *it;
+}
+
+bool BlockEntities::erase(uint16_t index)
+{
+	auto it = lowerBound(index);
+	if (it == _entries.end() || it->index != index)
+		return false;
+
+	_entries.erase(it);
+	return true;
+}
+
+std::vector<BlockEntities::Entry>::const_iterator BlockEntities::lowerBound(uint16_t index) const
+{
+	return std::lower_bound(_entries.begin(), _entries.end(), index, [](const Entry& entry, uint16_t value) { return entry.index < value; });
+}
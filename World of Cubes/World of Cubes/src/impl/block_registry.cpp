@@ -0,0 +1,343 @@
+#include "engine/block_registry.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <limits>
+
+#include <native_json/json.hpp>
+
+using json = nlohmann::json;
+
+namespace
+{
+	constexpr char CacheMagic[4] = { 'W', 'O', 'C', 'B' };
+
+	bool read_file(const std::string& path, std::string& text)
+	{
+		std::ifstream file{ path, std::ios::binary };
+		if (!file)
+			return false;
+
+		std::ostringstream ss;
+		ss << file.rdbuf();
+		text = ss.str();
+		return true;
+	}
+
+	bool read_bool(const json& obj, const char* key, bool defaultValue)
+	{
+		auto it = obj.find(key);
+		return it != obj.end() && it->is_boolean() ? it->get<bool>() : defaultValue;
+	}
+
+	int read_int(const json& obj, const char* key, int defaultValue)
+	{
+		auto it = obj.find(key);
+		return it != obj.end() && it->is_number_integer() ? it->get<int>() : defaultValue;
+	}
+
+	template<typename _Ty>
+	void write_raw(std::ofstream& out, const _Ty& value) { out.write(reinterpret_cast<const char*>(&value), sizeof(_Ty)); }
+
+	template<typename _Ty>
+	bool read_raw(std::ifstream& in, _Ty& value) { return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(_Ty))); }
+
+	template<typename _Ty>
+	void write_array(std::ofstream& out, const std::vector<_Ty>& values)
+	{
+		out.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(_Ty)));
+	}
+
+	template<typename _Ty>
+	bool read_array(std::ifstream& in, std::vector<_Ty>& values, size_t count)
+	{
+		values.resize(count);
+		return static_cast<bool>(in.read(reinterpret_cast<char*>(values.data()), static_cast<std::streamsize>(count * sizeof(_Ty))));
+	}
+
+	void write_strings(std::ofstream& out, const std::vector<std::string>& strings)
+	{
+		for (const std::string& str : strings)
+		{
+			write_raw(out, static_cast<uint16_t>(str.size()));
+			out.write(str.data(), static_cast<std::streamsize>(str.size()));
+		}
+	}
+
+	bool read_strings(std::ifstream& in, std::vector<std::string>& strings, size_t count)
+	{
+		strings.resize(count);
+		for (std::string& str : strings)
+		{
+			uint16_t len;
+			if (!read_raw(in, len))
+				return false;
+			str.resize(len);
+			if (len && !in.read(&str[0], len))
+				return false;
+		}
+		return true;
+	}
+}
+
+
+BlockRegistry::BlockRegistry() :
+	_names{},
+	_ids{},
+	_textureNames{},
+	_solid{},
+	_opaque{},
+	_lightEmission{},
+	_tint{},
+	_collision{},
+	_textures{}
+{
+	clear();
+}
+
+bool BlockRegistry::load(const std::string& definitionsPath, const std::string& cachePath)
+{
+	std::string text;
+	if (!read_file(definitionsPath, text))
+	{
+		std::cerr << "Block definitions error: cannot open " << definitionsPath << std::endl;
+		return false;
+	}
+
+	uint64_t hash = hashSource(text);
+	if (loadCache(cachePath, hash))
+		return true;
+
+	if (!parseDefinitions(text))
+		return false;
+
+	if (!saveCache(cachePath, hash))
+		std::cerr << "Block cache warning: cannot write " << cachePath << std::endl;
+	return true;
+}
+
+bool BlockRegistry::loadDefinitions(const std::string& path)
+{
+	std::string text;
+	if (!read_file(path, text))
+	{
+		std::cerr << "Block definitions error: cannot open " << path << std::endl;
+		return false;
+	}
+	return parseDefinitions(text);
+}
+
+bool BlockRegistry::parseDefinitions(const std::string& text)
+{
+	json root = json::parse(text, nullptr, false);
+	if (root.is_discarded() || !root.is_object() || !root.contains("blocks") || !root["blocks"].is_array())
+	{
+		std::cerr << "Block definitions error: expected an object with a \"blocks\" array" << std::endl;
+		return false;
+	}
+
+	clear();
+	for (const json& def : root["blocks"])
+	{
+		if (!def.is_object() || !def.contains("name") || !def["name"].is_string())
+		{
+			std::cerr << "Block definitions error: every block needs a \"name\"" << std::endl;
+			clear();
+			return false;
+		}
+
+		const std::string name = def["name"].get<std::string>();
+		if (name == "air")
+			continue;
+		if (_ids.count(name))
+		{
+			std::cerr << "Block definitions error: duplicated block " << name << std::endl;
+			clear();
+			return false;
+		}
+		if (_names.size() > std::numeric_limits<BlockId>::max())
+		{
+			std::cerr << "Block definitions error: too many blocks" << std::endl;
+			clear();
+			return false;
+		}
+
+		BlockId id = add(name);
+		bool solid = read_bool(def, "solid", true);
+		_solid[id] = solid;
+		_opaque[id] = read_bool(def, "opaque", solid);
+		_lightEmission[id] = static_cast<uint8_t>(utils::clamp(read_int(def, "light", 0), 0, 15));
+
+		auto tint = def.find("tint");
+		if (tint != def.end() && tint->is_array() && (tint->size() == 3 || tint->size() == 4) &&
+			std::all_of(tint->begin(), tint->end(), [](const json& c) { return c.is_number_integer(); }))
+		{
+			int alpha = tint->size() == 4 ? (*tint)[3].get<int>() : 255;
+			_tint[id] = Color{ (*tint)[0].get<int>(), (*tint)[1].get<int>(), (*tint)[2].get<int>(), alpha }.rgba();
+		}
+
+		CollisionShape shape = solid ? CollisionShape::Cube : CollisionShape::None;
+		auto collision = def.find("collision");
+		if (collision != def.end() && collision->is_string())
+		{
+			const std::string value = collision->get<std::string>();
+			if (value == "none") shape = CollisionShape::None;
+			else if (value == "cube") shape = CollisionShape::Cube;
+			else if (value == "slab") shape = CollisionShape::Slab;
+			else if (value == "cross") shape = CollisionShape::Cross;
+			else std::cerr << "Block definitions warning: unknown collision shape " << value << " in " << name << std::endl;
+		}
+		_collision[id] = shape;
+
+		// "textures" is either one name for every face or an object of all/side/top/bottom/<face>
+		TextureId* faces = &_textures[id * BLOCK_FACE_COUNT];
+		auto textures = def.find("textures");
+		if (textures != def.end() && textures->is_string())
+		{
+			std::fill(faces, faces + BLOCK_FACE_COUNT, internTexture(textures->get<std::string>()));
+		}
+		else if (textures != def.end() && textures->is_object())
+		{
+			static const char* const faceKeys[BLOCK_FACE_COUNT] = { "west", "east", "bottom", "top", "north", "south" };
+			auto get = [&](const char* key, TextureId& out) {
+				auto it = textures->find(key);
+				if (it != textures->end() && it->is_string())
+					out = internTexture(it->get<std::string>());
+			};
+
+			TextureId all = 0, side = 0;
+			get("all", all);
+			side = all;
+			get("side", side);
+			for (size_t f = 0; f < BLOCK_FACE_COUNT; ++f)
+			{
+				faces[f] = (f == static_cast<size_t>(BlockFace::Top) || f == static_cast<size_t>(BlockFace::Bottom)) ? all : side;
+				get(faceKeys[f], faces[f]);
+			}
+		}
+	}
+
+	return true;
+}
+
+bool BlockRegistry::loadCache(const std::string& path, uint64_t sourceHash)
+{
+	std::ifstream in{ path, std::ios::binary };
+	if (!in)
+		return false;
+
+	char magic[4];
+	uint32_t version, blockCount, textureCount;
+	uint64_t hash;
+	if (!in.read(magic, 4) || !std::equal(magic, magic + 4, CacheMagic) ||
+		!read_raw(in, version) || version != CACHE_VERSION ||
+		!read_raw(in, hash) || hash != sourceHash ||
+		!read_raw(in, blockCount) || !read_raw(in, textureCount))
+		return false;
+
+	BlockRegistry loaded;
+	loaded._ids.clear();
+	if (!read_strings(in, loaded._names, blockCount) ||
+		!read_strings(in, loaded._textureNames, textureCount) ||
+		!read_array(in, loaded._solid, blockCount) ||
+		!read_array(in, loaded._opaque, blockCount) ||
+		!read_array(in, loaded._lightEmission, blockCount) ||
+		!read_array(in, loaded._tint, blockCount) ||
+		!read_array(in, loaded._collision, blockCount) ||
+		!read_array(in, loaded._textures, blockCount * BLOCK_FACE_COUNT))
+	{
+		std::cerr << "Block cache warning: " << path << " is truncated" << std::endl;
+		return false;
+	}
+
+	for (size_t i = 0; i < loaded._names.size(); ++i)
+		loaded._ids.emplace(loaded._names[i], static_cast<BlockId>(i));
+
+	*this = std::move(loaded);
+	return true;
+}
+
+bool BlockRegistry::saveCache(const std::string& path, uint64_t sourceHash) const
+{
+	std::ofstream out{ path, std::ios::binary | std::ios::trunc };
+	if (!out)
+		return false;
+
+	out.write(CacheMagic, 4);
+	write_raw(out, CACHE_VERSION);
+	write_raw(out, sourceHash);
+	write_raw(out, static_cast<uint32_t>(_names.size()));
+	write_raw(out, static_cast<uint32_t>(_textureNames.size()));
+	write_strings(out, _names);
+	write_strings(out, _textureNames);
+	write_array(out, _solid);
+	write_array(out, _opaque);
+	write_array(out, _lightEmission);
+	write_array(out, _tint);
+	write_array(out, _collision);
+	write_array(out, _textures);
+	return static_cast<bool>(out);
+}
+
+void BlockRegistry::clear()
+{
+	_names.clear();
+	_ids.clear();
+	_textureNames.clear();
+	_solid.clear();
+	_opaque.clear();
+	_lightEmission.clear();
+	_tint.clear();
+	_collision.clear();
+	_textures.clear();
+
+	// Air is always block 0 and texture 0 is the "missing" texture
+	internTexture("missing");
+	BlockId air = add("air");
+	_solid[air] = false;
+	_opaque[air] = false;
+	_collision[air] = CollisionShape::None;
+}
+
+BlockId BlockRegistry::find(const std::string& name, BlockId defaultId) const
+{
+	auto it = _ids.find(name);
+	return it != _ids.end() ? it->second : defaultId;
+}
+
+uint64_t BlockRegistry::hashSource(const std::string& text)
+{
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (char c : text)
+	{
+		hash ^= static_cast<uint8_t>(c);
+		hash *= 0x100000001b3ull;
+	}
+	return hash ^ CACHE_VERSION;
+}
+
+BlockId BlockRegistry::add(const std::string& name)
+{
+	BlockId id = static_cast<BlockId>(_names.size());
+	_names.push_back(name);
+	_ids.emplace(name, id);
+	_solid.push_back(1);
+	_opaque.push_back(1);
+	_lightEmission.push_back(0);
+	_tint.push_back(Color::WHITE.rgba());
+	_collision.push_back(CollisionShape::Cube);
+	_textures.insert(_textures.end(), BLOCK_FACE_COUNT, 0);
+	return id;
+}
+
+TextureId BlockRegistry::internTexture(const std::string& name)
+{
+	for (size_t i = 0; i < _textureNames.size(); ++i)
+		if (_textureNames[i] == name)
+			return static_cast<TextureId>(i);
+
+	_textureNames.push_back(name);
+	return static_cast<TextureId>(_textureNames.size() - 1);
+}
@@ -0,0 +1,316 @@
+#include "engine/block_textures.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#include <opengl/glew.h>
+#include <sfml/Graphics/Image.hpp>
+
+#include "engine/software_rasterizer.h"
+#include "support/checksum.h"
+#include "support/clock.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BLOCK_TEXTURES_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	constexpr char CacheMagic[4] = { 'W', 'O', 'C', 'T' };
+	constexpr uint32_t MAX_SIZE = 4096;
+	constexpr int32_t LINEAR_STEPS = 4095;
+
+	// sRGB bytes to linear values, and linear values in LINEAR_STEPS steps back to sRGB bytes
+	struct ColorTables
+	{
+		float toLinear[256];
+		uint8_t toSrgb[LINEAR_STEPS + 1];
+
+		ColorTables()
+		{
+			for (int32_t i = 0; i < 256; ++i)
+			{
+				const float c = i / 255.f;
+				toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+			}
+			for (int32_t i = 0; i <= LINEAR_STEPS; ++i)
+			{
+				const float l = static_cast<float>(i) / LINEAR_STEPS;
+				const float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.f / 2.4f) - 0.055f;
+				toSrgb[i] = static_cast<uint8_t>(utils::clamp(c * 255.f + 0.5f, 0.f, 255.f));
+			}
+		}
+	};
+
+	const ColorTables& color_tables()
+	{
+		static const ColorTables tables;
+		return tables;
+	}
+
+	inline uint8_t to_srgb(const ColorTables& tables, float linear)
+	{
+		return tables.toSrgb[static_cast<int32_t>(utils::clamp(linear, 0.f, 1.f) * LINEAR_STEPS + 0.5f)];
+	}
+
+	bool read_file(const std::string& path, std::string& text)
+	{
+		std::ifstream file{ path, std::ios::binary };
+		if (!file)
+			return false;
+
+		std::ostringstream ss;
+		ss << file.rdbuf();
+		text = ss.str();
+		return true;
+	}
+
+	template<typename _Ty>
+	void write_raw(std::ofstream& out, const _Ty& value) { out.write(reinterpret_cast<const char*>(&value), sizeof(_Ty)); }
+
+	template<typename _Ty>
+	bool read_raw(std::ifstream& in, _Ty& value) { return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(_Ty))); }
+
+	template<typename _Ty>
+	uint32_t crc_raw(const _Ty& value, uint32_t crc) { return checksum::crc32(&value, sizeof(_Ty), crc); }
+}
+
+BlockTextures::BlockTextures(const BlockRegistry& registry, uint32_t size) :
+	_registry{ registry },
+	_size{ size },
+	_levelCount{ 0 },
+	_levels{},
+	_stats{}
+{
+	for (uint32_t s = size; s > 0; s >>= 1)
+		++_levelCount;
+}
+
+bool BlockTextures::load(const std::string& directory, const std::string& cachePath, uint32_t threads)
+{
+	if (_size == 0 || _size > MAX_SIZE || (_size & (_size - 1)) != 0)
+	{
+		std::cerr << "Block textures error: the size " << _size << " is not a power of 2 up to " << MAX_SIZE << std::endl;
+		return false;
+	}
+
+	_stats = {};
+	Clock clock;
+
+	// Sources are only hashed when the cache is valid, not decoded
+	const size_t layers = getLayerCount();
+	std::vector<std::string> sources(layers);
+	std::vector<uint8_t> found(layers, 0);
+	uint32_t hash = crc_raw(CACHE_VERSION, 0);
+	hash = crc_raw(_size, hash);
+	for (size_t i = 0; i < layers; ++i)
+	{
+		const std::string& name = _registry.getTextureName(static_cast<TextureId>(i));
+		found[i] = read_file(directory + "/" + name + ".png", sources[i]);
+		hash = checksum::crc32(name.data(), name.size(), crc_raw(name.size(), hash));
+		hash = checksum::crc32(sources[i].data(), sources[i].size(), crc_raw(sources[i].size(), hash));
+	}
+	_stats.readTime = clock.reset();
+
+	if (loadCache(cachePath, hash))
+	{
+		_stats.fromCache = true;
+		_stats.cacheTime = clock.reset();
+		return true;
+	}
+
+	allocate();
+	const size_t pixels = static_cast<size_t>(_size) * _size;
+	for (size_t i = 0; i < layers; ++i)
+	{
+		Color* layer = getLayer(0, i);
+		sf::Image image;
+		if (found[i] && image.loadFromMemory(sources[i].data(), sources[i].size()) && image.getSize().x == _size && image.getSize().y == _size)
+		{
+			const uint8_t* rgba = image.getPixelsPtr();
+			for (size_t p = 0; p < pixels; ++p, rgba += 4)
+				layer[p] = Color{ rgba[0], rgba[1], rgba[2], rgba[3] };
+			++_stats.loaded;
+			continue;
+		}
+
+		if (found[i])
+			std::cerr << "Block textures warning: " << _registry.getTextureName(static_cast<TextureId>(i)) << " is not a " << _size << "x" << _size << " image" << std::endl;
+		for (uint32_t y = 0; y < _size; ++y)
+			for (uint32_t x = 0; x < _size; ++x)
+				layer[y * _size + x] = placeholder(static_cast<TextureId>(i), x, y);
+		++_stats.generated;
+	}
+	_stats.decodeTime = clock.reset();
+
+	generateMips(threads);
+	_stats.filterTime = clock.reset();
+
+	if (!saveCache(cachePath, hash))
+		std::cerr << "Block textures warning: cannot write " << cachePath << std::endl;
+	_stats.cacheTime = clock.reset();
+	return true;
+}
+
+void BlockTextures::generateMips(uint32_t threads)
+{
+	const size_t layers = getLayerCount();
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	threads = static_cast<uint32_t>(std::min<size_t>(threads, layers));
+
+	// Each layer goes down its whole chain on one thread
+	std::atomic<size_t> nextLayer{ 0 };
+	auto work = [this, layers, &nextLayer]() {
+		for (size_t layer; (layer = nextLayer.fetch_add(1, std::memory_order_relaxed)) < layers;)
+			for (uint32_t level = 1; level < _levelCount; ++level)
+				downsample(getLayer(level - 1, layer), getSize(level - 1), getLayer(level, layer));
+	};
+
+	std::vector<std::thread> workers;
+	for (uint32_t i = 1; i < threads; ++i)
+		workers.emplace_back(work);
+	work();
+	for (std::thread& worker : workers)
+		worker.join();
+}
+
+bool BlockTextures::loadCache(const std::string& path, uint32_t sourceHash)
+{
+	std::ifstream in{ path, std::ios::binary };
+	if (!in)
+		return false;
+
+	char magic[4];
+	uint32_t version, hash, size, levelCount, layerCount;
+	if (!in.read(magic, 4) || !std::equal(magic, magic + 4, CacheMagic) ||
+		!read_raw(in, version) || version != CACHE_VERSION ||
+		!read_raw(in, hash) || hash != sourceHash ||
+		!read_raw(in, size) || size != _size ||
+		!read_raw(in, levelCount) || levelCount != _levelCount ||
+		!read_raw(in, layerCount) || layerCount != getLayerCount())
+		return false;
+
+	allocate();
+	for (std::vector<Color>& level : _levels)
+		if (!in.read(reinterpret_cast<char*>(level.data()), static_cast<std::streamsize>(level.size() * sizeof(Color))))
+		{
+			std::cerr << "Block textures warning: " << path << " is truncated" << std::endl;
+			return false;
+		}
+	return true;
+}
+
+bool BlockTextures::saveCache(const std::string& path, uint32_t sourceHash) const
+{
+	std::ofstream out{ path, std::ios::binary | std::ios::trunc };
+	if (!out)
+		return false;
+
+	out.write(CacheMagic, 4);
+	write_raw(out, CACHE_VERSION);
+	write_raw(out, sourceHash);
+	write_raw(out, _size);
+	write_raw(out, _levelCount);
+	write_raw(out, static_cast<uint32_t>(getLayerCount()));
+	for (const std::vector<Color>& level : _levels)
+		out.write(reinterpret_cast<const char*>(level.data()), static_cast<std::streamsize>(level.size() * sizeof(Color)));
+	return static_cast<bool>(out);
+}
+
+uint32_t BlockTextures::upload() const
+{
+	if (_levels.empty())
+		return 0;
+
+	GLuint texture = 0;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	for (uint32_t level = 0; level < _levelCount; ++level)
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, static_cast<GLint>(level), GL_SRGB8_ALPHA8, static_cast<GLsizei>(getSize(level)), static_cast<GLsizei>(getSize(level)),
+			static_cast<GLsizei>(getLayerCount()), 0, GL_RGBA, GL_UNSIGNED_BYTE, _levels[level].data());
+
+	// Merged quads repeat their texture once per block
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(_levelCount - 1));
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	return texture;
+}
+
+void BlockTextures::downsample(const Color* source, uint32_t sourceSize, Color* target)
+{
+	const ColorTables& tables = color_tables();
+	const uint32_t size = sourceSize / 2;
+
+	for (uint32_t y = 0; y < size; ++y)
+		for (uint32_t x = 0; x < size; ++x)
+		{
+			const Color* row = source + static_cast<size_t>(2 * y) * sourceSize + 2 * x;
+			const Color pixels[4] = { row[0], row[1], row[sourceSize], row[sourceSize + 1] };
+
+			// Lanes red, green, blue, alpha; colors summed weighted by alpha, which sums the
+			// alphas in the last lane
+			float result[4];
+#ifdef BLOCK_TEXTURES_SSE2
+			__m128 weighted = _mm_setzero_ps();
+			__m128 plain = _mm_setzero_ps();
+			for (const Color& pixel : pixels)
+			{
+				const __m128 linear = _mm_set_ps(1.f, tables.toLinear[pixel.getBlue()], tables.toLinear[pixel.getGreen()], tables.toLinear[pixel.getRed()]);
+				weighted = _mm_add_ps(weighted, _mm_mul_ps(linear, _mm_set1_ps(pixel.getAlphaProportion())));
+				plain = _mm_add_ps(plain, linear);
+			}
+			_mm_storeu_ps(result, weighted);
+			const float alpha = result[3];
+			_mm_storeu_ps(result, alpha > 0.f ? _mm_div_ps(weighted, _mm_set1_ps(alpha)) : _mm_mul_ps(plain, _mm_set1_ps(0.25f)));
+#else
+			float weighted[4] = {}, plain[4] = {};
+			for (const Color& pixel : pixels)
+			{
+				const float linear[4] = { tables.toLinear[pixel.getRed()], tables.toLinear[pixel.getGreen()], tables.toLinear[pixel.getBlue()], 1.f };
+				const float weight = pixel.getAlphaProportion();
+				for (int32_t c = 0; c < 4; ++c)
+				{
+					weighted[c] += linear[c] * weight;
+					plain[c] += linear[c];
+				}
+			}
+			const float alpha = weighted[3];
+			for (int32_t c = 0; c < 4; ++c)
+				result[c] = alpha > 0.f ? weighted[c] / alpha : plain[c] * 0.25f;
+#endif
+			target[static_cast<size_t>(y) * size + x] = Color{ to_srgb(tables, result[0]), to_srgb(tables, result[1]), to_srgb(tables, result[2]),
+				static_cast<uint8_t>(alpha * 0.25f * 255.f + 0.5f) };
+		}
+}
+
+Color BlockTextures::placeholder(TextureId texture, uint32_t x, uint32_t y)
+{
+	// The missing texture is a magenta and black checker
+	if (texture == 0)
+		return ((x >> 2) ^ (y >> 2)) & 1 ? Color{ 255, 0, 255 } : Color{ 0, 0, 0 };
+
+	// Color of SoftwareRasterizer, with some noise for the mips to filter
+	const vec3f color = SoftwareRasterizer::defaultTextureColor(texture);
+	const uint32_t noise = (x * 73856093u ^ y * 19349663u ^ texture * 83492791u) * 2654435761u >> 24;
+	const float shade = 0.85f + 0.3f * noise / 255.f;
+	return Color{ color.x * shade, color.y * shade, color.z * shade };
+}
+
+void BlockTextures::allocate()
+{
+	_levels.resize(_levelCount);
+	for (uint32_t level = 0; level < _levelCount; ++level)
+		_levels[level].assign(getLayerCount() * getSize(level) * getSize(level), Color{});
+}
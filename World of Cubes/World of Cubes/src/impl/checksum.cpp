@@ -0,0 +1,44 @@
+#include "support/checksum.h"
+
+namespace
+{
+	struct Crc32Tables
+	{
+		uint32_t table[4][256];
+
+		Crc32Tables()
+		{
+			for (uint32_t i = 0; i < 256; ++i)
+			{
+				uint32_t c = i;
+				for (int k = 0; k < 8; ++k)
+					c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+				table[0][i] = c;
+			}
+			for (uint32_t i = 0; i < 256; ++i)
+				for (int t = 1; t < 4; ++t)
+					table[t][i] = (table[t - 1][i] >> 8) ^ table[0][table[t - 1][i] & 0xff];
+		}
+	};
+
+	const Crc32Tables _Tables;
+}
+
+uint32_t checksum::crc32(const void* data, size_t size, uint32_t crc)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	const auto& t = _Tables.table;
+	crc = ~crc;
+
+	// Slicing-by-4: one table lookup per byte, four bytes per step
+	for (; size >= 4; size -= 4, bytes += 4)
+	{
+		crc ^= static_cast<uint32_t>(bytes[0]) | (static_cast<uint32_t>(bytes[1]) << 8) |
+			(static_cast<uint32_t>(bytes[2]) << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+		crc = t[3][crc & 0xff] ^ t[2][(crc >> 8) & 0xff] ^ t[1][(crc >> 16) & 0xff] ^ t[0][crc >> 24];
+	}
+	for (; size; --size, ++bytes)
+		crc = t[0][(crc ^ *bytes) & 0xff] ^ (crc >> 8);
+
+	return ~crc;
+}
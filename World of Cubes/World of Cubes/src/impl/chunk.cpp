@@ -0,0 +1,296 @@
+#include "engine/chunk.h"
+
+#include <algorithm>
+#include <new>
+#include <utility>
+
+#include "support/pool.h"
+
+ChunkSection* ChunkSection::create(BlockId fillId)
+{
+	void* memory = pool().allocate();
+	bool pooled = memory != nullptr;
+	if (!pooled)
+		memory = ::operator new(sizeof(ChunkSection));
+
+	ChunkSection* section = new (memory) ChunkSection;
+	section->refs.store(1, std::memory_order_relaxed);
+	section->pooled = pooled;
+	std::fill(section->blocks, section->blocks + VOLUME, fillId);
+	return section;
+}
+
+ChunkSection* ChunkSection::clone(const ChunkSection& section)
+{
+	ChunkSection* copy = create(blocks::AIR);
+	std::copy(section.blocks, section.blocks + VOLUME, copy->blocks);
+	return copy;
+}
+
+void ChunkSection::release(ChunkSection* section)
+{
+	if (!section || section->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+		return;
+
+	bool pooled = section->pooled;
+	section->~ChunkSection();
+	if (pooled)
+		pool().deallocate(section);
+	else ::operator delete(section);
+}
+
+SlabPool& ChunkSection::pool()
+{
+	static SlabPool sectionPool{ sizeof(ChunkSection), 1 << 20 };
+	return sectionPool;
+}
+
+
+
+Chunk::Chunk(const vec3i& coords) :
+	_coords{ coords },
+	_version{ 0 },
+	_sections{},
+	_entities{}
+{}
+
+Chunk::Chunk(const Chunk& c) :
+	_coords{ c._coords },
+	_version{ c._version },
+	_sections{},
+	_entities{ c._entities }
+{
+	for (int32_t i = 0; i < SECTION_COUNT; ++i)
+	{
+		_sections[i] = c._sections[i];
+		ChunkSection::acquire(_sections[i]);
+	}
+}
+
+Chunk::Chunk(Chunk&& c) noexcept :
+	_coords{ std::move(c._coords) },
+	_version{ c._version },
+	_sections{},
+	_entities{ std::move(c._entities) }
+{
+	std::swap(_sections, c._sections);
+}
+
+Chunk::~Chunk() { releaseSections(); }
+
+Chunk& Chunk::operator= (const Chunk& c)
+{
+	if (this != &c)
+	{
+		for (int32_t i = 0; i < SECTION_COUNT; ++i)
+			ChunkSection::acquire(c._sections[i]);
+		releaseSections();
+
+		_coords = c._coords;
+		_version = c._version;
+		std::copy(c._sections, c._sections + SECTION_COUNT, _sections);
+		_entities = c._entities;
+	}
+	return *this;
+}
+
+Chunk& Chunk::operator= (Chunk&& c) noexcept
+{
+	_coords = std::move(c._coords);
+	_version = c._version;
+	std::swap(_sections, c._sections);
+	std::swap(_entities, c._entities);
+	return *this;
+}
+
+void Chunk::setBlock(int32_t x, int32_t y, int32_t z, BlockId id)
+{
+	int32_t index = sectionIndex(x, y, z);
+	if (!_sections[index] && id == blocks::AIR)
+		return;
+
+	BlockId& block = editSection(index)[ChunkSection::index(x, y, z)];
+	if (_entities && block != id)
+		removeEntity({ x, y, z });
+	block = id;
+}
+
+BlockId* Chunk::editSection(int32_t index)
+{
+	ChunkSection*& section = _sections[index];
+	if (!section)
+		section = ChunkSection::create(blocks::AIR);
+	else if (section->refs.load(std::memory_order_acquire) > 1)
+	{
+		// Shared with a snapshot: detach before writing
+		ChunkSection* copy = ChunkSection::clone(*section);
+		ChunkSection::release(section);
+		section = copy;
+	}
+
+	++_version;
+	return section->blocks;
+}
+
+void Chunk::clearSection(int32_t index)
+{
+	if (_sections[index])
+	{
+		ChunkSection::release(_sections[index]);
+		_sections[index] = nullptr;
+		++_version;
+	}
+}
+
+void Chunk::fill(BlockId id)
+{
+	releaseSections();
+	_entities.reset();
+	if (id != blocks::AIR)
+		for (ChunkSection*& section : _sections)
+			section = ChunkSection::create(id);
+	++_version;
+}
+
+bool Chunk::isEmpty() const { return snapshot().isEmpty(); }
+
+const BlockEntities::Entry* Chunk::getEntity(int32_t x, int32_t y, int32_t z) const
+{
+	return _entities ? _entities->find(static_cast<uint16_t>(index(x, y, z))) : nullptr;
+}
+
+BlockEntities::Entry& Chunk::setEntity(const vec3i& local, BlockEntityType type, const uint8_t* data, size_t size)
+{
+	return editEntities().set(static_cast<uint16_t>(index(local)), type, data, size);
+}
+
+bool Chunk::removeEntity(const vec3i& local)
+{
+	const uint16_t key = static_cast<uint16_t>(index(local));
+	if (!_entities || !_entities->find(key))
+		return false;
+
+	editEntities().erase(key);
+	if (_entities->empty())
+		_entities.reset();
+	return true;
+}
+
+BlockEntities& Chunk::editEntities()
+{
+	if (!_entities)
+		_entities = std::make_shared<BlockEntities>();
+	else if (_entities.use_count() > 1)
+	{
+		// Shared with a snapshot: detach before writing
+		_entities = std::make_shared<BlockEntities>(*_entities);
+	}
+
+	++_version;
+	return *_entities;
+}
+
+void Chunk::clearEntities()
+{
+	if (_entities)
+	{
+		_entities.reset();
+		++_version;
+	}
+}
+
+ChunkSnapshot Chunk::snapshot() const
+{
+	ChunkSnapshot snapshot;
+	snapshot._coords = _coords;
+	snapshot._version = _version;
+	snapshot._entities = _entities;
+	for (int32_t i = 0; i < SECTION_COUNT; ++i)
+	{
+		snapshot._sections[i] = _sections[i];
+		ChunkSection::acquire(_sections[i]);
+	}
+	return snapshot;
+}
+
+void Chunk::releaseSections()
+{
+	for (ChunkSection*& section : _sections)
+	{
+		ChunkSection::release(section);
+		section = nullptr;
+	}
+}
+
+
+
+ChunkSnapshot::ChunkSnapshot() :
+	_coords{},
+	_version{ 0 },
+	_sections{},
+	_entities{}
+{}
+
+ChunkSnapshot::ChunkSnapshot(const ChunkSnapshot& s) :
+	_coords{ s._coords },
+	_version{ s._version },
+	_sections{},
+	_entities{ s._entities }
+{
+	for (int32_t i = 0; i < Chunk::SECTION_COUNT; ++i)
+	{
+		_sections[i] = s._sections[i];
+		ChunkSection::acquire(_sections[i]);
+	}
+}
+
+ChunkSnapshot::ChunkSnapshot(ChunkSnapshot&& s) noexcept :
+	_coords{ std::move(s._coords) },
+	_version{ s._version },
+	_sections{},
+	_entities{ std::move(s._entities) }
+{
+	std::swap(_sections, s._sections);
+}
+
+ChunkSnapshot::~ChunkSnapshot()
+{
+	for (ChunkSection* section : _sections)
+		ChunkSection::release(section);
+}
+
+ChunkSnapshot& ChunkSnapshot::operator= (const ChunkSnapshot& s)
+{
+	if (this != &s)
+	{
+		for (int32_t i = 0; i < Chunk::SECTION_COUNT; ++i)
+		{
+			ChunkSection::acquire(s._sections[i]);
+			ChunkSection::release(_sections[i]);
+			_sections[i] = s._sections[i];
+		}
+		_coords = s._coords;
+		_version = s._version;
+		_entities = s._entities;
+	}
+	return *this;
+}
+
+ChunkSnapshot& ChunkSnapshot::operator= (ChunkSnapshot&& s) noexcept
+{
+	_coords = std::move(s._coords);
+	_version = s._version;
+	std::swap(_sections, s._sections);
+	std::swap(_entities, s._entities);
+	return *this;
+}
+
+bool ChunkSnapshot::isEmpty() const
+{
+	if (_entities && !_entities->empty())
+		return false;
+	for (const ChunkSection* section : _sections)
+		if (section && std::any_of(section->blocks, section->blocks + ChunkSection::VOLUME, [](BlockId id) { return id != blocks::AIR; }))
+			return false;
+	return true;
+}
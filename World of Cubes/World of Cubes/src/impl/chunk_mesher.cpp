@@ -0,0 +1,452 @@
+#include "engine/chunk_mesher.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "engine/world.h"
+#include "engine/heightmap.h"
+#include "engine/section_visibility.h"
+#include "support/bits.h"
+
+namespace
+{
+	constexpr int32_t SIZE = Chunk::SIZE;
+	constexpr int32_t PADDED = ChunkMesher::PADDED;
+
+	// Face keys: the block, then per corner 2 bits of AO and 4 bits each of sky and block light
+	constexpr uint32_t KEY_AO_SHIFT = 16;
+	constexpr uint32_t KEY_SKY_SHIFT = 24;
+	constexpr uint32_t KEY_LIGHT_SHIFT = 40;
+	constexpr uint64_t KEY_MERGE_U = uint64_t{ 1 } << 56;
+	constexpr uint64_t KEY_MERGE_V = uint64_t{ 1 } << 57;
+
+	// Direction of each corner of a face from its center, in u, v order
+	const int32_t CORNER_DU[4] = { -1, 1, 1, -1 };
+	const int32_t CORNER_DV[4] = { -1, -1, 1, 1 };
+
+	// Steps through the padded blocks for the layer, u and v of a face-plane cell
+	struct CellStrides
+	{
+		int32_t layer, u, v;
+
+		explicit CellStrides(int32_t axis)
+		{
+			constexpr int32_t x = 1, z = PADDED, y = z * PADDED;
+			const int32_t strides[3][3] = { { x, z, y }, { y, x, z }, { z, x, y } };
+			layer = strides[axis][0];
+			u = strides[axis][1];
+			v = strides[axis][2];
+		}
+
+		inline size_t operator() (int32_t l, int32_t cu, int32_t cv) const
+		{
+			return ChunkMesher::paddedIndex(0, 0, 0) + static_cast<ptrdiff_t>(l * layer + cu * u + cv * v);
+		}
+	};
+
+	// Blocks of a neighbor touching the center chunk along one axis
+	inline void border_range(int32_t d, int32_t& first, int32_t& last)
+	{
+		first = d < 0 ? -1 : d > 0 ? SIZE : 0;
+		last = d < 0 ? -1 : d > 0 ? SIZE : SIZE - 1;
+	}
+}
+
+void ChunkMesh::clear()
+{
+	quads.clear();
+	vertices.clear();
+	std::fill(faceStart, faceStart + BLOCK_FACE_COUNT + 1, 0u);
+	connectivity = section_visibility::ALL_CONNECTED;
+}
+
+void ChunkNeighborhood::gather(const World& world, const vec3i& coords, ChunkNeighborhood& out)
+{
+	for (int32_t dy = -1; dy <= 1; ++dy)
+		for (int32_t dz = -1; dz <= 1; ++dz)
+			for (int32_t dx = -1; dx <= 1; ++dx)
+			{
+				const Chunk* chunk = world.getChunk({ coords.x + dx, coords.y + dy, coords.z + dz });
+				out.chunks[index(dx, dy, dz)] = chunk ? chunk->snapshot() : ChunkSnapshot{};
+			}
+
+	out.hasHeights = world.getHeightmaps() != nullptr;
+	if (!out.hasHeights)
+		return;
+
+	const vec3i origin = Chunk::origin(coords);
+	for (int32_t z = -1; z <= SIZE; ++z)
+		for (int32_t x = -1; x <= SIZE; ++x)
+			out.heights[(z + 1) * PADDED + (x + 1)] = world.getHeight(HeightmapType::Opaque, origin.x + x, origin.z + z);
+}
+
+ChunkMesher::ChunkMesher(const BlockRegistry& registry) :
+	_registry{ registry },
+	_blocks(static_cast<size_t>(PADDED) * PADDED * PADDED, blocks::AIR),
+	_solid{},
+	_opaque{},
+	_sky{},
+	_slices(static_cast<size_t>(SIZE) * SIZE, 0),
+	_keys(static_cast<size_t>(Chunk::VOLUME), 0),
+	_emissive{ false },
+	_coords{},
+	_version{ 0 },
+	_sections{ 0 },
+	_faceCount{ 0 }
+{
+	for (int32_t axis = 0; axis < 3; ++axis)
+	{
+		_solid[axis].resize(static_cast<size_t>(PADDED) * PADDED);
+		_opaque[axis].resize(static_cast<size_t>(PADDED) * PADDED);
+		_sky[axis].resize(static_cast<size_t>(PADDED) * PADDED);
+	}
+}
+
+void ChunkMesher::build(const ChunkNeighborhood& input, ChunkMesh& mesh)
+{
+	prepare(input);
+	mesh.clear();
+	mesh.section = ChunkMesh::WHOLE_CHUNK;
+	meshRegion({ 0, 0, 0 }, { SIZE, SIZE, SIZE }, _sections != 0, mesh);
+}
+
+void ChunkMesher::prepare(const ChunkNeighborhood& input)
+{
+	_coords = input.center().getCoords();
+	_version = input.center().getVersion();
+	_sections = 0;
+	for (int32_t i = 0; i < Chunk::SECTION_COUNT; ++i)
+		if (input.center().getSection(i))
+			_sections |= 1u << i;
+
+	// Only solid blocks have faces
+	if (!_sections)
+		return;
+
+	copyBlocks(input);
+	buildMasks(input);
+}
+
+void ChunkMesher::buildSection(int32_t section, ChunkMesh& mesh)
+{
+	const vec3i origin = Chunk::sectionOrigin(section);
+	mesh.clear();
+	mesh.section = section;
+	meshRegion(origin, { origin.x + ChunkSection::SIZE, origin.y + ChunkSection::SIZE, origin.z + ChunkSection::SIZE }, (_sections >> section & 1) != 0, mesh);
+	if (_sections >> section & 1)
+		mesh.connectivity = section_visibility::compute(_blocks.data() + paddedIndex(origin.x, origin.y, origin.z), PADDED, PADDED * PADDED, _registry.opaqueTable());
+}
+
+void ChunkMesher::meshRegion(const vec3i& from, const vec3i& to, bool solid, ChunkMesh& mesh)
+{
+	mesh.coords = _coords;
+	mesh.version = _version;
+	mesh.level = 0;
+	_faceCount = 0;
+	if (!solid)
+		return;
+
+	for (size_t f = 0; f < BLOCK_FACE_COUNT; ++f)
+	{
+		mesh.faceStart[f] = static_cast<uint32_t>(mesh.quads.size());
+		meshFace(static_cast<BlockFace>(f), from, to, mesh);
+	}
+	mesh.faceStart[BLOCK_FACE_COUNT] = static_cast<uint32_t>(mesh.quads.size());
+}
+
+void ChunkMesher::copyBlocks(const ChunkNeighborhood& input)
+{
+	std::fill(_blocks.begin(), _blocks.end(), blocks::AIR);
+
+	for (int32_t i = 0; i < Chunk::SECTION_COUNT; ++i)
+	{
+		const ChunkSection* section = input.center().getSection(i);
+		if (!section)
+			continue;
+
+		const vec3i origin = Chunk::sectionOrigin(i);
+		for (int32_t y = 0; y < ChunkSection::SIZE; ++y)
+			for (int32_t z = 0; z < ChunkSection::SIZE; ++z)
+			{
+				const BlockId* row = section->blocks + ChunkSection::index(0, y, z);
+				std::copy(row, row + ChunkSection::SIZE, _blocks.begin() + paddedIndex(origin.x, origin.y + y, origin.z + z));
+			}
+	}
+
+	// Only the blocks touching the center chunk are needed from the others: a layer from the
+	// chunks sharing a face, a row from those sharing an edge and a block from the corners
+	for (int32_t dy = -1; dy <= 1; ++dy)
+		for (int32_t dz = -1; dz <= 1; ++dz)
+			for (int32_t dx = -1; dx <= 1; ++dx)
+			{
+				const ChunkSnapshot& chunk = input.chunks[ChunkNeighborhood::index(dx, dy, dz)];
+				if ((dx == 0 && dy == 0 && dz == 0) || chunk.isEmpty())
+					continue;
+
+				int32_t x0, x1, y0, y1, z0, z1;
+				border_range(dx, x0, x1);
+				border_range(dy, y0, y1);
+				border_range(dz, z0, z1);
+				for (int32_t y = y0; y <= y1; ++y)
+					for (int32_t z = z0; z <= z1; ++z)
+						for (int32_t x = x0; x <= x1; ++x)
+							_blocks[paddedIndex(x, y, z)] = chunk.getBlock(x & Chunk::MASK, y & Chunk::MASK, z & Chunk::MASK);
+			}
+}
+
+void ChunkMesher::buildMasks(const ChunkNeighborhood& input)
+{
+	const uint8_t* opaque = _registry.opaqueTable();
+	const uint8_t* emission = _registry.lightEmissionTable();
+
+	constexpr uint64_t FULL = (uint64_t{ 1 } << PADDED) - 1;
+
+	// Rows along x of the whole padded volume, by (y, z); rows of one block are common (air, stone)
+	uint64_t* solidRows = _solid[0].data();
+	uint64_t* opaqueRows = _opaque[0].data();
+	uint8_t emissive = 0;
+	const BlockId* row = _blocks.data();
+	for (int32_t i = 0; i < PADDED * PADDED; ++i, row += PADDED)
+	{
+		if (std::memcmp(row, row + 1, (PADDED - 1) * sizeof(BlockId)) == 0)
+		{
+			solidRows[i] = row[0] != blocks::AIR ? FULL : 0;
+			opaqueRows[i] = opaque[row[0]] ? FULL : 0;
+			emissive |= emission[row[0]];
+			continue;
+		}
+
+		uint64_t s = 0, o = 0;
+		for (int32_t x = 0; x < PADDED; ++x)
+		{
+			s |= static_cast<uint64_t>(row[x] != blocks::AIR) << x;
+			o |= static_cast<uint64_t>(opaque[row[x]]) << x;
+			emissive |= emission[row[x]];
+		}
+		solidRows[i] = s;
+		opaqueRows[i] = o;
+	}
+	_emissive = emissive != 0;
+
+	// Sky rows are simplest along y: every block above the height of the column
+	uint64_t* skyRows = _sky[1].data();
+	const int32_t baseY = input.center().getCoords().y * SIZE;
+	for (int32_t i = 0; i < PADDED * PADDED; ++i)
+	{
+		// Padded y of the first block above the column, clamped to the padded chunk
+		const int64_t first = input.hasHeights ? static_cast<int64_t>(input.heights[i]) - baseY + 2 : 0;
+		skyRows[i] = first <= 0 ? FULL : first >= PADDED ? 0 : FULL & ~((uint64_t{ 1 } << first) - 1);
+	}
+
+	// The other rows are those of a plane transposed
+	uint64_t matrix[64];
+	auto transpose = [&matrix](const uint64_t* source, size_t sourceStride, uint64_t* target, size_t targetStride) {
+		bool uniform = true;
+		for (int32_t i = 0; i < PADDED; ++i)
+		{
+			matrix[i] = source[i * sourceStride];
+			uniform &= matrix[i] == matrix[0];
+		}
+
+		// Identical rows transpose to rows that are either full or empty
+		if (uniform)
+		{
+			for (int32_t i = 0; i < PADDED; ++i)
+				target[i * targetStride] = (matrix[0] >> i & 1) ? FULL : 0;
+			return;
+		}
+
+		std::fill(matrix + PADDED, matrix + 64, 0);
+		bits::transpose64(matrix);
+		for (int32_t i = 0; i < PADDED; ++i)
+			target[i * targetStride] = matrix[i];
+	};
+
+	// Planes of constant z give the y rows from the x rows and the other way around, then
+	// planes of constant y give the z rows
+	for (int32_t i = 0; i < PADDED; ++i)
+	{
+		transpose(solidRows + i, PADDED, _solid[1].data() + i * PADDED, 1);
+		transpose(opaqueRows + i, PADDED, _opaque[1].data() + i * PADDED, 1);
+		transpose(skyRows + i * PADDED, 1, _sky[0].data() + i, PADDED);
+	}
+	for (int32_t i = 0; i < PADDED; ++i)
+	{
+		transpose(solidRows + i * PADDED, 1, _solid[2].data() + i * PADDED, 1);
+		transpose(opaqueRows + i * PADDED, 1, _opaque[2].data() + i * PADDED, 1);
+		transpose(_sky[0].data() + i * PADDED, 1, _sky[2].data() + i * PADDED, 1);
+	}
+}
+
+void ChunkMesher::meshFace(BlockFace face, const vec3i& from, const vec3i& to, ChunkMesh& mesh)
+{
+	const int32_t axis = static_cast<int32_t>(face) / 2;
+	const bool positive = (static_cast<int32_t>(face) & 1) != 0;
+	const int32_t step = positive ? 1 : -1;
+	const uint64_t* solid = _solid[axis].data();
+	const uint64_t* opaque = _opaque[axis].data();
+	const uint64_t* skyRows = _sky[axis].data();
+	const CellStrides cell{ axis };
+	const BlockId* blocks = _blocks.data();
+	const uint8_t* emission = _registry.lightEmissionTable();
+
+	// Range of the region along the layer, u and v axes of the face
+	const int32_t low[3] = { from.x, from.y, from.z }, high[3] = { to.x, to.y, to.z };
+	const int32_t layerLow = low[axis], layerHigh = high[axis];
+	const int32_t uLow = low[block_face::U_AXIS[axis]], uHigh = high[block_face::U_AXIS[axis]];
+	const int32_t vLow = low[block_face::V_AXIS[axis]], vHigh = high[block_face::V_AXIS[axis]];
+	const uint32_t layers = (layerHigh == SIZE ? ~0u : (1u << layerHigh) - 1) & ~((1u << layerLow) - 1);
+
+	// Bits of the blocks in front of the 32 faces of a row, bit i for layer i
+	auto front = [positive](const uint64_t* rows, int32_t u, int32_t v) {
+		const uint64_t row = rows[rowIndex(u, v)];
+		return static_cast<uint32_t>(positive ? row >> 2 : row);
+	};
+
+	// Culling: 32 faces per row at once, then the scattered bits become face-plane slices
+	std::fill(_slices.begin(), _slices.end(), 0u);
+	for (int32_t v = vLow; v < vHigh; ++v)
+		for (int32_t u = uLow; u < uHigh; ++u)
+		{
+			const uint64_t s = solid[rowIndex(u, v)], o = opaque[rowIndex(u, v)];
+			if (!s)
+				continue;
+
+			const uint64_t hidden = positive ? o >> 1 : o << 1;
+			const uint64_t neighbor = positive ? s >> 1 : s << 1;
+			uint32_t faces = static_cast<uint32_t>((s & ~hidden) >> 1) & layers;
+
+			// Transparent blocks next to something other than air: hidden only by the same block
+			for (uint32_t check = faces & ~static_cast<uint32_t>(o >> 1) & static_cast<uint32_t>(neighbor >> 1); check; check &= check - 1)
+			{
+				const int32_t layer = static_cast<int32_t>(bits::ctz32(check));
+				if (blocks[cell(layer, u, v)] == blocks[cell(layer + step, u, v)])
+					faces &= ~(1u << layer);
+			}
+			if (!faces)
+				continue;
+			_faceCount += bits::popcount32(faces);
+
+			// Per corner, for the 32 faces at once, the blocks around it in front of the face: the
+			// two sides and the diagonal one. AO is 3 minus the opaque ones, 0 when both sides are,
+			// kept as two bit planes. Smooth light averages the open ones, the diagonal one only
+			// if light reaches it through a side.
+			uint32_t aoLow[4], aoHigh[4], open[4][3], sky[4][4];
+			const uint32_t skyFront = front(skyRows, u, v);
+			for (int32_t c = 0; c < 4; ++c)
+			{
+				const int32_t su = u + CORNER_DU[c], sv = v + CORNER_DV[c];
+				const uint32_t side1 = front(opaque, su, v);
+				const uint32_t side2 = front(opaque, u, sv);
+				const uint32_t corner = front(opaque, su, sv);
+				const uint32_t both = side1 & side2;
+				aoLow[c] = ~(side1 ^ side2 ^ corner) & ~both;
+				aoHigh[c] = ~(corner & (side1 ^ side2)) & ~both;
+
+				open[c][0] = ~side1;
+				open[c][1] = ~side2;
+				open[c][2] = ~both & ~corner;
+				sky[c][0] = skyFront;
+				sky[c][1] = open[c][0] & front(skyRows, su, v);
+				sky[c][2] = open[c][1] & front(skyRows, u, sv);
+				sky[c][3] = open[c][2] & front(skyRows, su, sv);
+			}
+
+			for (; faces; faces &= faces - 1)
+			{
+				const int32_t layer = static_cast<int32_t>(bits::ctz32(faces));
+				const BlockId id = blocks[cell(layer, u, v)];
+
+				// Block light is rare: only looked up when something emits around the chunk
+				uint8_t light[3][3] = {};
+				if (_emissive)
+					for (int32_t dv = -1; dv <= 1; ++dv)
+						for (int32_t du = -1; du <= 1; ++du)
+							light[dv + 1][du + 1] = emission[blocks[cell(layer + step, u + du, v + dv)]];
+
+				uint64_t key = id;
+				uint32_t corners[4];
+				for (int32_t c = 0; c < 4; ++c)
+				{
+					const bool side1 = (open[c][0] >> layer & 1) != 0;
+					const bool side2 = (open[c][1] >> layer & 1) != 0;
+					const bool diagonal = (open[c][2] >> layer & 1) != 0;
+					const uint32_t count = 1 + side1 + side2 + diagonal;
+					const uint32_t lit = (sky[c][0] >> layer & 1) + (sky[c][1] >> layer & 1) + (sky[c][2] >> layer & 1) + (sky[c][3] >> layer & 1);
+
+					const int32_t su = CORNER_DU[c] + 1, sv = CORNER_DV[c] + 1;
+					const uint32_t lightSum = light[1][1] + (side1 ? light[1][su] : 0) + (side2 ? light[sv][1] : 0) + (diagonal ? light[sv][su] : 0);
+
+					const uint32_t ao = (aoHigh[c] >> layer & 1) << 1 | (aoLow[c] >> layer & 1);
+					const uint32_t skyLight = (lit * voxel_vertex::MAX_LIGHT + count / 2) / count;
+					const uint32_t blockLight = std::max<uint32_t>((lightSum + count / 2) / count, emission[id]);
+					key |= static_cast<uint64_t>(ao) << (KEY_AO_SHIFT + c * 2);
+					key |= static_cast<uint64_t>(skyLight) << (KEY_SKY_SHIFT + c * 4);
+					key |= static_cast<uint64_t>(blockLight) << (KEY_LIGHT_SHIFT + c * 4);
+					corners[c] = ao | skyLight << 2 | blockLight << 6;
+				}
+
+				// A quad interpolates its corners: faces only merge along a direction their
+				// corners do not change in
+				if (corners[0] == corners[1] && corners[3] == corners[2])
+					key |= KEY_MERGE_U;
+				if (corners[0] == corners[3] && corners[1] == corners[2])
+					key |= KEY_MERGE_V;
+
+				_keys[static_cast<size_t>(layer) * Chunk::AREA + v * SIZE + u] = key;
+				_slices[layer * SIZE + v] |= 1u << u;
+			}
+		}
+
+	// Greedy merge: widest run of equal keys along u, then as many rows along v as match
+	const TextureId* textures = _registry.textureTable();
+	for (int32_t layer = layerLow; layer < layerHigh; ++layer)
+	{
+		uint32_t* rows = _slices.data() + layer * SIZE;
+		const uint64_t* keys = _keys.data() + static_cast<size_t>(layer) * Chunk::AREA;
+		for (int32_t v = vLow; v < vHigh; ++v)
+			while (rows[v])
+			{
+				const int32_t u = static_cast<int32_t>(bits::ctz32(rows[v]));
+				const uint64_t key = keys[v * SIZE + u];
+
+				int32_t width = 1;
+				if (key & KEY_MERGE_U)
+					while (u + width < SIZE && (rows[v] >> (u + width) & 1) && keys[v * SIZE + u + width] == key)
+						++width;
+				const uint32_t mask = (width == SIZE ? ~0u : (1u << width) - 1) << u;
+
+				int32_t height = 1;
+				if (key & KEY_MERGE_V)
+					for (; v + height < SIZE && (rows[v + height] & mask) == mask; ++height)
+					{
+						const uint64_t* next = keys + (v + height) * SIZE + u;
+						int32_t k = 0;
+						while (k < width && next[k] == key)
+							++k;
+						if (k < width)
+							break;
+					}
+
+				for (int32_t k = 0; k < height; ++k)
+					rows[v + k] &= ~mask;
+
+				const BlockId id = static_cast<BlockId>(key & 0xffff);
+				const vec3i p = block_face::cell_position(axis, layer, u, v);
+				mesh.quads.push_back({
+					static_cast<uint8_t>(p.x), static_cast<uint8_t>(p.y), static_cast<uint8_t>(p.z),
+					static_cast<uint8_t>(width), static_cast<uint8_t>(height),
+					face, id, textures[id * BLOCK_FACE_COUNT + static_cast<size_t>(face)]
+				});
+
+				uint8_t ao[4], skyLight[4], blockLight[4];
+				for (int32_t c = 0; c < 4; ++c)
+				{
+					ao[c] = static_cast<uint8_t>(key >> (KEY_AO_SHIFT + c * 2) & voxel_vertex::MAX_AO);
+					skyLight[c] = static_cast<uint8_t>(key >> (KEY_SKY_SHIFT + c * 4) & voxel_vertex::MAX_LIGHT);
+					blockLight[c] = static_cast<uint8_t>(key >> (KEY_LIGHT_SHIFT + c * 4) & voxel_vertex::MAX_LIGHT);
+				}
+				voxel_vertex::emitQuad(mesh.quads.back(), ao, skyLight, blockLight, mesh.vertices);
+			}
+	}
+}
@@ -0,0 +1,388 @@
+#include "engine/chunk_serializer.h"
+
+#include <algorithm>
+
+#include "support/lz.h"
+
+namespace
+{
+	inline void put16(std::vector<uint8_t>& out, uint16_t value)
+	{
+		out.push_back(static_cast<uint8_t>(value));
+		out.push_back(static_cast<uint8_t>(value >> 8));
+	}
+
+	inline uint16_t get16(const uint8_t* data) { return static_cast<uint16_t>(data[0] | (data[1] << 8)); }
+
+	uint8_t section_mask(const ChunkSnapshot& chunk)
+	{
+		uint8_t mask = 0;
+		for (int32_t i = 0; i < Chunk::SECTION_COUNT; ++i)
+			if (chunk.getSection(i))
+				mask |= static_cast<uint8_t>(1u << i);
+		return mask;
+	}
+
+	void encode_raw(const BlockId* blocks, std::vector<uint8_t>& out)
+	{
+		for (int32_t i = 0; i < ChunkSection::VOLUME; ++i)
+			put16(out, blocks[i]);
+	}
+
+	bool decode_raw(const uint8_t*& data, const uint8_t* end, BlockId* blocks)
+	{
+		if (end - data < ChunkSection::VOLUME * 2)
+			return false;
+		for (int32_t i = 0; i < ChunkSection::VOLUME; ++i, data += 2)
+			blocks[i] = get16(data);
+		return true;
+	}
+
+	void encode_runs(const BlockId* blocks, std::vector<uint8_t>& out)
+	{
+		for (int32_t i = 0; i < ChunkSection::VOLUME;)
+		{
+			int32_t run = 1;
+			while (i + run < ChunkSection::VOLUME && blocks[i + run] == blocks[i])
+				++run;
+			put16(out, static_cast<uint16_t>(run - 1));
+			put16(out, blocks[i]);
+			i += run;
+		}
+	}
+
+	bool decode_runs(const uint8_t*& data, const uint8_t* end, BlockId* blocks)
+	{
+		for (int32_t i = 0; i < ChunkSection::VOLUME;)
+		{
+			if (end - data < 4)
+				return false;
+			int32_t run = get16(data) + 1;
+			BlockId id = get16(data + 2);
+			data += 4;
+			if (i + run > ChunkSection::VOLUME)
+				return false;
+			std::fill(blocks + i, blocks + i + run, id);
+			i += run;
+		}
+		return true;
+	}
+
+
+	/*
+	 * Palette sections: the distinct ids in order of first appearance, then the section as
+	 * palette indices in one of three bodies, whichever is smallest:
+	 *   runs:   varint((run - 1) << bits | index) along the Y-major order
+	 *   packed: indices bit-packed into 64-bit words, floor(64 / bits) per word
+	 *   lz:     the packed words compressed with lz
+	 * A single-entry palette has no body.
+	 */
+	enum PaletteBody : uint8_t
+	{
+		BODY_RUNS = 0,
+		BODY_PACKED = 1,
+		BODY_LZ = 2
+	};
+
+	constexpr uint32_t MAX_INDEX_BITS = 12;
+	constexpr size_t MAX_PACKED_BYTES = ((ChunkSection::VOLUME + 4) / 5) * 8;
+
+	inline void put_varint(std::vector<uint8_t>& out, uint32_t value)
+	{
+		for (; value >= 0x80; value >>= 7)
+			out.push_back(static_cast<uint8_t>(value | 0x80));
+		out.push_back(static_cast<uint8_t>(value));
+	}
+
+	inline bool get_varint(const uint8_t*& data, const uint8_t* end, uint32_t& value)
+	{
+		value = 0;
+		for (uint32_t shift = 0; shift < 35 && data != end; shift += 7)
+		{
+			uint8_t byte = *data++;
+			value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+			if (!(byte & 0x80))
+				return true;
+		}
+		return false;
+	}
+
+	inline uint32_t index_bits(size_t paletteSize)
+	{
+		uint32_t bits = 1;
+		while ((size_t{ 1 } << bits) < paletteSize)
+			++bits;
+		return bits;
+	}
+
+	inline size_t packed_words(uint32_t bits)
+	{
+		const size_t perWord = 64 / bits;
+		return (ChunkSection::VOLUME + perWord - 1) / perWord;
+	}
+
+	void pack_indices(const uint16_t* indices, uint32_t bits, std::vector<uint8_t>& out)
+	{
+		const size_t perWord = 64 / bits;
+		for (size_t i = 0; i < ChunkSection::VOLUME; i += perWord)
+		{
+			uint64_t word = 0;
+			for (size_t j = 0; j < perWord && i + j < ChunkSection::VOLUME; ++j)
+				word |= static_cast<uint64_t>(indices[i + j]) << (j * bits);
+			for (int32_t k = 0; k < 8; ++k)
+				out.push_back(static_cast<uint8_t>(word >> (k * 8)));
+		}
+	}
+
+	void unpack_indices(const uint8_t* data, uint32_t bits, const BlockId* palette, BlockId* blocks)
+	{
+		const size_t perWord = 64 / bits;
+		const uint64_t mask = (uint64_t{ 1 } << bits) - 1;
+		for (size_t i = 0; i < ChunkSection::VOLUME; i += perWord, data += 8)
+		{
+			uint64_t word = 0;
+			for (int32_t k = 0; k < 8; ++k)
+				word |= static_cast<uint64_t>(data[k]) << (k * 8);
+
+			const size_t count = std::min(perWord, ChunkSection::VOLUME - i);
+			for (size_t j = 0; j < count; ++j, word >>= bits)
+				blocks[i + j] = palette[word & mask];
+		}
+	}
+
+	void encode_palette(const BlockId* blocks, std::vector<uint8_t>& out)
+	{
+		static thread_local std::vector<uint16_t> lookup(size_t{ 1 } << 16, 0xffff);
+		static thread_local std::vector<uint8_t> runs, packed, compressed;
+
+		BlockId palette[ChunkSection::VOLUME];
+		uint16_t indices[ChunkSection::VOLUME];
+		size_t paletteSize = 0;
+		for (int32_t i = 0; i < ChunkSection::VOLUME; ++i)
+		{
+			uint16_t& slot = lookup[blocks[i]];
+			if (slot == 0xffff)
+			{
+				slot = static_cast<uint16_t>(paletteSize);
+				palette[paletteSize++] = blocks[i];
+			}
+			indices[i] = slot;
+		}
+		for (size_t i = 0; i < paletteSize; ++i)
+			lookup[palette[i]] = 0xffff;
+
+		put_varint(out, static_cast<uint32_t>(paletteSize));
+		for (size_t i = 0; i < paletteSize; ++i)
+			put_varint(out, palette[i]);
+		if (paletteSize == 1)
+			return;
+
+		const uint32_t bits = index_bits(paletteSize);
+
+		runs.clear();
+		for (int32_t i = 0; i < ChunkSection::VOLUME;)
+		{
+			int32_t run = 1;
+			while (i + run < ChunkSection::VOLUME && indices[i + run] == indices[i])
+				++run;
+			put_varint(runs, (static_cast<uint32_t>(run - 1) << bits) | indices[i]);
+			i += run;
+		}
+
+		packed.clear();
+		pack_indices(indices, bits, packed);
+
+		compressed.clear();
+		lz::compress(packed.data(), packed.size(), compressed);
+		const size_t lzSize = compressed.size() + (compressed.size() < 0x80 ? 1 : 2);
+
+		if (lzSize < runs.size() && lzSize < packed.size())
+		{
+			out.push_back(BODY_LZ);
+			put_varint(out, static_cast<uint32_t>(compressed.size()));
+			out.insert(out.end(), compressed.begin(), compressed.end());
+		}
+		else if (packed.size() < runs.size())
+		{
+			out.push_back(BODY_PACKED);
+			out.insert(out.end(), packed.begin(), packed.end());
+		}
+		else
+		{
+			out.push_back(BODY_RUNS);
+			out.insert(out.end(), runs.begin(), runs.end());
+		}
+	}
+
+	bool decode_palette(const uint8_t*& data, const uint8_t* end, BlockId* blocks)
+	{
+		uint32_t paletteSize;
+		if (!get_varint(data, end, paletteSize) || paletteSize == 0 || paletteSize > ChunkSection::VOLUME)
+			return false;
+
+		BlockId palette[size_t{ 1 } << MAX_INDEX_BITS];
+		for (uint32_t i = 0; i < paletteSize; ++i)
+		{
+			uint32_t id;
+			if (!get_varint(data, end, id) || id > 0xffff)
+				return false;
+			palette[i] = static_cast<BlockId>(id);
+		}
+
+		if (paletteSize == 1)
+		{
+			std::fill(blocks, blocks + ChunkSection::VOLUME, palette[0]);
+			return true;
+		}
+
+		if (data == end)
+			return false;
+		const uint8_t kind = *data++;
+		const uint32_t bits = index_bits(paletteSize);
+		const size_t packedSize = packed_words(bits) * 8;
+
+		// Padded to a power of two so that a corrupted packed index still stays in bounds
+		std::fill(palette + paletteSize, palette + (size_t{ 1 } << bits), palette[0]);
+
+		switch (kind)
+		{
+			case BODY_RUNS:
+				for (int32_t i = 0; i < ChunkSection::VOLUME;)
+				{
+					uint32_t value;
+					if (!get_varint(data, end, value))
+						return false;
+					const uint32_t index = value & ((1u << bits) - 1);
+					const int32_t run = static_cast<int32_t>(value >> bits) + 1;
+					if (index >= paletteSize || run > ChunkSection::VOLUME - i)
+						return false;
+					std::fill(blocks + i, blocks + i + run, palette[index]);
+					i += run;
+				}
+				return true;
+
+			case BODY_PACKED:
+				if (static_cast<size_t>(end - data) < packedSize)
+					return false;
+				unpack_indices(data, bits, palette, blocks);
+				data += packedSize;
+				return true;
+
+			case BODY_LZ:
+			{
+				uint32_t size;
+				if (!get_varint(data, end, size) || static_cast<size_t>(end - data) < size)
+					return false;
+
+				uint8_t packed[MAX_PACKED_BYTES];
+				if (!lz::decompress(data, size, packed, packedSize))
+					return false;
+				unpack_indices(packed, bits, palette, blocks);
+				data += size;
+				return true;
+			}
+
+			default:
+				return false;
+		}
+	}
+
+
+	/*
+	 * Block entity trailer: varint count, then for each entity in index order
+	 * varint(index delta), varint(type), varint(size) and the payload bytes.
+	 */
+	void encode_entities(const BlockEntities& entities, std::vector<uint8_t>& out)
+	{
+		put_varint(out, static_cast<uint32_t>(entities.size()));
+		uint32_t previous = 0;
+		for (const BlockEntities::Entry& entry : entities)
+		{
+			put_varint(out, entry.index - previous);
+			put_varint(out, entry.type);
+			put_varint(out, static_cast<uint32_t>(entry.data.size()));
+			out.insert(out.end(), entry.data.begin(), entry.data.end());
+			previous = entry.index;
+		}
+	}
+
+	bool decode_entities(const uint8_t*& data, const uint8_t* end, Chunk& chunk)
+	{
+		uint32_t count;
+		if (!get_varint(data, end, count) || count == 0 || count > Chunk::VOLUME)
+			return false;
+
+		BlockEntities& entities = chunk.editEntities();
+		uint32_t index = 0;
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			uint32_t delta, type, size;
+			if (!get_varint(data, end, delta) || !get_varint(data, end, type) || !get_varint(data, end, size))
+				return false;
+
+			index += delta;
+			if ((i > 0 && delta == 0) || index >= Chunk::VOLUME || type > 0xffff || static_cast<size_t>(end - data) < size)
+				return false;
+
+			entities.set(static_cast<uint16_t>(index), static_cast<BlockEntityType>(type), data, size);
+			data += size;
+		}
+		return true;
+	}
+}
+
+void chunk_io::encode(const ChunkSnapshot& chunk, ChunkCompression compression, std::vector<uint8_t>& out)
+{
+	out.clear();
+	uint8_t mask = section_mask(chunk);
+	out.push_back(mask);
+
+	for (int32_t i = 0; i < Chunk::SECTION_COUNT; ++i)
+	{
+		if (!(mask & (1u << i)))
+			continue;
+
+		const BlockId* blocks = chunk.getSection(i)->blocks;
+		switch (compression)
+		{
+			case ChunkCompression::None: encode_raw(blocks, out); break;
+			case ChunkCompression::RunLength: encode_runs(blocks, out); break;
+			case ChunkCompression::Palette: encode_palette(blocks, out); break;
+		}
+	}
+
+	const BlockEntities* entities = chunk.getEntities();
+	if (entities && !entities->empty())
+		encode_entities(*entities, out);
+}
+
+bool chunk_io::decode(const uint8_t* data, size_t size, ChunkCompression compression, Chunk& chunk)
+{
+	if (size < 1)
+		return false;
+
+	const uint8_t* end = data + size;
+	uint8_t mask = *data++;
+	for (int32_t i = 0; i < Chunk::SECTION_COUNT; ++i)
+	{
+		if (!(mask & (1u << i)))
+		{
+			chunk.clearSection(i);
+			continue;
+		}
+
+		BlockId* blocks = chunk.editSection(i);
+		bool ok = false;
+		switch (compression)
+		{
+			case ChunkCompression::None: ok = decode_raw(data, end, blocks); break;
+			case ChunkCompression::RunLength: ok = decode_runs(data, end, blocks); break;
+			case ChunkCompression::Palette: ok = decode_palette(data, end, blocks); break;
+		}
+		if (!ok)
+			return false;
+	}
+
+	chunk.clearEntities();
+	return data == end || (decode_entities(data, end, chunk) && data == end);
+}
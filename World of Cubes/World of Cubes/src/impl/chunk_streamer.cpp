@@ -0,0 +1,367 @@
+#include "engine/chunk_streamer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <unordered_set>
+
+#include "engine/world.h"
+#include "engine/region_file.h"
+#include "engine/terrain_generator.h"
+#include "support/clock.h"
+#include "support/epoch.h"
+
+namespace
+{
+	inline vec3i chunk_of(const vec3f& position)
+	{
+		return {
+			static_cast<int32_t>(std::floor(position.x / Chunk::SIZE)),
+			static_cast<int32_t>(std::floor(position.y / Chunk::SIZE)),
+			static_cast<int32_t>(std::floor(position.z / Chunk::SIZE))
+		};
+	}
+
+	inline int32_t distance_squared(const vec3i& a, const vec3i& b)
+	{
+		const int32_t dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+		return dx * dx + dy * dy + dz * dz;
+	}
+}
+
+ChunkStreamer::ChunkStreamer(World& world, RegionStorage* storage, const TerrainGenerator& generator, uint32_t workers) :
+	_world{ world },
+	_storage{ storage },
+	_generator{ generator },
+	_mesher{},
+	_loadRadius{ 8 },
+	_unloadRadius{ 10 },
+	_minY{ 0 },
+	_maxY{ 7 },
+	_lookAhead{ 1.0f },
+	_anchors{},
+	_candidates{},
+	_nextCandidate{ 0 },
+	_states{},
+	_generateQueue{},
+	_meshQueue{},
+	_unloadQueue{},
+	_workers{},
+	_jobLock{},
+	_jobReady{},
+	_jobs{},
+	_finished{},
+	_arrived{},
+	_jobsInFlight{ 0 },
+	_stopping{ false },
+	_stats{}
+{
+	for (uint32_t i = 0; i < workers; ++i)
+		_workers.emplace_back(&ChunkStreamer::work, this);
+}
+
+ChunkStreamer::~ChunkStreamer()
+{
+	{
+		std::lock_guard<std::mutex> lock{ _jobLock };
+		_stopping = true;
+		_jobs.clear();
+	}
+	_jobReady.notify_all();
+	for (std::thread& worker : _workers)
+		worker.join();
+}
+
+void ChunkStreamer::setRadius(int32_t loadRadius, int32_t unloadRadius)
+{
+	_loadRadius = std::max(0, loadRadius);
+	_unloadRadius = std::max(_loadRadius + 1, unloadRadius);
+	_anchors.clear();
+}
+
+void ChunkStreamer::setVerticalRange(int32_t minY, int32_t maxY)
+{
+	_minY = std::min(minY, maxY);
+	_maxY = std::max(minY, maxY);
+	_anchors.clear();
+}
+
+void ChunkStreamer::update(const std::vector<StreamObserver>& observers, const StreamBudget& budget)
+{
+	_stats.loaded = _stats.generated = _stats.meshed = _stats.unloaded = 0;
+
+	if (refresh(observers))
+		rebuild(observers);
+
+	runUnloads(budget.unload);
+	runLoads(budget.load);
+	runGeneration(budget.generate);
+	runMeshing(budget.mesh);
+
+	_stats.loadQueue = _candidates.size() - _nextCandidate;
+	_stats.generateQueue = _generateQueue.size();
+	_stats.meshQueue = _meshQueue.size();
+	_stats.tracked = _states.size();
+}
+
+void ChunkStreamer::invalidate(const vec3i& coords)
+{
+	auto it = _states.find(ChunkMap<Chunk>::pack(coords));
+	if (it != _states.end() && it->second == State::Ready)
+	{
+		it->second = State::Meshing;
+		_meshQueue.push_front(coords);
+	}
+}
+
+ChunkStreamer::State ChunkStreamer::getState(const vec3i& coords) const
+{
+	auto it = _states.find(ChunkMap<Chunk>::pack(coords));
+	return it != _states.end() ? it->second : State::Unloaded;
+}
+
+bool ChunkStreamer::refresh(const std::vector<StreamObserver>& observers)
+{
+	// Current and predicted chunk of every observer; a change in either reorders the queue
+	std::vector<vec3i> anchors;
+	anchors.reserve(observers.size() * 2);
+	for (const StreamObserver& observer : observers)
+		anchors.push_back(chunk_of(observer.position));
+	for (const StreamObserver& observer : observers)
+		anchors.push_back(chunk_of(observer.position + observer.velocity * _lookAhead));
+
+	if (anchors.size() == _anchors.size() && std::equal(anchors.begin(), anchors.end(), _anchors.begin(),
+		[](const vec3i& a, const vec3i& b) { return a.x == b.x && a.y == b.y && a.z == b.z; }))
+		return false;
+
+	_anchors.swap(anchors);
+	return true;
+}
+
+void ChunkStreamer::rebuild(const std::vector<StreamObserver>& observers)
+{
+	_candidates.clear();
+	_nextCandidate = 0;
+
+	const size_t observerCount = observers.size();
+	const int32_t radiusSquared = _loadRadius * _loadRadius;
+	std::unordered_set<uint64_t> seen;
+	for (size_t i = 0; i < observerCount; ++i)
+	{
+		const vec3i& center = _anchors[i];
+		for (int32_t y = std::max(_minY, center.y - _loadRadius); y <= std::min(_maxY, center.y + _loadRadius); ++y)
+			for (int32_t z = center.z - _loadRadius; z <= center.z + _loadRadius; ++z)
+				for (int32_t x = center.x - _loadRadius; x <= center.x + _loadRadius; ++x)
+				{
+					const vec3i coords = { x, y, z };
+					if (distance_squared(coords, center) > radiusSquared)
+						continue;
+
+					const uint64_t key = ChunkMap<Chunk>::pack(coords);
+					if (_states.count(key) || !seen.insert(key).second)
+						continue;
+					_candidates.push_back({ priority(observers, coords), coords });
+				}
+	}
+
+	std::sort(_candidates.begin(), _candidates.end(), [](const Candidate& a, const Candidate& b) { return a.priority < b.priority; });
+
+	// Meshing follows the same order; chunks left behind wait until the front is done
+	std::stable_sort(_meshQueue.begin(), _meshQueue.end(), [this, &observers](const vec3i& a, const vec3i& b) {
+		return priority(observers, a) < priority(observers, b);
+	});
+
+	_unloadQueue.clear();
+	for (const auto& state : _states)
+	{
+		const vec3i coords = ChunkMap<Chunk>::unpack(state.first);
+		if (!inRange(coords, _unloadRadius))
+			_unloadQueue.push_back(coords);
+	}
+}
+
+float ChunkStreamer::priority(const std::vector<StreamObserver>& observers, const vec3i& coords) const
+{
+	const float half = Chunk::SIZE * 0.5f;
+	const vec3f center = {
+		coords.x * static_cast<float>(Chunk::SIZE) + half,
+		coords.y * static_cast<float>(Chunk::SIZE) + half,
+		coords.z * static_cast<float>(Chunk::SIZE) + half
+	};
+
+	float best = INFINITY;
+	for (const StreamObserver& observer : observers)
+	{
+		const vec3f predicted = observer.position + observer.velocity * _lookAhead;
+		const vec3f offset = { center.x - predicted.x, center.y - predicted.y, center.z - predicted.z };
+		const float distance = static_cast<float>(offset.length());
+
+		// Up to twice as urgent straight ahead as behind
+		float facing = 0.0f;
+		const float directionLength = static_cast<float>(observer.direction.length());
+		if (distance > 0.0f && directionLength > 0.0f)
+			facing = offset.dot(observer.direction) / (distance * directionLength);
+
+		best = std::min(best, distance * (1.5f - 0.5f * facing));
+	}
+	return best;
+}
+
+void ChunkStreamer::runLoads(const Time& budget)
+{
+	Clock clock;
+	while (_nextCandidate < _candidates.size() && clock.getElapsedTime() < budget)
+	{
+		const vec3i coords = _candidates[_nextCandidate++].coords;
+		const uint64_t key = ChunkMap<Chunk>::pack(coords);
+		if (_states.count(key))
+			continue;
+
+		std::unique_ptr<Chunk> chunk{ new Chunk{ coords } };
+		if (_storage && _storage->loadChunk(coords, *chunk) && _world.addChunk(std::move(chunk)))
+		{
+			_states[key] = State::Meshing;
+			_meshQueue.push_back(coords);
+			++_stats.loaded;
+		}
+		else
+		{
+			_states[key] = State::Generating;
+			_generateQueue.push_back(coords);
+		}
+	}
+}
+
+void ChunkStreamer::runGeneration(const Time& budget)
+{
+	Clock clock;
+	if (_workers.empty())
+	{
+		while (!_generateQueue.empty() && clock.getElapsedTime() < budget)
+		{
+			const vec3i coords = _generateQueue.front();
+			_generateQueue.pop_front();
+			if (getState(coords) != State::Generating)
+				continue;
+
+			std::unique_ptr<Chunk> chunk{ new Chunk{ coords } };
+			_generator.generate(*chunk);
+			addGenerated(std::move(chunk));
+		}
+		return;
+	}
+
+	// Keep every worker busy with a couple of jobs, in priority order
+	{
+		std::lock_guard<std::mutex> lock{ _jobLock };
+		while (!_generateQueue.empty() && _jobsInFlight < _workers.size() * 2)
+		{
+			const vec3i coords = _generateQueue.front();
+			_generateQueue.pop_front();
+			if (getState(coords) != State::Generating)
+				continue;
+
+			_jobs.push_back(coords);
+			++_jobsInFlight;
+		}
+		for (std::unique_ptr<Chunk>& chunk : _finished)
+			_arrived.push_back(std::move(chunk));
+		_finished.clear();
+	}
+	_jobReady.notify_all();
+
+	while (!_arrived.empty() && clock.getElapsedTime() < budget)
+	{
+		std::unique_ptr<Chunk> chunk = std::move(_arrived.front());
+		_arrived.pop_front();
+		--_jobsInFlight;
+		if (getState(chunk->getCoords()) == State::Generating)
+			addGenerated(std::move(chunk));
+	}
+}
+
+void ChunkStreamer::addGenerated(std::unique_ptr<Chunk> chunk)
+{
+	const vec3i coords = chunk->getCoords();
+	if (!_world.addChunk(std::move(chunk), true) && !_world.getChunk(coords))
+	{
+		_states.erase(ChunkMap<Chunk>::pack(coords));
+		return;
+	}
+
+	_states[ChunkMap<Chunk>::pack(coords)] = State::Meshing;
+	_meshQueue.push_back(coords);
+	++_stats.generated;
+}
+
+void ChunkStreamer::runMeshing(const Time& budget)
+{
+	Clock clock;
+	while (!_meshQueue.empty() && clock.getElapsedTime() < budget)
+	{
+		const vec3i coords = _meshQueue.front();
+		_meshQueue.pop_front();
+
+		auto it = _states.find(ChunkMap<Chunk>::pack(coords));
+		Chunk* chunk = _world.getChunk(coords);
+		if (it == _states.end() || it->second != State::Meshing || !chunk)
+			continue;
+
+		if (_mesher)
+			_mesher(*chunk);
+		it->second = State::Ready;
+		++_stats.meshed;
+	}
+}
+
+void ChunkStreamer::runUnloads(const Time& budget)
+{
+	Clock clock;
+	while (!_unloadQueue.empty() && clock.getElapsedTime() < budget)
+	{
+		const vec3i coords = _unloadQueue.back();
+		_unloadQueue.pop_back();
+
+		// Hysteresis: the observer may have turned back since the queue was built
+		if (inRange(coords, _unloadRadius))
+			continue;
+
+		_states.erase(ChunkMap<Chunk>::pack(coords));
+		if (_world.removeChunk(coords))
+			++_stats.unloaded;
+	}
+
+	if (_stats.unloaded > 0)
+		epoch::collect();
+}
+
+void ChunkStreamer::work()
+{
+	std::unique_lock<std::mutex> lock{ _jobLock };
+	for (;;)
+	{
+		_jobReady.wait(lock, [this]() { return _stopping || !_jobs.empty(); });
+		if (_stopping)
+			return;
+
+		const vec3i coords = _jobs.front();
+		_jobs.pop_front();
+		lock.unlock();
+
+		std::unique_ptr<Chunk> chunk{ new Chunk{ coords } };
+		_generator.generate(*chunk);
+
+		lock.lock();
+		_finished.push_back(std::move(chunk));
+	}
+}
+
+bool ChunkStreamer::inRange(const vec3i& coords, int32_t radius) const
+{
+	// Only the current chunks of the observers count, the predicted ones are in the second half
+	const size_t observers = _anchors.size() / 2;
+	for (size_t i = 0; i < observers; ++i)
+		if (distance_squared(coords, _anchors[i]) <= radius * radius)
+			return true;
+	return false;
+}
@@ -0,0 +1,142 @@
+#include "support/epoch.h"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+namespace epoch
+{
+	static constexpr uint64_t _Inactive = 0;
+	static constexpr size_t _CollectThreshold = 256;
+
+	struct ThreadRecord
+	{
+		std::atomic<uint64_t> epoch{ _Inactive };
+		std::atomic<bool> used{ false };
+	};
+
+	struct RetiredObject
+	{
+		void* ptr;
+		Deleter deleter;
+		uint64_t epoch;
+	};
+
+	struct Limbo
+	{
+		std::mutex lock;
+		std::vector<RetiredObject> objects;
+
+		~Limbo()
+		{
+			for (RetiredObject& obj : objects)
+				obj.deleter(obj.ptr);
+		}
+	};
+
+	static std::atomic<uint64_t> _GlobalEpoch{ 1 };
+	static ThreadRecord _Records[MAX_THREADS];
+	static Limbo _Limbo;
+
+	struct ThreadSlot
+	{
+		ThreadRecord* record = nullptr;
+		uint32_t depth = 0;
+
+		ThreadRecord& get()
+		{
+			if (record)
+				return *record;
+
+			for (ThreadRecord& rec : _Records)
+			{
+				bool expected = false;
+				if (rec.used.compare_exchange_strong(expected, true))
+				{
+					record = &rec;
+					return rec;
+				}
+			}
+
+			// Waiting for a record could deadlock with the threads holding them
+			std::cerr << "Epoch error: more than " << MAX_THREADS << " threads use epoch guards at once" << std::endl;
+			std::abort();
+		}
+
+		~ThreadSlot()
+		{
+			if (record)
+			{
+				record->epoch.store(_Inactive);
+				record->used.store(false);
+			}
+		}
+	};
+
+	static thread_local ThreadSlot _Slot;
+}
+
+
+epoch::Guard::Guard()
+{
+	ThreadRecord& rec = _Slot.get();
+	if (_Slot.depth++ == 0)
+		rec.epoch.store(_GlobalEpoch.load());
+}
+
+epoch::Guard::~Guard()
+{
+	if (--_Slot.depth == 0)
+		_Slot.record->epoch.store(_Inactive, std::memory_order_release);
+}
+
+void epoch::retire(void* ptr, Deleter deleter)
+{
+	if (!ptr)
+		return;
+
+	size_t count;
+	{
+		std::lock_guard<std::mutex> lock{ _Limbo.lock };
+		_Limbo.objects.push_back({ ptr, deleter, _GlobalEpoch.load() });
+		count = _Limbo.objects.size();
+	}
+
+	if (count >= _CollectThreshold)
+		collect();
+}
+
+size_t epoch::collect()
+{
+	uint64_t oldest = _GlobalEpoch.fetch_add(1) + 1;
+	for (const ThreadRecord& rec : _Records)
+	{
+		uint64_t e = rec.epoch.load();
+		if (e != _Inactive)
+			oldest = std::min(oldest, e);
+	}
+
+	// A reader pinned at epoch E can only reference objects retired at E or later
+	std::vector<RetiredObject> reclaimable;
+	{
+		std::lock_guard<std::mutex> lock{ _Limbo.lock };
+		auto it = std::partition(_Limbo.objects.begin(), _Limbo.objects.end(), [oldest](const RetiredObject& obj) { return obj.epoch >= oldest; });
+		reclaimable.assign(it, _Limbo.objects.end());
+		_Limbo.objects.erase(it, _Limbo.objects.end());
+	}
+
+	for (RetiredObject& obj : reclaimable)
+		obj.deleter(obj.ptr);
+	return reclaimable.size();
+}
+
+uint64_t epoch::current() { return _GlobalEpoch.load(); }
+
+size_t epoch::pending()
+{
+	std::lock_guard<std::mutex> lock{ _Limbo.lock };
+	return _Limbo.objects.size();
+}
@@ -0,0 +1,319 @@
+#include "support/file.h"
+
+#include <algorithm>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cstdio>
+#endif
+
+#ifdef _WIN32
+
+File::File() :
+	_handle{ INVALID_HANDLE_VALUE }
+{}
+
+File::File(File&& f) noexcept :
+	_handle{ f._handle }
+{
+	f._handle = INVALID_HANDLE_VALUE;
+}
+
+File& File::operator= (File&& f) noexcept
+{
+	std::swap(_handle, f._handle);
+	return *this;
+}
+
+bool File::open(const std::string& path, Mode mode)
+{
+	close();
+	DWORD access = mode == Mode::Read ? GENERIC_READ : GENERIC_READ | GENERIC_WRITE;
+	DWORD disposition = mode == Mode::Create ? OPEN_ALWAYS : OPEN_EXISTING;
+	_handle = CreateFileA(path.c_str(), access, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, disposition, FILE_ATTRIBUTE_NORMAL, nullptr);
+	return _handle != INVALID_HANDLE_VALUE;
+}
+
+void File::close()
+{
+	if (_handle != INVALID_HANDLE_VALUE)
+		CloseHandle(_handle);
+	_handle = INVALID_HANDLE_VALUE;
+}
+
+bool File::isOpen() const { return _handle != INVALID_HANDLE_VALUE; }
+
+size_t File::readAt(uint64_t offset, void* buffer, size_t size) const
+{
+	size_t total = 0;
+	while (total < size)
+	{
+		OVERLAPPED ov{};
+		uint64_t pos = offset + total;
+		ov.Offset = static_cast<DWORD>(pos);
+		ov.OffsetHigh = static_cast<DWORD>(pos >> 32);
+		DWORD chunk = static_cast<DWORD>(std::min<size_t>(size - total, 1u << 30)), read = 0;
+		if (!ReadFile(_handle, static_cast<uint8_t*>(buffer) + total, chunk, &read, &ov) || read == 0)
+			break;
+		total += read;
+	}
+	return total;
+}
+
+size_t File::writeAt(uint64_t offset, const void* buffer, size_t size)
+{
+	size_t total = 0;
+	while (total < size)
+	{
+		OVERLAPPED ov{};
+		uint64_t pos = offset + total;
+		ov.Offset = static_cast<DWORD>(pos);
+		ov.OffsetHigh = static_cast<DWORD>(pos >> 32);
+		DWORD chunk = static_cast<DWORD>(std::min<size_t>(size - total, 1u << 30)), written = 0;
+		if (!WriteFile(_handle, static_cast<const uint8_t*>(buffer) + total, chunk, &written, &ov) || written == 0)
+			break;
+		total += written;
+	}
+	return total;
+}
+
+uint64_t File::size() const
+{
+	LARGE_INTEGER size;
+	return GetFileSizeEx(_handle, &size) ? static_cast<uint64_t>(size.QuadPart) : 0;
+}
+
+bool File::resize(uint64_t size)
+{
+	LARGE_INTEGER pos;
+	pos.QuadPart = static_cast<LONGLONG>(size);
+	return SetFilePointerEx(_handle, pos, nullptr, FILE_BEGIN) && SetEndOfFile(_handle);
+}
+
+bool File::sync() { return FlushFileBuffers(_handle) != 0; }
+
+void File::dropCache() {}
+
+bool File::exists(const std::string& path) { return GetFileAttributesA(path.c_str()) != INVALID_FILE_ATTRIBUTES; }
+bool File::remove(const std::string& path) { return DeleteFileA(path.c_str()) != 0; }
+bool File::rename(const std::string& from, const std::string& to) { return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0; }
+bool File::createDirectory(const std::string& path) { return CreateDirectoryA(path.c_str(), nullptr) || GetLastError() == ERROR_ALREADY_EXISTS; }
+
+
+
+MappedFile::MappedFile() :
+	_data{ nullptr },
+	_size{ 0 },
+	_mapping{ nullptr }
+{}
+
+MappedFile::MappedFile(MappedFile&& m) noexcept :
+	_data{ m._data },
+	_size{ m._size },
+	_mapping{ m._mapping }
+{
+	m._data = nullptr;
+	m._size = 0;
+	m._mapping = nullptr;
+}
+
+MappedFile& MappedFile::operator= (MappedFile&& m) noexcept
+{
+	std::swap(_data, m._data);
+	std::swap(_size, m._size);
+	std::swap(_mapping, m._mapping);
+	return *this;
+}
+
+bool MappedFile::map(const File& file, size_t size)
+{
+	unmap();
+	if (size == 0)
+		size = static_cast<size_t>(file.size());
+	if (size == 0)
+		return false;
+
+	uint64_t max = size;
+	_mapping = CreateFileMappingA(file.nativeHandle(), nullptr, PAGE_READONLY, static_cast<DWORD>(max >> 32), static_cast<DWORD>(max), nullptr);
+	if (!_mapping)
+		return false;
+
+	_data = static_cast<const uint8_t*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, size));
+	if (!_data)
+	{
+		CloseHandle(_mapping);
+		_mapping = nullptr;
+		return false;
+	}
+	_size = size;
+	return true;
+}
+
+void MappedFile::unmap()
+{
+	if (_data)
+		UnmapViewOfFile(_data);
+	if (_mapping)
+		CloseHandle(_mapping);
+	_data = nullptr;
+	_mapping = nullptr;
+	_size = 0;
+}
+
+#else
+
+File::File() :
+	_fd{ -1 }
+{}
+
+File::File(File&& f) noexcept :
+	_fd{ f._fd }
+{
+	f._fd = -1;
+}
+
+File& File::operator= (File&& f) noexcept
+{
+	std::swap(_fd, f._fd);
+	return *this;
+}
+
+bool File::open(const std::string& path, Mode mode)
+{
+	close();
+	int flags = mode == Mode::Read ? O_RDONLY : O_RDWR;
+	if (mode == Mode::Create)
+		flags |= O_CREAT;
+	_fd = ::open(path.c_str(), flags | O_CLOEXEC, 0644);
+	return _fd >= 0;
+}
+
+void File::close()
+{
+	if (_fd >= 0)
+		::close(_fd);
+	_fd = -1;
+}
+
+bool File::isOpen() const { return _fd >= 0; }
+
+size_t File::readAt(uint64_t offset, void* buffer, size_t size) const
+{
+	size_t total = 0;
+	while (total < size)
+	{
+		ssize_t read = ::pread(_fd, static_cast<uint8_t*>(buffer) + total, size - total, static_cast<off_t>(offset + total));
+		if (read <= 0)
+			break;
+		total += static_cast<size_t>(read);
+	}
+	return total;
+}
+
+size_t File::writeAt(uint64_t offset, const void* buffer, size_t size)
+{
+	size_t total = 0;
+	while (total < size)
+	{
+		ssize_t written = ::pwrite(_fd, static_cast<const uint8_t*>(buffer) + total, size - total, static_cast<off_t>(offset + total));
+		if (written <= 0)
+			break;
+		total += static_cast<size_t>(written);
+	}
+	return total;
+}
+
+uint64_t File::size() const
+{
+	struct stat st;
+	return ::fstat(_fd, &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+}
+
+bool File::resize(uint64_t size) { return ::ftruncate(_fd, static_cast<off_t>(size)) == 0; }
+
+bool File::sync()
+{
+#ifdef __linux__
+	return ::fdatasync(_fd) == 0;
+#else
+	return ::fsync(_fd) == 0;
+#endif
+}
+
+void File::dropCache()
+{
+#ifdef POSIX_FADV_DONTNEED
+	::posix_fadvise(_fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+}
+
+bool File::exists(const std::string& path)
+{
+	struct stat st;
+	return ::stat(path.c_str(), &st) == 0;
+}
+
+bool File::remove(const std::string& path) { return ::unlink(path.c_str()) == 0; }
+bool File::rename(const std::string& from, const std::string& to) { return ::rename(from.c_str(), to.c_str()) == 0; }
+bool File::createDirectory(const std::string& path) { return ::mkdir(path.c_str(), 0755) == 0 || exists(path); }
+
+
+
+MappedFile::MappedFile() :
+	_data{ nullptr },
+	_size{ 0 }
+{}
+
+MappedFile::MappedFile(MappedFile&& m) noexcept :
+	_data{ m._data },
+	_size{ m._size }
+{
+	m._data = nullptr;
+	m._size = 0;
+}
+
+MappedFile& MappedFile::operator= (MappedFile&& m) noexcept
+{
+	std::swap(_data, m._data);
+	std::swap(_size, m._size);
+	return *this;
+}
+
+bool MappedFile::map(const File& file, size_t size)
+{
+	unmap();
+	if (size == 0)
+		size = static_cast<size_t>(file.size());
+	if (size == 0)
+		return false;
+
+	void* data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, file.nativeHandle(), 0);
+	if (data == MAP_FAILED)
+		return false;
+
+	_data = static_cast<const uint8_t*>(data);
+	_size = size;
+	return true;
+}
+
+void MappedFile::unmap()
+{
+	if (_data)
+		::munmap(const_cast<uint8_t*>(_data), _size);
+	_data = nullptr;
+	_size = 0;
+}
+
+#endif
+
+File::~File() { close(); }
+
+MappedFile::~MappedFile() { unmap(); }
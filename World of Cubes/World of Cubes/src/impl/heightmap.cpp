@@ -0,0 +1,143 @@
+#include "engine/heightmap.h"
+
+#include <algorithm>
+
+#include "engine/block_registry.h"
+
+Heightmaps::Heightmaps(const BlockRegistry& registry) :
+	_tables{ registry.opaqueTable(), registry.solidTable() },
+	_columns{}
+{}
+
+void Heightmaps::addChunk(const Chunk& chunk)
+{
+	const vec3i& coords = chunk.getCoords();
+	auto inserted = _columns.try_emplace(columnKey(coords.x, coords.z));
+	Column& column = inserted.first->second;
+	if (inserted.second)
+		for (auto& heights : column.height)
+			std::fill(heights, heights + Chunk::AREA, NONE);
+
+	ChunkTops& tops = column.chunks[coords.y];
+	for (auto& top : tops.top)
+		std::fill(top, top + Chunk::AREA, static_cast<int8_t>(-1));
+
+	// Top down, one layer at a time, skipping sections that are all air
+	size_t missing = HEIGHTMAP_TYPE_COUNT * Chunk::AREA;
+	for (int32_t y = Chunk::MASK; y >= 0 && missing > 0; --y)
+	{
+		for (int32_t z = 0; z < Chunk::SIZE; z += ChunkSection::SIZE)
+			for (int32_t x = 0; x < Chunk::SIZE; x += ChunkSection::SIZE)
+			{
+				const ChunkSection* section = chunk.getSection(Chunk::sectionIndex(x, y, z));
+				if (!section)
+					continue;
+
+				for (int32_t dz = 0; dz < ChunkSection::SIZE; ++dz)
+					for (int32_t dx = 0; dx < ChunkSection::SIZE; ++dx)
+					{
+						const BlockId id = section->blocks[ChunkSection::index(dx, y, dz)];
+						const size_t index = columnIndex(x + dx, z + dz);
+						for (size_t type = 0; type < HEIGHTMAP_TYPE_COUNT; ++type)
+							if (tops.top[type][index] < 0 && _tables[type][id])
+							{
+								tops.top[type][index] = static_cast<int8_t>(y);
+								--missing;
+							}
+					}
+			}
+	}
+
+	const int32_t base = coords.y * Chunk::SIZE;
+	for (size_t type = 0; type < HEIGHTMAP_TYPE_COUNT; ++type)
+		for (size_t i = 0; i < Chunk::AREA; ++i)
+			if (tops.top[type][i] >= 0)
+				column.height[type][i] = std::max(column.height[type][i], base + tops.top[type][i]);
+}
+
+void Heightmaps::removeChunk(const vec3i& coords)
+{
+	auto it = _columns.find(columnKey(coords.x, coords.z));
+	if (it == _columns.end())
+		return;
+
+	Column& column = it->second;
+	auto chunk = column.chunks.find(coords.y);
+	if (chunk == column.chunks.end())
+		return;
+
+	const ChunkTops tops = chunk->second;
+	column.chunks.erase(chunk);
+	if (column.chunks.empty())
+	{
+		_columns.erase(it);
+		return;
+	}
+
+	const int32_t base = coords.y * Chunk::SIZE;
+	for (size_t type = 0; type < HEIGHTMAP_TYPE_COUNT; ++type)
+		for (size_t i = 0; i < Chunk::AREA; ++i)
+			if (tops.top[type][i] >= 0 && column.height[type][i] == base + tops.top[type][i])
+				rescan(column, type, i);
+}
+
+void Heightmaps::update(const Chunk& chunk, const vec3i& local, BlockId previous)
+{
+	const vec3i& coords = chunk.getCoords();
+	auto it = _columns.find(columnKey(coords.x, coords.z));
+	if (it == _columns.end())
+		return;
+
+	Column& column = it->second;
+	auto tops = column.chunks.find(coords.y);
+	if (tops == column.chunks.end())
+		return;
+
+	const BlockId id = chunk.getBlock(local);
+	const size_t index = columnIndex(local.x, local.z);
+	const int32_t base = coords.y * Chunk::SIZE;
+	for (size_t type = 0; type < HEIGHTMAP_TYPE_COUNT; ++type)
+	{
+		const bool was = _tables[type][previous] != 0;
+		const bool is = _tables[type][id] != 0;
+		int8_t& top = tops->second.top[type][index];
+
+		if (is && local.y > top)
+		{
+			top = static_cast<int8_t>(local.y);
+			column.height[type][index] = std::max(column.height[type][index], base + local.y);
+		}
+		else if (was && !is && local.y == top)
+		{
+			int32_t y = local.y - 1;
+			while (y >= 0 && !_tables[type][chunk.getBlock(local.x, y, local.z)])
+				--y;
+			top = static_cast<int8_t>(y);
+
+			if (column.height[type][index] == base + local.y)
+				rescan(column, type, index);
+		}
+	}
+}
+
+int32_t Heightmaps::getHeight(HeightmapType type, int32_t x, int32_t z) const
+{
+	auto it = _columns.find(columnKey(x >> Chunk::SIZE_BITS, z >> Chunk::SIZE_BITS));
+	return it != _columns.end() ? it->second.height[static_cast<size_t>(type)][columnIndex(x, z)] : NONE;
+}
+
+void Heightmaps::clear() { _columns.clear(); }
+
+void Heightmaps::rescan(Column& column, size_t type, size_t index)
+{
+	column.height[type][index] = NONE;
+	for (auto it = column.chunks.rbegin(); it != column.chunks.rend(); ++it)
+	{
+		const int8_t top = it->second.top[type][index];
+		if (top >= 0)
+		{
+			column.height[type][index] = it->first * Chunk::SIZE + top;
+			return;
+		}
+	}
+}
@@ -0,0 +1,151 @@
+#include "engine/journal.h"
+
+#include <cstring>
+#include <iostream>
+
+#include "support/checksum.h"
+
+namespace
+{
+	uint32_t record_checksum(Journal::Record record, const uint8_t* payload)
+	{
+		record.checksum = 0;
+		return checksum::crc32(payload, record.length, checksum::crc32(&record, sizeof(record)));
+	}
+
+	// Walks the intact records from the start, calling back each one if a callback is given,
+	// and returns where the first torn or corrupt one begins
+	size_t scan_records(const std::vector<uint8_t>& data, const Journal::ReplayCallback* callback, size_t& count)
+	{
+		size_t offset = 0;
+		count = 0;
+		while (data.size() - offset >= sizeof(Journal::Record))
+		{
+			Journal::Record record;
+			std::memcpy(&record, data.data() + offset, sizeof(record));
+
+			const uint8_t* payload = data.data() + offset + sizeof(record);
+			if (record.magic != Journal::MAGIC || record.length > data.size() - offset - sizeof(record) ||
+				record.compression >= CHUNK_COMPRESSION_COUNT || record_checksum(record, payload) != record.checksum)
+				break;
+
+			if (callback)
+				(*callback)({ record.x, record.y, record.z }, record.version, static_cast<ChunkCompression>(record.compression), payload, record.length);
+			offset += sizeof(record) + record.length;
+			++count;
+		}
+		return offset;
+	}
+}
+
+Journal::Journal() :
+	_path{},
+	_file{},
+	_buffer{},
+	_size{ 0 }
+{}
+
+bool Journal::open(const std::string& path)
+{
+	_path = path;
+	_buffer.clear();
+	if (!_file.open(path, File::Mode::Create))
+	{
+		std::cerr << "Journal error: cannot open " << path << std::endl;
+		return false;
+	}
+
+	// Appends must follow the last intact record: replay stops at the first bad one, so records
+	// written after a torn tail would be lost on the next recovery
+	std::vector<uint8_t> data(static_cast<size_t>(_file.size()));
+	if (_file.readAt(0, data.data(), data.size()) != data.size())
+	{
+		std::cerr << "Journal error: cannot read " << path << std::endl;
+		_file.close();
+		return false;
+	}
+
+	size_t count;
+	_size = scan_records(data, nullptr, count);
+	if (_size != data.size())
+	{
+		std::cerr << "Journal warning: truncated " << data.size() - _size << " torn bytes at the end of " << path << std::endl;
+		if (!_file.resize(_size) || !_file.sync())
+		{
+			std::cerr << "Journal error: cannot truncate " << path << std::endl;
+			_file.close();
+			return false;
+		}
+	}
+	return true;
+}
+
+void Journal::close()
+{
+	_file.close();
+	_buffer.clear();
+	_size = 0;
+}
+
+void Journal::append(const vec3i& coords, uint64_t version, ChunkCompression compression, const uint8_t* payload, size_t size)
+{
+	Record record{};
+	record.magic = MAGIC;
+	record.length = static_cast<uint32_t>(size);
+	record.x = coords.x;
+	record.y = coords.y;
+	record.z = coords.z;
+	record.version = version;
+	record.compression = static_cast<uint8_t>(compression);
+	record.checksum = record_checksum(record, payload);
+
+	const uint8_t* header = reinterpret_cast<const uint8_t*>(&record);
+	_buffer.insert(_buffer.end(), header, header + sizeof(record));
+	_buffer.insert(_buffer.end(), payload, payload + size);
+}
+
+bool Journal::commit()
+{
+	if (_buffer.empty())
+		return true;
+
+	if (_file.writeAt(_size, _buffer.data(), _buffer.size()) != _buffer.size() || !_file.sync())
+	{
+		std::cerr << "Journal error: cannot write to " << _path << std::endl;
+		return false;
+	}
+
+	_size += _buffer.size();
+	_buffer.clear();
+	return true;
+}
+
+size_t Journal::replay(const ReplayCallback& callback)
+{
+	std::vector<uint8_t> data(static_cast<size_t>(_file.size()));
+	if (_file.readAt(0, data.data(), data.size()) != data.size())
+	{
+		std::cerr << "Journal error: cannot read " << _path << std::endl;
+		return 0;
+	}
+
+	size_t count;
+	const size_t offset = scan_records(data, &callback, count);
+	if (offset != data.size())
+		std::cerr << "Journal warning: discarded " << data.size() - offset << " torn bytes at the end of " << _path << std::endl;
+
+	return count;
+}
+
+bool Journal::reset()
+{
+	_buffer.clear();
+	if (!_file.resize(0) || !_file.sync())
+	{
+		std::cerr << "Journal error: cannot truncate " << _path << std::endl;
+		return false;
+	}
+
+	_size = 0;
+	return true;
+}
@@ -0,0 +1,221 @@
+#include "engine/lod_mesher.h"
+
+namespace
+{
+	constexpr int32_t SIZE = Chunk::SIZE;
+
+	// Block at chunk-local coordinates, taken from the neighbor for coordinates outside the chunk
+	inline BlockId block_at(const ChunkNeighborhood& input, int32_t x, int32_t y, int32_t z)
+	{
+		auto side = [](int32_t c) { return c < 0 ? -1 : c >= SIZE ? 1 : 0; };
+		return input.chunks[ChunkNeighborhood::index(side(x), side(y), side(z))].getBlock(x & Chunk::MASK, y & Chunk::MASK, z & Chunk::MASK);
+	}
+}
+
+LodMesher::LodMesher(const BlockRegistry& registry) :
+	_registry{ registry },
+	_cells{},
+	_counts(registry.size(), 0),
+	_voted{},
+	_faces{},
+	_cellCount{ 0 }
+{}
+
+void LodMesher::build(const ChunkNeighborhood& input, int32_t level, uint8_t skirts, ChunkMesh& mesh)
+{
+	mesh.clear();
+	mesh.coords = input.center().getCoords();
+	mesh.version = input.center().getVersion();
+	mesh.section = ChunkMesh::WHOLE_CHUNK;
+	mesh.level = level;
+
+	bool empty = true;
+	for (int32_t i = 0; i < Chunk::SECTION_COUNT && empty; ++i)
+		empty = input.center().getSection(i) == nullptr;
+	if (empty)
+		return;
+
+	downsample(input, level);
+	for (size_t f = 0; f < BLOCK_FACE_COUNT; ++f)
+	{
+		mesh.faceStart[f] = static_cast<uint32_t>(mesh.quads.size());
+		const bool skirt = (skirts >> f & 1) != 0;
+		meshFace(static_cast<BlockFace>(f), level, skirt, mesh);
+		if (skirt)
+			meshSkirt(input, static_cast<BlockFace>(f), level, mesh);
+	}
+	mesh.faceStart[BLOCK_FACE_COUNT] = static_cast<uint32_t>(mesh.quads.size());
+}
+
+int32_t LodMesher::levelForDistance(int32_t distance, int32_t fullRadius)
+{
+	int32_t level = 0;
+	while (level < MAX_LEVEL && distance > (fullRadius << level))
+		++level;
+	return level;
+}
+
+uint8_t LodMesher::skirtSides(const vec3i& coords, const vec3i& center, int32_t fullRadius)
+{
+	const int32_t level = levelForDistance(distance(coords, center), fullRadius);
+
+	uint8_t sides = 0;
+	for (size_t f = 0; f < BLOCK_FACE_COUNT; ++f)
+	{
+		const vec3i& offset = block_face::OFFSETS[f];
+		const vec3i neighbor{ coords.x + offset.x, coords.y + offset.y, coords.z + offset.z };
+		if (levelForDistance(distance(neighbor, center), fullRadius) < level)
+			sides |= static_cast<uint8_t>(1u << f);
+	}
+	return sides;
+}
+
+void LodMesher::downsample(const ChunkNeighborhood& input, int32_t level)
+{
+	const int32_t size = 1 << level;
+	_cellCount = SIZE >> level;
+	_cells.assign(static_cast<size_t>(_cellCount + 2) * (_cellCount + 2) * (_cellCount + 2), blocks::AIR);
+
+	// The chunk and the layer of cells around it that shares a face with it; culling needs nothing else
+	for (int32_t y = -1; y <= _cellCount; ++y)
+		for (int32_t z = -1; z <= _cellCount; ++z)
+			for (int32_t x = -1; x <= _cellCount; ++x)
+			{
+				const int32_t outside = (x < 0 || x >= _cellCount) + (y < 0 || y >= _cellCount) + (z < 0 || z >= _cellCount);
+				if (outside <= 1)
+					_cells[cellIndex(x, y, z)] = vote(input, { x * size, y * size, z * size }, size);
+			}
+}
+
+BlockId LodMesher::vote(const ChunkNeighborhood& input, const vec3i& from, int32_t size)
+{
+	// Cells up to a section in size lie in one section, often missing
+	if (size <= ChunkSection::SIZE)
+	{
+		auto side = [](int32_t c) { return c < 0 ? -1 : c >= SIZE ? 1 : 0; };
+		const ChunkSnapshot& chunk = input.chunks[ChunkNeighborhood::index(side(from.x), side(from.y), side(from.z))];
+		const ChunkSection* section = chunk.getSection(Chunk::sectionIndex(from.x & Chunk::MASK, from.y & Chunk::MASK, from.z & Chunk::MASK));
+		if (!section)
+			return blocks::AIR;
+		return vote(from, size, [section](int32_t x, int32_t y, int32_t z) { return section->blocks[ChunkSection::index(x, y, z)]; });
+	}
+
+	return vote(from, size, [&input](int32_t x, int32_t y, int32_t z) { return block_at(input, x, y, z); });
+}
+
+void LodMesher::meshFace(BlockFace face, int32_t level, bool skirt, ChunkMesh& mesh)
+{
+	const int32_t axis = static_cast<int32_t>(face) / 2;
+	const int32_t step = (static_cast<int32_t>(face) & 1) != 0 ? 1 : -1;
+	const int32_t count = _cellCount;
+	const uint8_t* opaque = _registry.opaqueTable();
+	const uint8_t* emission = _registry.lightEmissionTable();
+	const TextureId* textures = _registry.textureTable();
+	const uint8_t ao[4] = { voxel_vertex::MAX_AO, voxel_vertex::MAX_AO, voxel_vertex::MAX_AO, voxel_vertex::MAX_AO };
+	const uint8_t sky[4] = { voxel_vertex::MAX_LIGHT, voxel_vertex::MAX_LIGHT, voxel_vertex::MAX_LIGHT, voxel_vertex::MAX_LIGHT };
+
+	_faces.resize(static_cast<size_t>(count) * count);
+	for (int32_t layer = 0; layer < count; ++layer)
+	{
+		// Same culling as full detail, skirts seeing air past the side
+		const bool closed = skirt && (layer + step < 0 || layer + step >= count);
+		for (int32_t v = 0; v < count; ++v)
+			for (int32_t u = 0; u < count; ++u)
+			{
+				const vec3i p = block_face::cell_position(axis, layer, u, v);
+				const vec3i q = block_face::cell_position(axis, layer + step, u, v);
+				const BlockId id = _cells[cellIndex(p.x, p.y, p.z)];
+				const BlockId neighbor = closed ? blocks::AIR : _cells[cellIndex(q.x, q.y, q.z)];
+				_faces[v * count + u] = id == blocks::AIR || opaque[neighbor] || neighbor == id ? blocks::AIR : id;
+			}
+
+		// Greedy merge of the same block, cells being few enough to go one at a time
+		for (int32_t v = 0; v < count; ++v)
+			for (int32_t u = 0; u < count; ++u)
+			{
+				const BlockId id = _faces[v * count + u];
+				if (id == blocks::AIR)
+					continue;
+
+				int32_t width = 1;
+				while (u + width < count && _faces[v * count + u + width] == id)
+					++width;
+
+				int32_t height = 1;
+				for (; v + height < count; ++height)
+				{
+					const BlockId* row = _faces.data() + (v + height) * count + u;
+					int32_t k = 0;
+					while (k < width && row[k] == id)
+						++k;
+					if (k < width)
+						break;
+				}
+
+				for (int32_t k = 0; k < height; ++k)
+					std::fill_n(_faces.begin() + (v + k) * count + u, width, blocks::AIR);
+
+				// Quads give the block a face belongs to: the last one of the cell for positive faces
+				const vec3i p = block_face::cell_position(axis, step > 0 ? ((layer + 1) << level) - 1 : layer << level, u << level, v << level);
+				mesh.quads.push_back({
+					static_cast<uint8_t>(p.x), static_cast<uint8_t>(p.y), static_cast<uint8_t>(p.z),
+					static_cast<uint8_t>(width << level), static_cast<uint8_t>(height << level),
+					face, id, textures[id * BLOCK_FACE_COUNT + static_cast<size_t>(face)]
+				});
+
+				const uint8_t light[4] = { emission[id], emission[id], emission[id], emission[id] };
+				voxel_vertex::emitQuad(mesh.quads.back(), ao, sky, light, mesh.vertices);
+			}
+	}
+}
+
+void LodMesher::meshSkirt(const ChunkNeighborhood& input, BlockFace face, int32_t level, ChunkMesh& mesh)
+{
+	const int32_t axis = static_cast<int32_t>(face) / 2;
+	const bool positive = (static_cast<int32_t>(face) & 1) != 0;
+	const int32_t size = 1 << level;
+	const int32_t layer = positive ? _cellCount - 1 : 0;
+	const int32_t blockLayer = positive ? SIZE - 1 : 0;
+	const uint8_t* opaque = _registry.opaqueTable();
+	const uint8_t* emission = _registry.lightEmissionTable();
+	const TextureId* textures = _registry.textureTable();
+	const uint8_t ao[4] = { voxel_vertex::MAX_AO, voxel_vertex::MAX_AO, voxel_vertex::MAX_AO, voxel_vertex::MAX_AO };
+	const uint8_t sky[4] = { voxel_vertex::MAX_LIGHT, voxel_vertex::MAX_LIGHT, voxel_vertex::MAX_LIGHT, voxel_vertex::MAX_LIGHT };
+
+	// The finer neighbor culls its faces against the real blocks of this side: where the vote
+	// emptied a border cell, hang a skirt from its highest opaque block down to the cell bottom
+	// (v is y on the side faces), the whole cell on the top and bottom ones
+	for (int32_t v = 0; v < _cellCount; ++v)
+		for (int32_t u = 0; u < _cellCount; ++u)
+		{
+			const vec3i p = block_face::cell_position(axis, layer, u, v);
+			if (_cells[cellIndex(p.x, p.y, p.z)] != blocks::AIR)
+				continue;
+
+			BlockId id = blocks::AIR;
+			int32_t height = 0;
+			for (int32_t j = size - 1; j >= 0 && id == blocks::AIR; --j)
+				for (int32_t i = 0; i < size && id == blocks::AIR; ++i)
+				{
+					const vec3i b = block_face::cell_position(axis, blockLayer, (u << level) + i, (v << level) + j);
+					const BlockId block = block_at(input, b.x, b.y, b.z);
+					if (opaque[block])
+					{
+						id = block;
+						height = axis == 1 ? size : j + 1;
+					}
+				}
+			if (id == blocks::AIR)
+				continue;
+
+			const vec3i b = block_face::cell_position(axis, blockLayer, u << level, v << level);
+			mesh.quads.push_back({
+				static_cast<uint8_t>(b.x), static_cast<uint8_t>(b.y), static_cast<uint8_t>(b.z),
+				static_cast<uint8_t>(size), static_cast<uint8_t>(height),
+				face, id, textures[id * BLOCK_FACE_COUNT + static_cast<size_t>(face)]
+			});
+
+			const uint8_t light[4] = { emission[id], emission[id], emission[id], emission[id] };
+			voxel_vertex::emitQuad(mesh.quads.back(), ao, sky, light, mesh.vertices);
+		}
+}
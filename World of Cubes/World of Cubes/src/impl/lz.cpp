@@ -0,0 +1,138 @@
+#include "support/lz.h"
+
+#include <cstring>
+
+namespace
+{
+	constexpr size_t MIN_MATCH = 4;
+	constexpr size_t MAX_OFFSET = 0xffff;
+	constexpr uint32_t HASH_BITS = 12;
+
+	inline uint32_t read32(const uint8_t* data)
+	{
+		uint32_t value;
+		std::memcpy(&value, data, sizeof(value));
+		return value;
+	}
+
+	inline uint32_t hash(uint32_t value) { return (value * 2654435761u) >> (32 - HASH_BITS); }
+
+	inline void put_length(std::vector<uint8_t>& out, size_t length)
+	{
+		for (; length >= 255; length -= 255)
+			out.push_back(255);
+		out.push_back(static_cast<uint8_t>(length));
+	}
+
+	inline bool get_length(const uint8_t*& data, const uint8_t* end, size_t& length)
+	{
+		uint8_t byte;
+		do
+		{
+			if (data == end)
+				return false;
+			byte = *data++;
+			length += byte;
+		} while (byte == 255);
+		return true;
+	}
+
+	void put_sequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t literalCount, size_t offset, size_t matchLength)
+	{
+		const size_t extraMatch = matchLength ? matchLength - MIN_MATCH : 0;
+		out.push_back(static_cast<uint8_t>(((literalCount < 15 ? literalCount : 15) << 4) | (extraMatch < 15 ? extraMatch : 15)));
+		if (literalCount >= 15)
+			put_length(out, literalCount - 15);
+		out.insert(out.end(), literals, literals + literalCount);
+
+		if (matchLength)
+		{
+			out.push_back(static_cast<uint8_t>(offset));
+			out.push_back(static_cast<uint8_t>(offset >> 8));
+			if (extraMatch >= 15)
+				put_length(out, extraMatch - 15);
+		}
+	}
+}
+
+size_t lz::compress(const uint8_t* data, size_t size, std::vector<uint8_t>& out)
+{
+	const size_t start = out.size();
+	int32_t table[1 << HASH_BITS];
+	std::memset(table, 0xff, sizeof(table));
+
+	size_t anchor = 0;
+	size_t i = 0;
+	while (i + MIN_MATCH <= size)
+	{
+		const uint32_t value = read32(data + i);
+		const uint32_t h = hash(value);
+		const int32_t candidate = table[h];
+		table[h] = static_cast<int32_t>(i);
+
+		if (candidate < 0 || i - candidate > MAX_OFFSET || read32(data + candidate) != value)
+		{
+			++i;
+			continue;
+		}
+
+		size_t length = MIN_MATCH;
+		while (i + length < size && data[candidate + length] == data[i + length])
+			++length;
+
+		put_sequence(out, data + anchor, i - anchor, i - candidate, length);
+		i += length;
+		anchor = i;
+	}
+
+	// The last sequence only carries literals
+	put_sequence(out, data + anchor, size - anchor, 0, 0);
+	return out.size() - start;
+}
+
+bool lz::decompress(const uint8_t* data, size_t size, uint8_t* out, size_t outSize)
+{
+	const uint8_t* end = data + size;
+	uint8_t* dst = out;
+	uint8_t* const dstEnd = out + outSize;
+
+	while (data < end)
+	{
+		const uint8_t token = *data++;
+
+		size_t literals = token >> 4;
+		if (literals == 15 && !get_length(data, end, literals))
+			return false;
+		if (static_cast<size_t>(end - data) < literals || static_cast<size_t>(dstEnd - dst) < literals)
+			return false;
+		std::memcpy(dst, data, literals);
+		data += literals;
+		dst += literals;
+
+		if (data == end)
+			break;
+
+		if (end - data < 2)
+			return false;
+		const size_t offset = static_cast<size_t>(data[0] | (data[1] << 8));
+		data += 2;
+
+		size_t length = token & 0xf;
+		if (length == 15 && !get_length(data, end, length))
+			return false;
+		length += MIN_MATCH;
+
+		if (offset == 0 || offset > static_cast<size_t>(dst - out) || static_cast<size_t>(dstEnd - dst) < length)
+			return false;
+
+		// Overlapping copies repeat the last offset bytes, so they cannot use memcpy
+		const uint8_t* src = dst - offset;
+		if (offset >= length)
+			std::memcpy(dst, src, length);
+		else for (size_t k = 0; k < length; ++k)
+			dst[k] = src[k];
+		dst += length;
+	}
+
+	return dst == dstEnd;
+}
@@ -1,15 +1,28 @@
 #include <iostream>
+#include <string>
+#include <vector>
 
 #include "support/vectors.h"
 #include "support/matrix44.h"
 #include "support/color.h"
 #include "support/SDL.h"
+#include "engine/benchmarks.h"
 
 #include <sfml/Graphics/Shader.hpp>
 
 
 int main(int argc, char** argv)
 {
+	if (argc >= 2 && std::string{ argv[1] } == "--bench")
+	{
+		if (argc < 3)
+		{
+			bench::list();
+			return 0;
+		}
+		return bench::run(argv[2], std::vector<std::string>{ argv + 3, argv + argc }) ? 0 : 1;
+	}
+
 	vec2 v0;
 	vec2u v1;
 
@@ -0,0 +1,277 @@
+#include "engine/mesh_pipeline.h"
+
+#include <algorithm>
+
+#include "engine/world.h"
+#include "engine/heightmap.h"
+#include "support/clock.h"
+
+MeshPipeline::MeshPipeline(const BlockRegistry& registry, uint32_t workers) :
+	_registry{ registry },
+	_upload{},
+	_remove{},
+	_workers{},
+	_jobLock{},
+	_jobReady{},
+	_jobs{},
+	_stopping{ false },
+	_finished{},
+	_pending{},
+	_meshes{},
+	_ready{},
+	_freeMeshes{},
+	_jobCount{ 0 },
+	_meshCount{ 0 },
+	_clock{},
+	_stats{}
+{
+	for (uint32_t i = 0; i < std::max(1u, workers); ++i)
+		_workers.emplace_back(&MeshPipeline::work, this);
+}
+
+MeshPipeline::~MeshPipeline()
+{
+	{
+		std::lock_guard<std::mutex> lock{ _jobLock };
+		_stopping = true;
+	}
+	_jobReady.notify_all();
+	for (std::thread& worker : _workers)
+		worker.join();
+
+	// Every job is now either still queued, finished or ready
+	for (Job* job : _jobs)
+		recycle(job);
+	collect();
+	for (Job* job : _ready)
+		recycle(job);
+
+	for (auto& meshes : _meshes)
+		for (ChunkMesh* mesh : meshes.second.sections)
+			delete mesh;
+	for (ChunkMesh* mesh : _freeMeshes)
+		delete mesh;
+}
+
+void MeshPipeline::request(const World& world, const vec3i& coords, uint32_t sections)
+{
+	if (!world.getChunk(coords) || !sections)
+		return;
+
+	Job* job = new Job;
+	job->coords = coords;
+	job->sections = sections;
+	ChunkNeighborhood::gather(world, coords, job->input);
+	job->requested = _clock.getElapsedTime();
+	job->cancelled.store(false, std::memory_order_relaxed);
+
+	// The new job replaces the pending one, so it also rebuilds its sections
+	Job*& pending = _pending[ChunkMap<Chunk>::pack(coords)];
+	if (pending)
+	{
+		pending->cancelled.store(true, std::memory_order_release);
+		job->sections |= pending->sections;
+		job->requested = std::min(job->requested, pending->requested);
+		++_stats.cancelled;
+	}
+	pending = job;
+
+	for (int32_t i = 0; i < Chunk::SECTION_COUNT; ++i)
+		job->meshes[i] = (job->sections >> i & 1) ? takeMesh() : nullptr;
+	++_jobCount;
+	++_stats.requested;
+
+	{
+		std::lock_guard<std::mutex> lock{ _jobLock };
+		_jobs.push_back(job);
+	}
+	_jobReady.notify_one();
+}
+
+void MeshPipeline::requestBlock(const World& world, const vec3i& position, int32_t previousHeight)
+{
+	std::vector<std::pair<vec3i, uint32_t>> chunks;
+	auto mark = [&chunks](const vec3i& block) {
+		const vec3i coords = Chunk::chunkCoords(block);
+		const vec3i local = Chunk::localCoords(block);
+		const uint32_t section = 1u << Chunk::sectionIndex(local.x, local.y, local.z);
+		for (auto& chunk : chunks)
+			if (chunk.first.x == coords.x && chunk.first.y == coords.y && chunk.first.z == coords.z)
+			{
+				chunk.second |= section;
+				return;
+			}
+		chunks.emplace_back(coords, section);
+	};
+
+	// A section mesh depends on its blocks and the ones around them, AO reaching over edges and
+	// corners: the block changes the sections of itself and of its 26 neighbors
+	for (int32_t dy = -1; dy <= 1; ++dy)
+		for (int32_t dz = -1; dz <= 1; ++dz)
+			for (int32_t dx = -1; dx <= 1; ++dx)
+				mark({ position.x + dx, position.y + dy, position.z + dz });
+
+	// The block was or became the top of its column: it shades or lights the blocks down to the
+	// other top, in the column and the ones around it, as far down as chunks are loaded
+	const int32_t height = world.getHeight(HeightmapType::Opaque, position.x, position.z);
+	if (world.getHeightmaps() && height != previousHeight)
+	{
+		const int32_t bottom = std::min(height, previousHeight);
+		for (int32_t dz = -1; dz <= 1; ++dz)
+			for (int32_t dx = -1; dx <= 1; ++dx)
+				for (int32_t y = position.y; y >= bottom; y = (y & ~(ChunkSection::SIZE - 1)) - 1)
+				{
+					const vec3i block{ position.x + dx, y, position.z + dz };
+					if (!world.getChunk(Chunk::chunkCoords(block)))
+						break;
+					mark(block);
+				}
+	}
+
+	for (const auto& chunk : chunks)
+		request(world, chunk.first, chunk.second);
+}
+
+void MeshPipeline::remove(const vec3i& coords)
+{
+	const uint64_t key = ChunkMap<Chunk>::pack(coords);
+
+	auto pending = _pending.find(key);
+	if (pending != _pending.end())
+	{
+		pending->second->cancelled.store(true, std::memory_order_release);
+		++_stats.cancelled;
+		_pending.erase(pending);
+	}
+
+	auto meshes = _meshes.find(key);
+	if (meshes != _meshes.end())
+	{
+		for (ChunkMesh* mesh : meshes->second.sections)
+			if (mesh)
+			{
+				_freeMeshes.push_back(mesh);
+				--_meshCount;
+			}
+		_meshes.erase(meshes);
+		if (_remove)
+			_remove(coords);
+	}
+}
+
+void MeshPipeline::update(const MeshBudget& budget)
+{
+	_stats.applied = _stats.uploadedSections = _stats.uploadedQuads = 0;
+	_stats.latency = Time{};
+	collect();
+
+	Clock clock;
+	while (!_ready.empty() && _stats.uploadedQuads < budget.quads && clock.getElapsedTime() < budget.time)
+	{
+		Job* job = _ready.front();
+		_ready.pop_front();
+
+		// Cancelled while it was waiting for its upload slot
+		if (job->cancelled.load(std::memory_order_acquire))
+		{
+			recycle(job);
+			continue;
+		}
+
+		const uint64_t key = ChunkMap<Chunk>::pack(job->coords);
+		_pending.erase(key);
+
+		// The previous meshes, if any, go back to the pool with the job
+		SectionMeshes& meshes = _meshes.emplace(key, SectionMeshes{}).first->second;
+		for (int32_t i = 0; i < Chunk::SECTION_COUNT; ++i)
+		{
+			if (!job->meshes[i])
+				continue;
+
+			ChunkMesh*& current = meshes.sections[i];
+			if (!current)
+				++_meshCount;
+			std::swap(current, job->meshes[i]);
+
+			if (_upload)
+				_upload(*current);
+			_stats.uploadedQuads += current->quads.size();
+			++_stats.uploadedSections;
+		}
+
+		_stats.latency = std::max(_stats.latency, _clock.getElapsedTime() - job->requested);
+		recycle(job);
+		++_stats.applied;
+	}
+
+	_stats.ready = _ready.size();
+	_stats.queued = _jobCount - _ready.size();
+	_stats.meshes = _meshCount;
+}
+
+const ChunkMesh* MeshPipeline::getMesh(const vec3i& coords, int32_t section) const
+{
+	auto it = _meshes.find(ChunkMap<Chunk>::pack(coords));
+	return it != _meshes.end() ? it->second.sections[section] : nullptr;
+}
+
+ChunkMesh* MeshPipeline::takeMesh()
+{
+	if (_freeMeshes.empty())
+		return new ChunkMesh{};
+
+	ChunkMesh* mesh = _freeMeshes.back();
+	_freeMeshes.pop_back();
+	return mesh;
+}
+
+void MeshPipeline::collect()
+{
+	Job* job;
+	while (_finished.pop(job))
+	{
+		if (job->cancelled.load(std::memory_order_acquire))
+			recycle(job);
+		else _ready.push_back(job);
+	}
+}
+
+void MeshPipeline::recycle(Job* job)
+{
+	for (ChunkMesh* mesh : job->meshes)
+		if (mesh)
+			_freeMeshes.push_back(mesh);
+	delete job;
+	--_jobCount;
+}
+
+void MeshPipeline::work()
+{
+	ChunkMesher mesher{ _registry };
+
+	std::unique_lock<std::mutex> lock{ _jobLock };
+	for (;;)
+	{
+		_jobReady.wait(lock, [this]() { return _stopping || !_jobs.empty(); });
+		if (_stopping)
+			return;
+
+		Job* job = _jobs.front();
+		_jobs.pop_front();
+		lock.unlock();
+
+		if (!job->cancelled.load(std::memory_order_acquire))
+		{
+			mesher.prepare(job->input);
+			for (int32_t i = 0; i < Chunk::SECTION_COUNT; ++i)
+				if (job->meshes[i])
+					mesher.buildSection(i, *job->meshes[i]);
+		}
+
+		// Drop the snapshots here rather than on the main thread
+		job->input = ChunkNeighborhood{};
+		_finished.push(job);
+
+		lock.lock();
+	}
+}
@@ -0,0 +1,312 @@
+#include "engine/occlusion_culler.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	inline float box_distance(const vec3f& eye, const vec3f& min, const vec3f& max)
+	{
+		const float dx = std::max(std::max(min.x - eye.x, eye.x - max.x), 0.f);
+		const float dy = std::max(std::max(min.y - eye.y, eye.y - max.y), 0.f);
+		const float dz = std::max(std::max(min.z - eye.z, eye.z - max.z), 0.f);
+		return dx * dx + dy * dy + dz * dz;
+	}
+}
+
+OcclusionCuller::OcclusionCuller(const BlockRegistry& registry, int32_t width, int32_t height, size_t maxOccluders) :
+	_registry{ registry },
+	_width{ (width + TILE_SIZE - 1) / TILE_SIZE * TILE_SIZE },
+	_height{ (height + TILE_SIZE - 1) / TILE_SIZE * TILE_SIZE },
+	_tilesX{ _width / TILE_SIZE },
+	_tilesY{ _height / TILE_SIZE },
+	_maxOccluders{ maxOccluders },
+	_viewProjection{},
+	_viewport{ Matrix4x4::viewport(static_cast<float>(_width), static_cast<float>(_height)) },
+	_eye{},
+	_depths(static_cast<size_t>(_width) * _height, 1.f),
+	_tileDepths(static_cast<size_t>(_tilesX) * _tilesY, 1.f),
+	_nearest{},
+	_stats{},
+	_clock{}
+{}
+
+void OcclusionCuller::cull(const std::vector<const ChunkMesh*>& meshes, const vec3f& eye, const Matrix4x4& viewProjection, std::vector<const ChunkMesh*>& visible)
+{
+	_stats = {};
+	_clock.reset();
+	begin(viewProjection, eye);
+
+	_nearest.clear();
+	for (const ChunkMesh* mesh : meshes)
+	{
+		vec3f min, max;
+		bounds(*mesh, min, max);
+		_nearest.emplace_back(box_distance(eye, min, max), mesh);
+	}
+	const size_t occluders = std::min(_maxOccluders, _nearest.size());
+	std::partial_sort(_nearest.begin(), _nearest.begin() + occluders, _nearest.end(),
+		[](const std::pair<float, const ChunkMesh*>& a, const std::pair<float, const ChunkMesh*>& b) { return a.first < b.first; });
+	for (size_t i = 0; i < occluders; ++i)
+		addOccluder(*_nearest[i].second);
+	updateTiles();
+	_stats.rasterizeTime = _clock.reset();
+
+	for (const ChunkMesh* mesh : meshes)
+	{
+		vec3f min, max;
+		bounds(*mesh, min, max);
+		if (isVisible(min, max))
+			visible.push_back(mesh);
+	}
+	_stats.testTime = _clock.reset();
+}
+
+void OcclusionCuller::begin(const Matrix4x4& viewProjection, const vec3f& eye)
+{
+	_viewProjection = viewProjection;
+	_eye = eye;
+	std::fill(_depths.begin(), _depths.end(), 1.f);
+	std::fill(_tileDepths.begin(), _tileDepths.end(), 1.f);
+}
+
+void OcclusionCuller::addOccluder(const ChunkMesh& mesh)
+{
+	const float originX = static_cast<float>(mesh.coords.x * Chunk::SIZE);
+	const float originY = static_cast<float>(mesh.coords.y * Chunk::SIZE);
+	const float originZ = static_cast<float>(mesh.coords.z * Chunk::SIZE);
+	const float (&m)[4][4] = _viewProjection.mat;
+	const float (&v)[4][4] = _viewport.mat;
+	const uint8_t* opaque = _registry.opaqueTable();
+	const float eye[3] = { _eye.x - originX, _eye.y - originY, _eye.z - originZ };
+	++_stats.occluders;
+
+	for (size_t q = 0; q < mesh.quads.size(); ++q)
+	{
+		const MeshQuad& quad = mesh.quads[q];
+		if (!opaque[quad.block])
+			continue;
+
+		// Faces turned away from the eye, before transforming anything
+		const int32_t face = static_cast<int32_t>(quad.face);
+		const uint8_t position[3] = { quad.x, quad.y, quad.z };
+		const float plane = static_cast<float>(position[face / 2] + (face & 1));
+		if ((face & 1) != 0 ? eye[face / 2] <= plane : eye[face / 2] >= plane)
+			continue;
+
+		// Triangles touching the near plane are left out, occluders need not be complete
+		float sx[4], sy[4], sz[4];
+		bool inFront = true;
+		for (size_t i = 0; i < 4 && inFront; ++i)
+		{
+			const VoxelVertex vertex = voxel_vertex::unpack(mesh.vertices[q * 4 + i]);
+			const float x = originX + vertex.x, y = originY + vertex.y, z = originZ + vertex.z;
+			const float clipZ = x * m[0][2] + y * m[1][2] + z * m[2][2] + m[3][2];
+			const float invW = 1.f / (x * m[0][3] + y * m[1][3] + z * m[2][3] + m[3][3]);
+			const float ndcX = (x * m[0][0] + y * m[1][0] + z * m[2][0] + m[3][0]) * invW;
+			const float ndcY = (x * m[0][1] + y * m[1][1] + z * m[2][1] + m[3][1]) * invW;
+			sx[i] = ndcX * v[0][0] + ndcY * v[1][0] + v[3][0];
+			sy[i] = ndcX * v[0][1] + ndcY * v[1][1] + v[3][1];
+			sz[i] = clipZ * invW;
+			inFront = clipZ >= 0.f;
+		}
+		if (!inFront)
+			continue;
+
+		rasterize({ sx[0], sx[1], sx[2] }, { sy[0], sy[1], sy[2] }, { sz[0], sz[1], sz[2] });
+		rasterize({ sx[0], sx[2], sx[3] }, { sy[0], sy[2], sy[3] }, { sz[0], sz[2], sz[3] });
+	}
+}
+
+void OcclusionCuller::rasterize(const float (&x)[3], const float (&y)[3], const float (&z)[3])
+{
+	// Front faces have a negative area on screen, see SoftwareRasterizer::setup(); vertices 1
+	// and 2 are swapped below for a positive one
+	const float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+	if (!(area < 0.f))
+		return;
+
+	const int32_t minX = static_cast<int32_t>(std::floor(utils::clamp(std::min({ x[0], x[1], x[2] }), 0.f, static_cast<float>(_width))));
+	const int32_t minY = static_cast<int32_t>(std::floor(utils::clamp(std::min({ y[0], y[1], y[2] }), 0.f, static_cast<float>(_height))));
+	const int32_t maxX = std::min(_width - 1, static_cast<int32_t>(std::ceil(utils::clamp(std::max({ x[0], x[1], x[2] }), -1.f, static_cast<float>(_width)))));
+	const int32_t maxY = std::min(_height - 1, static_cast<int32_t>(std::ceil(utils::clamp(std::max({ y[0], y[1], y[2] }), -1.f, static_cast<float>(_height)))));
+	if (minX > maxX || minY > maxY)
+		return;
+	++_stats.occluderTriangles;
+
+	const float sx[3] = { x[0], x[2], x[1] };
+	const float sy[3] = { y[0], y[2], y[1] };
+	float a[3], b[3], c[3];
+	for (size_t i = 0; i < 3; ++i)
+	{
+		const size_t j = (i + 1) % 3, k = (i + 2) % 3;
+		a[i] = sy[j] - sy[k];
+		b[i] = sx[k] - sx[j];
+		c[i] = sx[j] * sy[k] - sx[k] * sy[j];
+	}
+
+	// Depth from vertex 0, as in SoftwareRasterizer
+	const float invArea = -1.f / area;
+	const float z0 = z[0], dz1 = z[2] - z[0], dz2 = z[1] - z[0];
+
+	for (int32_t py = minY; py <= maxY; ++py)
+	{
+		const float centerY = static_cast<float>(py) + 0.5f;
+		const float row[3] = { b[0] * centerY + c[0], b[1] * centerY + c[1], b[2] * centerY + c[2] };
+		float* depths = _depths.data() + static_cast<size_t>(py) * _width;
+
+		for (int32_t px = minX & ~3; px <= maxX; px += 4)
+		{
+#ifdef OCCLUSION_SSE2
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 centerX = _mm_add_ps(_mm_set1_ps(static_cast<float>(px)), _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f));
+			const __m128 e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[0]), centerX), _mm_set1_ps(row[0]));
+			const __m128 e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[1]), centerX), _mm_set1_ps(row[1]));
+			const __m128 e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[2]), centerX), _mm_set1_ps(row[2]));
+			const __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+			if (_mm_movemask_ps(inside) == 0)
+				continue;
+
+			const __m128 l1 = _mm_mul_ps(e1, _mm_set1_ps(invArea)), l2 = _mm_mul_ps(e2, _mm_set1_ps(invArea));
+			const __m128 depth = _mm_add_ps(_mm_set1_ps(z0), _mm_add_ps(_mm_mul_ps(l1, _mm_set1_ps(dz1)), _mm_mul_ps(l2, _mm_set1_ps(dz2))));
+			const __m128 previous = _mm_loadu_ps(depths + px);
+			const __m128 nearest = _mm_min_ps(previous, depth);
+			_mm_storeu_ps(depths + px, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, previous)));
+#else
+			for (int32_t k = 0; k < 4; ++k)
+			{
+				const float centerX = static_cast<float>(px + k) + 0.5f;
+				const float e0 = a[0] * centerX + row[0], e1 = a[1] * centerX + row[1], e2 = a[2] * centerX + row[2];
+				if (e0 < 0.f || e1 < 0.f || e2 < 0.f)
+					continue;
+
+				const float depth = z0 + (e1 * invArea * dz1 + e2 * invArea * dz2);
+				depths[px + k] = std::min(depths[px + k], depth);
+			}
+#endif
+		}
+	}
+}
+
+void OcclusionCuller::updateTiles()
+{
+	for (int32_t ty = 0; ty < _tilesY; ++ty)
+		for (int32_t tx = 0; tx < _tilesX; ++tx)
+		{
+			const float* depths = _depths.data() + static_cast<size_t>(ty) * TILE_SIZE * _width + tx * TILE_SIZE;
+#ifdef OCCLUSION_SSE2
+			__m128 farthest = _mm_setzero_ps();
+			for (int32_t y = 0; y < TILE_SIZE; ++y, depths += _width)
+				for (int32_t x = 0; x < TILE_SIZE; x += 4)
+					farthest = _mm_max_ps(farthest, _mm_loadu_ps(depths + x));
+			farthest = _mm_max_ps(farthest, _mm_shuffle_ps(farthest, farthest, _MM_SHUFFLE(1, 0, 3, 2)));
+			farthest = _mm_max_ps(farthest, _mm_shuffle_ps(farthest, farthest, _MM_SHUFFLE(2, 3, 0, 1)));
+			_tileDepths[static_cast<size_t>(ty) * _tilesX + tx] = _mm_cvtss_f32(farthest);
+#else
+			float farthest = 0.f;
+			for (int32_t y = 0; y < TILE_SIZE; ++y, depths += _width)
+				for (int32_t x = 0; x < TILE_SIZE; ++x)
+					farthest = std::max(farthest, depths[x]);
+			_tileDepths[static_cast<size_t>(ty) * _tilesX + tx] = farthest;
+#endif
+		}
+}
+
+bool OcclusionCuller::isVisible(const vec3f& min, const vec3f& max)
+{
+	++_stats.tested;
+	const float (&m)[4][4] = _viewProjection.mat;
+	const float (&v)[4][4] = _viewport.mat;
+
+	// Screen rectangle and nearest depth of the corners; the nearest point of a box is a corner
+	float minX = static_cast<float>(_width), minY = static_cast<float>(_height), maxX = -1.f, maxY = -1.f;
+	float nearest = 1.f;
+	for (int32_t i = 0; i < 8; ++i)
+	{
+		const float x = (i & 1) ? max.x + BOX_MARGIN : min.x - BOX_MARGIN;
+		const float y = (i & 2) ? max.y + BOX_MARGIN : min.y - BOX_MARGIN;
+		const float z = (i & 4) ? max.z + BOX_MARGIN : min.z - BOX_MARGIN;
+		const float clipZ = x * m[0][2] + y * m[1][2] + z * m[2][2] + m[3][2];
+		if (clipZ < 0.f)
+			return true;
+
+		const float invW = 1.f / (x * m[0][3] + y * m[1][3] + z * m[2][3] + m[3][3]);
+		const float ndcX = (x * m[0][0] + y * m[1][0] + z * m[2][0] + m[3][0]) * invW;
+		const float ndcY = (x * m[0][1] + y * m[1][1] + z * m[2][1] + m[3][1]) * invW;
+		const float sx = ndcX * v[0][0] + ndcY * v[1][0] + v[3][0];
+		const float sy = ndcX * v[0][1] + ndcY * v[1][1] + v[3][1];
+		minX = std::min(minX, sx);
+		minY = std::min(minY, sy);
+		maxX = std::max(maxX, sx);
+		maxY = std::max(maxY, sy);
+		nearest = std::min(nearest, clipZ * invW);
+	}
+
+	const int32_t x0 = static_cast<int32_t>(std::floor(std::max(minX, 0.f)));
+	const int32_t y0 = static_cast<int32_t>(std::floor(std::max(minY, 0.f)));
+	const int32_t x1 = std::min(_width - 1, static_cast<int32_t>(std::floor(maxX)));
+	const int32_t y1 = std::min(_height - 1, static_cast<int32_t>(std::floor(maxY)));
+	if (x0 > x1 || y0 > y1 || nearest >= 1.f)
+	{
+		++_stats.outside;
+		return false;
+	}
+
+	bool checked = false;
+	for (int32_t ty = y0 / TILE_SIZE; ty <= y1 / TILE_SIZE; ++ty)
+		for (int32_t tx = x0 / TILE_SIZE; tx <= x1 / TILE_SIZE; ++tx)
+		{
+			if (_tileDepths[static_cast<size_t>(ty) * _tilesX + tx] < nearest)
+				continue;
+
+			// Some pixel of the tile is behind the box, is it one the box covers?
+			checked = true;
+			const int32_t fromX = std::max(x0, tx * TILE_SIZE), toX = std::min(x1, tx * TILE_SIZE + TILE_SIZE - 1);
+			const int32_t fromY = std::max(y0, ty * TILE_SIZE), toY = std::min(y1, ty * TILE_SIZE + TILE_SIZE - 1);
+			for (int32_t y = fromY; y <= toY; ++y)
+			{
+				const float* depths = _depths.data() + static_cast<size_t>(y) * _width;
+#ifdef OCCLUSION_SSE2
+				const __m128 boxDepth = _mm_set1_ps(nearest);
+				for (int32_t x = fromX & ~3; x <= toX; x += 4)
+				{
+					const __m128i lanes = _mm_add_epi32(_mm_set1_epi32(x), _mm_set_epi32(3, 2, 1, 0));
+					const __m128 covered = _mm_castsi128_ps(_mm_andnot_si128(_mm_cmplt_epi32(lanes, _mm_set1_epi32(fromX)),
+						_mm_cmplt_epi32(lanes, _mm_set1_epi32(toX + 1))));
+					if (_mm_movemask_ps(_mm_and_ps(covered, _mm_cmpge_ps(_mm_loadu_ps(depths + x), boxDepth))) != 0)
+						return true;
+				}
+#else
+				for (int32_t x = fromX; x <= toX; ++x)
+					if (depths[x] >= nearest)
+						return true;
+#endif
+			}
+		}
+
+	++_stats.culled;
+	if (!checked)
+		++_stats.tileCulled;
+	return false;
+}
+
+void OcclusionCuller::bounds(const ChunkMesh& mesh, vec3f& min, vec3f& max)
+{
+	vec3i from{ mesh.coords.x * Chunk::SIZE, mesh.coords.y * Chunk::SIZE, mesh.coords.z * Chunk::SIZE };
+	int32_t size = Chunk::SIZE;
+	if (mesh.section != ChunkMesh::WHOLE_CHUNK)
+	{
+		// See Chunk::sectionIndex()
+		size = ChunkSection::SIZE;
+		from.x += (mesh.section % Chunk::SECTIONS_PER_AXIS) * size;
+		from.z += (mesh.section / Chunk::SECTIONS_PER_AXIS % Chunk::SECTIONS_PER_AXIS) * size;
+		from.y += (mesh.section / (Chunk::SECTIONS_PER_AXIS * Chunk::SECTIONS_PER_AXIS)) * size;
+	}
+	min = { static_cast<float>(from.x), static_cast<float>(from.y), static_cast<float>(from.z) };
+	max = { static_cast<float>(from.x + size), static_cast<float>(from.y + size), static_cast<float>(from.z + size) };
+}
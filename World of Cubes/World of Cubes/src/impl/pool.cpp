@@ -0,0 +1,484 @@
+#include "support/pool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <thread>
+
+#include "support/bits.h"
+
+PoolStats& PoolStats::operator+= (const PoolStats& other)
+{
+	reservedBytes += other.reservedBytes;
+	usedBytes += other.usedBytes;
+	peakUsedBytes += other.peakUsedBytes;
+	allocations += other.allocations;
+	deallocations += other.deallocations;
+	cacheHits += other.cacheHits;
+	failedAllocations += other.failedAllocations;
+	slabs += other.slabs;
+	return *this;
+}
+
+
+
+MemoryBudget::MemoryBudget(size_t limit) :
+	_reserved{ 0 },
+	_limit{ limit }
+{}
+
+bool MemoryBudget::tryReserve(size_t bytes)
+{
+	size_t current = _reserved.load(std::memory_order_relaxed);
+	do
+	{
+		if (_limit && current + bytes > _limit)
+			return false;
+	} while (!_reserved.compare_exchange_weak(current, current + bytes, std::memory_order_relaxed));
+	return true;
+}
+
+void MemoryBudget::release(size_t bytes) { _reserved.fetch_sub(bytes, std::memory_order_relaxed); }
+
+
+
+namespace
+{
+	class SpinLock
+	{
+	private:
+		std::atomic_flag& _flag;
+
+	public:
+		explicit SpinLock(std::atomic_flag& flag) : _flag{ flag }
+		{
+			while (_flag.test_and_set(std::memory_order_acquire))
+				std::this_thread::yield();
+		}
+		~SpinLock() { _flag.clear(std::memory_order_release); }
+	};
+
+	std::atomic<size_t> _NextCacheIndex{ 0 };
+}
+
+SlabPool::SlabPool(size_t blockSize, size_t slabBytes, size_t memoryLimit) :
+	_blockSize{ (std::max<size_t>(blockSize, sizeof(void*)) + ALIGNMENT - 1) & ~(ALIGNMENT - 1) },
+	_blocksPerSlab{ std::max<size_t>(1, slabBytes / _blockSize) },
+	_ownBudget{ new MemoryBudget{ memoryLimit } },
+	_budget{ _ownBudget.get() },
+	_lock{},
+	_slabs{},
+	_freeBlocks{},
+	_emptySlabs{ 0 },
+	_caches{ new ThreadCache[THREAD_CACHES] },
+	_used{ 0 },
+	_peak{ 0 },
+	_allocations{ 0 },
+	_deallocations{ 0 },
+	_cacheHits{ 0 },
+	_failed{ 0 }
+{}
+
+SlabPool::SlabPool(size_t blockSize, size_t slabBytes, MemoryBudget& sharedBudget) :
+	SlabPool{ blockSize, slabBytes, 0 }
+{
+	_ownBudget.reset();
+	_budget = &sharedBudget;
+}
+
+SlabPool::~SlabPool()
+{
+	for (const Slab& slab : _slabs)
+		::operator delete(slab.data, std::align_val_t{ ALIGNMENT });
+	_budget->release(_slabs.size() * _blocksPerSlab * _blockSize);
+}
+
+void* SlabPool::allocate()
+{
+	ThreadCache& cache = localCache();
+	void* block = nullptr;
+	bool cached = true;
+	{
+		SpinLock lock{ cache.lock };
+		if (cache.count == 0)
+		{
+			cache.count = refill(cache.blocks, CACHE_SIZE / 2);
+			cached = false;
+		}
+		if (cache.count > 0)
+			block = cache.blocks[--cache.count];
+	}
+
+	if (!block)
+	{
+		_failed.fetch_add(1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	countAllocation(cached);
+	return block;
+}
+
+void SlabPool::deallocate(void* block)
+{
+	if (!block)
+		return;
+
+	ThreadCache& cache = localCache();
+	{
+		SpinLock lock{ cache.lock };
+		if (cache.count == CACHE_SIZE)
+		{
+			constexpr size_t half = CACHE_SIZE / 2;
+			std::lock_guard<std::mutex> central{ _lock };
+			for (size_t i = half; i < CACHE_SIZE; ++i)
+				pushFree(cache.blocks[i]);
+			releaseEmpty(RETAINED_SLABS);
+			cache.count = half;
+		}
+		cache.blocks[cache.count++] = block;
+	}
+
+	_used.fetch_sub(_blockSize, std::memory_order_relaxed);
+	_deallocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+void SlabPool::deallocate(void* const* blocks, size_t count)
+{
+	size_t returned = 0;
+	{
+		std::lock_guard<std::mutex> central{ _lock };
+		for (size_t i = 0; i < count; ++i)
+		{
+			if (blocks[i])
+			{
+				pushFree(blocks[i]);
+				++returned;
+			}
+		}
+		releaseEmpty(RETAINED_SLABS);
+	}
+
+	_used.fetch_sub(returned * _blockSize, std::memory_order_relaxed);
+	_deallocations.fetch_add(returned, std::memory_order_relaxed);
+}
+
+void SlabPool::flushCaches()
+{
+	for (size_t i = 0; i < THREAD_CACHES; ++i)
+	{
+		ThreadCache& cache = _caches[i];
+		SpinLock lock{ cache.lock };
+		if (cache.count == 0)
+			continue;
+
+		std::lock_guard<std::mutex> central{ _lock };
+		for (size_t j = 0; j < cache.count; ++j)
+			pushFree(cache.blocks[j]);
+		releaseEmpty(RETAINED_SLABS);
+		cache.count = 0;
+	}
+}
+
+PoolStats SlabPool::getStats() const
+{
+	PoolStats stats{};
+	{
+		std::lock_guard<std::mutex> central{ _lock };
+		stats.slabs = _slabs.size();
+	}
+	stats.reservedBytes = stats.slabs * _blocksPerSlab * _blockSize;
+	stats.usedBytes = _used.load(std::memory_order_relaxed);
+	stats.peakUsedBytes = _peak.load(std::memory_order_relaxed);
+	stats.allocations = _allocations.load(std::memory_order_relaxed);
+	stats.deallocations = _deallocations.load(std::memory_order_relaxed);
+	stats.cacheHits = _cacheHits.load(std::memory_order_relaxed);
+	stats.failedAllocations = _failed.load(std::memory_order_relaxed);
+	return stats;
+}
+
+SlabPool::ThreadCache& SlabPool::localCache()
+{
+	static thread_local size_t index = _NextCacheIndex.fetch_add(1, std::memory_order_relaxed) % THREAD_CACHES;
+	return _caches[index];
+}
+
+size_t SlabPool::refill(void** out, size_t count)
+{
+	std::lock_guard<std::mutex> central{ _lock };
+	if (_freeBlocks.size() < count && !grow() && _freeBlocks.empty())
+		return 0;
+
+	count = std::min(count, _freeBlocks.size());
+	for (size_t i = 0; i < count; ++i)
+	{
+		void* block = _freeBlocks[_freeBlocks.size() - count + i];
+		Slab& slab = findSlab(block);
+		if (slab.freeCount-- == _blocksPerSlab && !slab.kept)
+			--_emptySlabs;
+		out[i] = block;
+	}
+	_freeBlocks.resize(_freeBlocks.size() - count);
+	return count;
+}
+
+bool SlabPool::reserve(size_t blocks)
+{
+	std::lock_guard<std::mutex> lock{ _lock };
+	while (_slabs.size() * _blocksPerSlab < blocks)
+		if (!grow(true))
+			return false;
+	return true;
+}
+
+std::vector<std::pair<void*, size_t>> SlabPool::getSlabs() const
+{
+	std::lock_guard<std::mutex> lock{ _lock };
+	std::vector<std::pair<void*, size_t>> slabs;
+	slabs.reserve(_slabs.size());
+	for (const Slab& slab : _slabs)
+		slabs.emplace_back(slab.data, _blocksPerSlab * _blockSize);
+	return slabs;
+}
+
+size_t SlabPool::trim()
+{
+	std::lock_guard<std::mutex> lock{ _lock };
+	return releaseEmpty(0);
+}
+
+bool SlabPool::grow(bool kept)
+{
+	const size_t slabSize = _blocksPerSlab * _blockSize;
+	if (!_budget->tryReserve(slabSize))
+		return false;
+
+	uint8_t* slab = static_cast<uint8_t*>(::operator new(slabSize, std::align_val_t{ ALIGNMENT }, std::nothrow));
+	if (!slab)
+	{
+		_budget->release(slabSize);
+		return false;
+	}
+
+	const Slab entry = { slab, _blocksPerSlab, kept };
+	_slabs.insert(std::upper_bound(_slabs.begin(), _slabs.end(), entry, [](const Slab& a, const Slab& b) { return a.data < b.data; }), entry);
+	if (!kept)
+		++_emptySlabs;
+
+	_freeBlocks.reserve(_freeBlocks.size() + _blocksPerSlab);
+	for (size_t i = _blocksPerSlab; i > 0; --i)
+		_freeBlocks.push_back(slab + (i - 1) * _blockSize);
+	return true;
+}
+
+SlabPool::Slab& SlabPool::findSlab(const void* block)
+{
+	// The last slab starting at or before the block
+	const uint8_t* address = static_cast<const uint8_t*>(block);
+	auto it = std::upper_bound(_slabs.begin(), _slabs.end(), address, [](const uint8_t* a, const Slab& slab) { return a < slab.data; });
+	return *(it - 1);
+}
+
+void SlabPool::pushFree(void* block)
+{
+	_freeBlocks.push_back(block);
+	Slab& slab = findSlab(block);
+	if (++slab.freeCount == _blocksPerSlab && !slab.kept)
+		++_emptySlabs;
+}
+
+size_t SlabPool::releaseEmpty(size_t keep)
+{
+	if (_emptySlabs <= keep)
+		return 0;
+
+	// Drops the blocks of the released slabs from the free list, then their memory
+	std::vector<const uint8_t*> released;
+	for (const Slab& slab : _slabs)
+		if (!slab.kept && slab.freeCount == _blocksPerSlab && _emptySlabs - released.size() > keep)
+			released.push_back(slab.data);
+
+	const size_t slabSize = _blocksPerSlab * _blockSize;
+	_freeBlocks.erase(std::remove_if(_freeBlocks.begin(), _freeBlocks.end(), [&](void* block) {
+		const uint8_t* address = static_cast<const uint8_t*>(block);
+		auto it = std::upper_bound(released.begin(), released.end(), address);
+		return it != released.begin() && address < *(it - 1) + slabSize;
+	}), _freeBlocks.end());
+
+	_slabs.erase(std::remove_if(_slabs.begin(), _slabs.end(), [&](const Slab& slab) {
+		if (!std::binary_search(released.begin(), released.end(), slab.data))
+			return false;
+		::operator delete(slab.data, std::align_val_t{ ALIGNMENT });
+		return true;
+	}), _slabs.end());
+
+	_emptySlabs -= released.size();
+	_budget->release(released.size() * slabSize);
+	return released.size() * slabSize;
+}
+
+void SlabPool::countAllocation(bool cached)
+{
+	size_t used = _used.fetch_add(_blockSize, std::memory_order_relaxed) + _blockSize;
+	size_t peak = _peak.load(std::memory_order_relaxed);
+	while (used > peak && !_peak.compare_exchange_weak(peak, used, std::memory_order_relaxed));
+
+	_allocations.fetch_add(1, std::memory_order_relaxed);
+	if (cached)
+		_cacheHits.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+
+SizeClassPool::SizeClassPool(size_t memoryLimit, size_t slabBytes) :
+	_budget{ memoryLimit },
+	_classes{}
+{
+	for (size_t i = 0; i < CLASS_COUNT; ++i)
+		_classes[i].reset(new SlabPool{ classSize(i), std::max(slabBytes, classSize(i)), _budget });
+}
+
+void* SizeClassPool::allocate(size_t size, size_t* capacity)
+{
+	size_t sizeClass = classOf(size);
+	if (sizeClass >= CLASS_COUNT)
+		return nullptr;
+
+	void* ptr = _classes[sizeClass]->allocate();
+	if (!ptr && _budget.isLimited())
+	{
+		// The limit is shared: empty slabs of the other classes may make room
+		size_t freed = 0;
+		for (auto& pool : _classes)
+			freed += pool->trim();
+		if (freed > 0)
+			ptr = _classes[sizeClass]->allocate();
+	}
+	if (capacity)
+		*capacity = ptr ? classSize(sizeClass) : 0;
+	return ptr;
+}
+
+void SizeClassPool::deallocate(void* ptr, size_t size)
+{
+	size_t sizeClass = classOf(size);
+	if (ptr && sizeClass < CLASS_COUNT)
+		_classes[sizeClass]->deallocate(ptr);
+}
+
+void SizeClassPool::flushCaches()
+{
+	for (auto& pool : _classes)
+		pool->flushCaches();
+}
+
+PoolStats SizeClassPool::getStats() const
+{
+	PoolStats stats{};
+	for (const auto& pool : _classes)
+		stats += pool->getStats();
+	return stats;
+}
+
+PoolStats SizeClassPool::getClassStats(size_t sizeClass) const
+{
+	return sizeClass < CLASS_COUNT ? _classes[sizeClass]->getStats() : PoolStats{};
+}
+
+size_t SizeClassPool::classOf(size_t size)
+{
+	if (size <= classSize(0))
+		return 0;
+	if (size > classSize(CLASS_COUNT - 1))
+		return CLASS_COUNT;
+	return (32 - bits::clz32(static_cast<uint32_t>(size - 1))) - MIN_CLASS_BITS;
+}
+
+
+
+PoolBuffer::PoolBuffer() :
+	_pool{ nullptr },
+	_data{ nullptr },
+	_size{ 0 },
+	_capacity{ 0 }
+{}
+
+PoolBuffer::PoolBuffer(SizeClassPool& pool, size_t reserve) :
+	_pool{ &pool },
+	_data{ nullptr },
+	_size{ 0 },
+	_capacity{ 0 }
+{
+	if (reserve)
+		this->reserve(reserve);
+}
+
+PoolBuffer::PoolBuffer(PoolBuffer&& b) noexcept :
+	_pool{ b._pool },
+	_data{ b._data },
+	_size{ b._size },
+	_capacity{ b._capacity }
+{
+	b._data = nullptr;
+	b._size = 0;
+	b._capacity = 0;
+}
+
+PoolBuffer::~PoolBuffer() { release(); }
+
+PoolBuffer& PoolBuffer::operator= (PoolBuffer&& b) noexcept
+{
+	if (this != &b)
+	{
+		release();
+		_pool = b._pool;
+		_data = b._data;
+		_size = b._size;
+		_capacity = b._capacity;
+		b._data = nullptr;
+		b._size = 0;
+		b._capacity = 0;
+	}
+	return *this;
+}
+
+bool PoolBuffer::reserve(size_t capacity)
+{
+	if (capacity <= _capacity)
+		return true;
+	if (!_pool)
+		return false;
+
+	size_t newCapacity;
+	uint8_t* data = static_cast<uint8_t*>(_pool->allocate(capacity, &newCapacity));
+	if (!data)
+		return false;
+
+	if (_data)
+	{
+		std::memcpy(data, _data, _size);
+		_pool->deallocate(_data, _capacity);
+	}
+	_data = data;
+	_capacity = newCapacity;
+	return true;
+}
+
+bool PoolBuffer::append(const void* data, size_t bytes)
+{
+	if (_size + bytes > _capacity && !reserve(std::max(_size + bytes, _capacity * 2)))
+		return false;
+
+	std::memcpy(_data + _size, data, bytes);
+	_size += bytes;
+	return true;
+}
+
+void PoolBuffer::release()
+{
+	if (_data && _pool)
+		_pool->deallocate(_data, _capacity);
+	_data = nullptr;
+	_size = 0;
+	_capacity = 0;
+}
@@ -0,0 +1,371 @@
+#include "engine/region_file.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include "support/checksum.h"
+
+namespace
+{
+	inline uint64_t region_key(const vec3i& coords)
+	{
+		return (static_cast<uint64_t>(coords.x & 0x1fffff) << 42) |
+			(static_cast<uint64_t>(coords.y & 0x1fffff) << 21) |
+			static_cast<uint64_t>(coords.z & 0x1fffff);
+	}
+}
+
+RegionFile::RegionFile() :
+	_path{},
+	_file{},
+	_map{},
+	_entries{},
+	_usedSectors{},
+	_released{},
+	_lock{}
+{}
+
+bool RegionFile::open(const std::string& path, bool create)
+{
+	std::unique_lock<std::shared_mutex> lock{ _lock };
+
+	_map.unmap();
+	_path = path;
+	if (!_file.open(path, create ? File::Mode::Create : File::Mode::ReadWrite))
+		return false;
+
+	const uint64_t headerBytes = static_cast<uint64_t>(HEADER_SECTORS) * SECTOR_SIZE;
+	_entries.assign(CHUNK_COUNT, { 0, 0 });
+	if (_file.size() < headerBytes)
+	{
+		if (!_file.resize(headerBytes))
+		{
+			std::cerr << "Region error: cannot initialize " << path << std::endl;
+			_file.close();
+			return false;
+		}
+	}
+	else if (_file.readAt(0, _entries.data(), CHUNK_COUNT * sizeof(Entry)) != CHUNK_COUNT * sizeof(Entry))
+	{
+		std::cerr << "Region error: cannot read the header of " << path << std::endl;
+		_file.close();
+		return false;
+	}
+
+	const uint32_t fileSectors = static_cast<uint32_t>((_file.size() + SECTOR_SIZE - 1) / SECTOR_SIZE);
+	_usedSectors.assign(fileSectors, false);
+	_released.clear();
+	std::fill(_usedSectors.begin(), _usedSectors.begin() + HEADER_SECTORS, true);
+	for (Entry& entry : _entries)
+	{
+		if (entry.sectors == 0)
+			continue;
+
+		if (entry.sector < HEADER_SECTORS || static_cast<uint64_t>(entry.sector) + entry.sectors > fileSectors)
+		{
+			std::cerr << "Region warning: dropping out of bounds chunk entry in " << path << std::endl;
+			entry = { 0, 0 };
+			continue;
+		}
+		markSectors(entry, true);
+	}
+
+	return remap();
+}
+
+void RegionFile::close()
+{
+	std::unique_lock<std::shared_mutex> lock{ _lock };
+	_map.unmap();
+	_file.close();
+	_entries.clear();
+	_usedSectors.clear();
+	_released.clear();
+}
+
+bool RegionFile::hasChunk(const vec3i& local) const
+{
+	std::shared_lock<std::shared_mutex> lock{ _lock };
+	return !_entries.empty() && _entries[entryIndex(local)].sectors != 0;
+}
+
+bool RegionFile::readChunk(const vec3i& local, Chunk& chunk) const
+{
+	std::shared_lock<std::shared_mutex> lock{ _lock };
+	if (_entries.empty())
+		return false;
+
+	const Entry& entry = _entries[entryIndex(local)];
+	if (entry.sectors == 0)
+		return false;
+
+	const uint64_t offset = static_cast<uint64_t>(entry.sector) * SECTOR_SIZE;
+	const uint64_t span = static_cast<uint64_t>(entry.sectors) * SECTOR_SIZE;
+	if (offset + span > _map.size())
+		return false;
+
+	return decodeRecord(_map.data() + offset, static_cast<size_t>(span), chunk);
+}
+
+bool RegionFile::getRecordSpan(const vec3i& local, uint64_t& offset, size_t& size) const
+{
+	std::shared_lock<std::shared_mutex> lock{ _lock };
+	if (_entries.empty())
+		return false;
+
+	const Entry& entry = _entries[entryIndex(local)];
+	if (entry.sectors == 0)
+		return false;
+
+	offset = static_cast<uint64_t>(entry.sector) * SECTOR_SIZE;
+	size = static_cast<size_t>(entry.sectors) * SECTOR_SIZE;
+	return true;
+}
+
+bool RegionFile::decodeRecord(const uint8_t* record, size_t size, Chunk& chunk)
+{
+	RecordHeader header;
+	if (size < sizeof(header))
+		return false;
+
+	std::memcpy(&header, record, sizeof(header));
+	if (sizeof(header) + static_cast<uint64_t>(header.length) > size || header.compression >= CHUNK_COMPRESSION_COUNT)
+	{
+		std::cerr << "Region error: corrupted record header" << std::endl;
+		return false;
+	}
+
+	const uint8_t* payload = record + sizeof(header);
+	if (checksum::crc32(payload, header.length) != header.checksum)
+	{
+		std::cerr << "Region error: checksum mismatch" << std::endl;
+		return false;
+	}
+
+	return chunk_io::decode(payload, header.length, static_cast<ChunkCompression>(header.compression), chunk);
+}
+
+bool RegionFile::writeChunk(const vec3i& local, const ChunkSnapshot& chunk, ChunkCompression compression)
+{
+	static thread_local std::vector<uint8_t> payload;
+	chunk_io::encode(chunk, compression, payload);
+	return writeRecord(local, payload.data(), payload.size(), compression, chunk.getVersion());
+}
+
+bool RegionFile::writeRecord(const vec3i& local, const uint8_t* payload, size_t size, ChunkCompression compression, uint64_t version)
+{
+	RecordHeader header{};
+	header.length = static_cast<uint32_t>(size);
+	header.checksum = checksum::crc32(payload, size);
+	header.version = version;
+	header.compression = static_cast<uint8_t>(compression);
+
+	const uint32_t sectors = static_cast<uint32_t>((sizeof(header) + size + SECTOR_SIZE - 1) / SECTOR_SIZE);
+	std::vector<uint8_t> record(static_cast<size_t>(sectors) * SECTOR_SIZE, 0);
+	std::memcpy(record.data(), &header, sizeof(header));
+	std::memcpy(record.data() + sizeof(header), payload, size);
+
+	std::unique_lock<std::shared_mutex> lock{ _lock };
+	if (!_file.isOpen())
+		return false;
+
+	const uint32_t sector = allocate(sectors);
+	const uint64_t offset = static_cast<uint64_t>(sector) * SECTOR_SIZE;
+	if (offset + record.size() > _map.size() && !reserve(offset + record.size()))
+	{
+		markSectors({ sector, sectors }, false);
+		return false;
+	}
+	if (_file.writeAt(offset, record.data(), record.size()) != record.size())
+	{
+		std::cerr << "Region error: cannot write chunk data to " << _path << std::endl;
+		markSectors({ sector, sectors }, false);
+		return false;
+	}
+
+	const size_t index = entryIndex(local);
+	const Entry previous = _entries[index];
+	const Entry current = { sector, sectors };
+	if (_file.writeAt(index * sizeof(Entry), &current, sizeof(Entry)) != sizeof(Entry))
+	{
+		std::cerr << "Region error: cannot update the header of " << _path << std::endl;
+		markSectors(current, false);
+		return false;
+	}
+
+	_entries[index] = current;
+	if (previous.sectors != 0)
+		_released.push_back(previous);
+	return true;
+}
+
+bool RegionFile::eraseChunk(const vec3i& local)
+{
+	std::unique_lock<std::shared_mutex> lock{ _lock };
+	if (_entries.empty())
+		return false;
+
+	const size_t index = entryIndex(local);
+	const Entry empty = { 0, 0 };
+	if (_entries[index].sectors == 0)
+		return true;
+	if (_file.writeAt(index * sizeof(Entry), &empty, sizeof(Entry)) != sizeof(Entry))
+		return false;
+
+	_released.push_back(_entries[index]);
+	_entries[index] = empty;
+	return true;
+}
+
+bool RegionFile::sync()
+{
+	std::unique_lock<std::shared_mutex> lock{ _lock };
+	if (!_file.isOpen() || !_file.sync())
+		return false;
+
+	// The table on disk no longer points at the replaced copies
+	for (const Entry& entry : _released)
+		markSectors(entry, false);
+	_released.clear();
+	return true;
+}
+
+void RegionFile::dropCache()
+{
+	std::unique_lock<std::shared_mutex> lock{ _lock };
+	if (_file.isOpen())
+		_file.dropCache();
+}
+
+uint32_t RegionFile::allocate(uint32_t sectors)
+{
+	// First fit over the free sectors, growing the file when nothing fits
+	uint32_t run = 0;
+	for (uint32_t i = HEADER_SECTORS; i < _usedSectors.size(); ++i)
+	{
+		run = _usedSectors[i] ? 0 : run + 1;
+		if (run == sectors)
+		{
+			Entry entry = { i + 1 - sectors, sectors };
+			markSectors(entry, true);
+			return entry.sector;
+		}
+	}
+
+	uint32_t start = static_cast<uint32_t>(_usedSectors.size()) - run;
+	_usedSectors.resize(static_cast<size_t>(start) + sectors, false);
+	markSectors({ start, sectors }, true);
+	return start;
+}
+
+void RegionFile::markSectors(const Entry& entry, bool used)
+{
+	for (uint32_t i = 0; i < entry.sectors; ++i)
+		if (entry.sector + i < _usedSectors.size())
+			_usedSectors[entry.sector + i] = used;
+}
+
+bool RegionFile::reserve(uint64_t size)
+{
+	// Doubling the file keeps the remaps logarithmic in its size
+	uint64_t capacity = std::max(_file.size(), static_cast<uint64_t>(HEADER_SECTORS) * SECTOR_SIZE);
+	while (capacity < size)
+		capacity *= 2;
+
+	if (capacity > _file.size() && !_file.resize(capacity))
+	{
+		std::cerr << "Region error: cannot grow " << _path << std::endl;
+		return false;
+	}
+	return remap();
+}
+
+bool RegionFile::remap()
+{
+	if (!_map.map(_file))
+	{
+		std::cerr << "Region error: cannot map " << _path << std::endl;
+		return false;
+	}
+	return true;
+}
+
+
+
+RegionStorage::RegionStorage(const std::string& directory) :
+	_directory{ directory },
+	_regions{},
+	_lock{}
+{}
+
+bool RegionStorage::loadChunk(const vec3i& chunkCoords, Chunk& chunk)
+{
+	RegionFile* region = getRegion(RegionFile::regionCoords(chunkCoords), false);
+	if (!region)
+		return false;
+
+	chunk = Chunk{ chunkCoords };
+	return region->readChunk(RegionFile::localCoords(chunkCoords), chunk);
+}
+
+bool RegionStorage::saveChunk(const ChunkSnapshot& chunk, ChunkCompression compression)
+{
+	RegionFile* region = getRegion(RegionFile::regionCoords(chunk.getCoords()), true);
+	return region && region->writeChunk(RegionFile::localCoords(chunk.getCoords()), chunk, compression);
+}
+
+RegionFile* RegionStorage::getRegion(const vec3i& regionCoords, bool create)
+{
+	std::lock_guard<std::mutex> lock{ _lock };
+
+	const uint64_t key = region_key(regionCoords);
+	auto it = _regions.find(key);
+	if (it != _regions.end())
+		return it->second.get();
+
+	const std::string path = regionPath(regionCoords);
+	if (!create && !File::exists(path))
+		return nullptr;
+	if (create && !File::createDirectory(_directory))
+	{
+		std::cerr << "Region error: cannot create directory " << _directory << std::endl;
+		return nullptr;
+	}
+
+	std::unique_ptr<RegionFile> region{ new RegionFile };
+	if (!region->open(path, create))
+		return nullptr;
+
+	return _regions.emplace(key, std::move(region)).first->second.get();
+}
+
+bool RegionStorage::syncAll()
+{
+	std::lock_guard<std::mutex> lock{ _lock };
+	bool ok = true;
+	for (auto& region : _regions)
+		ok = region.second->sync() && ok;
+	return ok;
+}
+
+void RegionStorage::dropCaches()
+{
+	std::lock_guard<std::mutex> lock{ _lock };
+	for (auto& region : _regions)
+		region.second->dropCache();
+}
+
+void RegionStorage::closeAll()
+{
+	std::lock_guard<std::mutex> lock{ _lock };
+	_regions.clear();
+}
+
+std::string RegionStorage::regionPath(const vec3i& regionCoords) const
+{
+	std::ostringstream ss;
+	ss << _directory << "/r." << regionCoords.x << '.' << regionCoords.y << '.' << regionCoords.z << ".wcr";
+	return ss.str();
+}
@@ -0,0 +1,226 @@
+#include "support/render_commands.h"
+
+#include <cstring>
+
+namespace
+{
+	constexpr size_t DIGIT_BITS = 8;
+	constexpr size_t DIGITS = 64 / DIGIT_BITS;
+	constexpr size_t BUCKETS = size_t{ 1 } << DIGIT_BITS;
+
+	inline uint32_t depth_bits(float depth)
+	{
+		// Bits of positive floats sort like their values
+		if (!(depth > 0.f))
+			return 0;
+		uint32_t bits;
+		std::memcpy(&bits, &depth, sizeof(bits));
+		return bits;
+	}
+
+	inline bool blended(RenderPass pass) { return pass == RenderPass::Translucent || pass == RenderPass::Overlay; }
+}
+
+
+
+RenderStateCache::RenderStateCache(RenderBackend& backend) :
+	_backend{ backend },
+	_program{ UNKNOWN },
+	_texture{ UNKNOWN },
+	_vertexArray{ UNKNOWN },
+	_depth{ UNKNOWN },
+	_blend{ UNKNOWN }
+{}
+
+void RenderStateCache::invalidate()
+{
+	_program = _texture = _vertexArray = _depth = _blend = UNKNOWN;
+}
+
+void RenderStateCache::setPass(RenderPass pass)
+{
+	const bool test = pass != RenderPass::Overlay;
+	const bool write = !blended(pass);
+	const uint32_t depth = (test ? 1u : 0u) | (write ? 2u : 0u);
+	if (depth != _depth)
+	{
+		_depth = depth;
+		_backend.setDepth(test, write);
+	}
+
+	const uint32_t blend = blended(pass) ? 1u : 0u;
+	if (blend != _blend)
+	{
+		_blend = blend;
+		_backend.setBlend(blend != 0);
+	}
+}
+
+void RenderStateCache::useProgram(uint32_t program)
+{
+	if (program != _program)
+	{
+		_program = program;
+		_backend.useProgram(program);
+	}
+}
+
+void RenderStateCache::bindTexture(uint32_t texture)
+{
+	if (texture != _texture)
+	{
+		_texture = texture;
+		_backend.bindTexture(texture);
+	}
+}
+
+void RenderStateCache::bindVertexArray(uint32_t vertexArray)
+{
+	if (vertexArray != _vertexArray)
+	{
+		_vertexArray = vertexArray;
+		_backend.bindVertexArray(vertexArray);
+	}
+}
+
+
+
+RenderCommandBuffer::RenderCommandBuffer() :
+	_commands{},
+	_order{},
+	_scratch{},
+	_sorted{ false }
+{}
+
+void RenderCommandBuffer::draw(RenderPass pass, uint32_t program, uint32_t texture, uint32_t vertexArray, uint32_t first, uint32_t count, float depth)
+{
+	_commands.push_back({ makeKey(pass, program, texture, depth), program, texture, vertexArray, first, count, pass });
+	_sorted = false;
+}
+
+void RenderCommandBuffer::sort()
+{
+	const size_t count = _commands.size();
+	_order.resize(count);
+	_scratch.resize(count);
+
+	// Histograms of every digit in one pass
+	uint32_t histograms[DIGITS][BUCKETS] = {};
+	for (size_t i = 0; i < count; ++i)
+	{
+		const uint64_t key = _commands[i].key;
+		_order[i] = { key, static_cast<uint32_t>(i) };
+		for (size_t digit = 0; digit < DIGITS; ++digit)
+			++histograms[digit][(key >> (digit * DIGIT_BITS)) & (BUCKETS - 1)];
+	}
+
+	for (size_t digit = 0; digit < DIGITS && count > 0; ++digit)
+	{
+		uint32_t* histogram = histograms[digit];
+		const size_t shift = digit * DIGIT_BITS;
+		if (histogram[(_order[0].key >> shift) & (BUCKETS - 1)] == count)
+			continue;
+
+		uint32_t offset = 0;
+		for (size_t bucket = 0; bucket < BUCKETS; ++bucket)
+		{
+			const uint32_t size = histogram[bucket];
+			histogram[bucket] = offset;
+			offset += size;
+		}
+		for (const SortEntry& entry : _order)
+			_scratch[histogram[(entry.key >> shift) & (BUCKETS - 1)]++] = entry;
+		_order.swap(_scratch);
+	}
+	_sorted = true;
+}
+
+void RenderCommandBuffer::submit(RenderStateCache& cache) const
+{
+	const size_t count = _commands.size();
+	for (size_t i = 0; i < count; ++i)
+	{
+		const RenderCommand& command = _commands[_sorted ? _order[i].index : i];
+		cache.setPass(command.pass);
+		cache.useProgram(command.program);
+		cache.bindTexture(command.texture);
+		cache.bindVertexArray(command.vertexArray);
+		cache.draw(command.first, command.count);
+	}
+}
+
+void RenderCommandBuffer::clear()
+{
+	_commands.clear();
+	_sorted = false;
+}
+
+uint64_t RenderCommandBuffer::makeKey(RenderPass pass, uint32_t program, uint32_t texture, float depth)
+{
+	const uint64_t passBits = static_cast<uint64_t>(pass) << 60;
+	const uint64_t programBits = program & 0xfffu;
+	const uint64_t textureBits = texture & 0xffffu;
+	const uint64_t depthBits = depth_bits(depth);
+
+	if (blended(pass))
+		return passBits | (~depthBits & 0xffffffffu) << 28 | programBits << 16 | textureBits;
+	return passBits | programBits << 48 | textureBits << 32 | depthBits;
+}
+
+
+
+MockRenderBackend::MockRenderBackend(bool record) :
+	RenderBackend{},
+	_counters{},
+	_current{},
+	_draws{},
+	_record{ record }
+{}
+
+void MockRenderBackend::useProgram(uint32_t program)
+{
+	++_counters.programs;
+	_current.program = program;
+}
+
+void MockRenderBackend::bindTexture(uint32_t texture)
+{
+	++_counters.textures;
+	_current.texture = texture;
+}
+
+void MockRenderBackend::bindVertexArray(uint32_t vertexArray)
+{
+	++_counters.vertexArrays;
+	_current.vertexArray = vertexArray;
+}
+
+void MockRenderBackend::setDepth(bool test, bool write)
+{
+	++_counters.depthStates;
+	_current.depthTest = test;
+	_current.depthWrite = write;
+}
+
+void MockRenderBackend::setBlend(bool enabled)
+{
+	++_counters.blendStates;
+	_current.blend = enabled;
+}
+
+void MockRenderBackend::draw(uint32_t first, uint32_t count)
+{
+	++_counters.draws;
+	if (_record)
+	{
+		_current.first = first;
+		_current.count = count;
+		_draws.push_back(_current);
+	}
+}
+
+void MockRenderBackend::reset()
+{
+	_counters = {};
+	_draws.clear();
+}
@@ -0,0 +1,156 @@
+#include "engine/section_visibility.h"
+
+#include <cmath>
+
+#include "engine/chunk_map.h"
+
+namespace
+{
+	constexpr int32_t SIZE = ChunkSection::SIZE;
+	constexpr int32_t SECTION_BITS = ChunkSection::SIZE_BITS;
+
+	inline int32_t floor_div(float value, int32_t size) { return static_cast<int32_t>(std::floor(value / size)); }
+}
+
+uint16_t section_visibility::compute(const BlockId* blocks, size_t zStride, size_t yStride, const uint8_t* opaque)
+{
+	// One row of 16 bits along x per (y, z), filled a run at a time and spread to the rows around
+	constexpr int32_t ROWS = SIZE * SIZE;
+	constexpr uint32_t LAST = 1u << (SIZE - 1);
+	uint32_t open[ROWS];
+	uint32_t seen[ROWS] = {};
+	uint32_t stack[ROWS * SIZE];	// Row and bits; pushed bits are marked seen, so each push adds one at least
+	uint16_t connectivity = 0;
+
+	for (int32_t row = 0; row < ROWS; ++row)
+	{
+		const BlockId* line = blocks + (row >> SECTION_BITS) * yStride + (row & (SIZE - 1)) * zStride;
+		uint32_t bits = 0;
+		for (int32_t x = 0; x < SIZE; ++x)
+			bits |= (opaque[line[x]] ? 0u : 1u) << x;
+		open[row] = bits;
+	}
+
+	// Components that touch no face do not matter: fills start from the border only
+	for (int32_t row = 0; row < ROWS && connectivity != ALL_CONNECTED; ++row)
+	{
+		const int32_t y = row >> SECTION_BITS, z = row & (SIZE - 1);
+		const bool borderRow = y == 0 || y == SIZE - 1 || z == 0 || z == SIZE - 1;
+		uint32_t seeds = open[row] & (borderRow ? ~0u : 1u | LAST);
+
+		while ((seeds &= ~seen[row]) != 0)
+		{
+			uint32_t faces = 0;
+			size_t count = 0;
+			seen[row] |= seeds & (0u - seeds);
+			stack[count++] = static_cast<uint32_t>(row) << 16 | (seeds & (0u - seeds));
+			while (count > 0)
+			{
+				const int32_t current = static_cast<int32_t>(stack[--count] >> 16);
+				uint32_t bits = stack[count] & 0xffffu;
+
+				// Whole open run around the bits
+				for (uint32_t grown = bits; ; bits = grown)
+				{
+					grown = (bits | bits << 1 | bits >> 1) & open[current];
+					if (grown == bits)
+						break;
+				}
+				seen[current] |= bits;
+
+				const int32_t cy = current >> SECTION_BITS, cz = current & (SIZE - 1);
+				faces |= (bits & 1u ? 1u : 0u) | (bits & LAST ? 2u : 0u) |
+					(cy == 0 ? 4u : 0u) | (cy == SIZE - 1 ? 8u : 0u) | (cz == 0 ? 16u : 0u) | (cz == SIZE - 1 ? 32u : 0u);
+
+				const int32_t neighbors[4] = {
+					cy > 0 ? current - SIZE : -1, cy < SIZE - 1 ? current + SIZE : -1,
+					cz > 0 ? current - 1 : -1, cz < SIZE - 1 ? current + 1 : -1
+				};
+				for (int32_t next : neighbors)
+				{
+					if (next < 0)
+						continue;
+					const uint32_t spread = bits & open[next] & ~seen[next];
+					if (spread)
+					{
+						seen[next] |= spread;
+						stack[count++] = static_cast<uint32_t>(next) << 16 | spread;
+					}
+				}
+			}
+
+			for (size_t a = 0; a < BLOCK_FACE_COUNT; ++a)
+				for (size_t b = a + 1; b < BLOCK_FACE_COUNT; ++b)
+					if ((faces >> a & 1) && (faces >> b & 1))
+						connectivity |= pairBit(static_cast<BlockFace>(a), static_cast<BlockFace>(b));
+		}
+	}
+	return connectivity;
+}
+
+VisibilityGraph::VisibilityGraph() :
+	_sections{},
+	_queue{},
+	_search{ 0 },
+	_stats{}
+{}
+
+void VisibilityGraph::setSection(const vec3i& section, uint16_t connectivity)
+{
+	Entry& entry = _sections[ChunkMap<Chunk>::pack(section)];
+	entry.connectivity = connectivity;
+}
+
+void VisibilityGraph::removeChunk(const vec3i& chunk)
+{
+	for (int32_t i = 0; i < Chunk::SECTION_COUNT; ++i)
+		_sections.erase(ChunkMap<Chunk>::pack(sectionCoords(chunk, i)));
+}
+
+bool VisibilityGraph::findVisible(const vec3f& eye, int32_t radius, std::vector<vec3i>& visible)
+{
+	_stats = {};
+	_stats.known = _sections.size();
+
+	const vec3i start{ floor_div(eye.x, SIZE), floor_div(eye.y, SIZE), floor_div(eye.z, SIZE) };
+	auto found = _sections.find(ChunkMap<Chunk>::pack(start));
+	if (found == _sections.end())
+		return false;
+
+	// Marks instead of a visited set; skips 0, the mark of new entries
+	if (++_search == 0)
+		++_search;
+	found->second.visited = _search;
+	visible.push_back(start);
+	_queue.clear();
+	_queue.push_back({ start, section_visibility::ALL_CONNECTED, BlockFace::West, 0 });
+
+	for (size_t head = 0; head < _queue.size(); ++head)
+	{
+		const Node node = _queue[head];
+		++_stats.visited;
+
+		for (size_t f = 0; f < BLOCK_FACE_COUNT; ++f)
+		{
+			const BlockFace face = static_cast<BlockFace>(f);
+			if (node.directions & (1u << static_cast<size_t>(section_visibility::opposite(face))))
+				continue;
+			if (head != 0 && !section_visibility::connects(node.connectivity, node.entry, face))
+				continue;
+
+			const vec3i& offset = block_face::OFFSETS[f];
+			const vec3i next{ node.section.x + offset.x, node.section.y + offset.y, node.section.z + offset.z };
+			if (std::abs(next.x - start.x) > radius || std::abs(next.y - start.y) > radius || std::abs(next.z - start.z) > radius)
+				continue;
+
+			auto neighbor = _sections.find(ChunkMap<Chunk>::pack(next));
+			if (neighbor == _sections.end() || neighbor->second.visited == _search)
+				continue;
+
+			neighbor->second.visited = _search;
+			visible.push_back(next);
+			_queue.push_back({ next, neighbor->second.connectivity, section_visibility::opposite(face), static_cast<uint8_t>(node.directions | 1u << f) });
+		}
+	}
+	return true;
+}
@@ -0,0 +1,426 @@
+#include "engine/software_rasterizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RASTERIZER_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	// Directional shading in BlockFace order, then by ambient occlusion level
+	const float FACE_SHADE[BLOCK_FACE_COUNT] = { 0.8f, 0.8f, 0.5f, 1.f, 0.65f, 0.65f };
+	const float AO_SHADE[voxel_vertex::MAX_AO + 1] = { 0.45f, 0.65f, 0.82f, 1.f };
+
+	inline float vertex_shade(const VoxelVertex& v)
+	{
+		const float light = static_cast<float>(std::max(v.skyLight, v.blockLight)) / voxel_vertex::MAX_LIGHT;
+		return FACE_SHADE[static_cast<size_t>(v.face)] * AO_SHADE[v.ao] * (0.2f + 0.8f * light);
+	}
+
+	inline uint32_t modulate(uint32_t a, uint32_t b)
+	{
+		uint32_t result = 0;
+		for (uint32_t shift = 0; shift < 32; shift += 8)
+			result |= ((a >> shift & 0xffu) * (b >> shift & 0xffu) + 127) / 255 << shift;
+		return result;
+	}
+
+	// Scales the color channels by shade, 0 to 1, keeping alpha
+	inline uint32_t shaded(uint32_t color, float shade)
+	{
+		const uint32_t s = static_cast<uint32_t>(shade * 256.f);
+		const uint32_t rb = ((color & 0x00ff00ffu) * s >> 8) & 0x00ff00ffu;
+		const uint32_t g = ((color & 0x0000ff00u) * s >> 8) & 0x0000ff00u;
+		return (color & 0xff000000u) | rb | g;
+	}
+}
+
+SoftwareRasterizer::SoftwareRasterizer(const BlockRegistry& registry, int32_t width, int32_t height, uint32_t threads) :
+	_registry{ registry },
+	_width{ width },
+	_height{ height },
+	_stride{ (width + 3) & ~3 },
+	_tilesX{ (width + TILE_SIZE - 1) / TILE_SIZE },
+	_tilesY{ (height + TILE_SIZE - 1) / TILE_SIZE },
+	_viewport{ Matrix4x4::viewport(static_cast<float>(width), static_cast<float>(height)) },
+	_colors(static_cast<size_t>(_stride) * height, Color::BLACK),
+	_depths(static_cast<size_t>(_stride) * height, 1.f),
+	_palette{},
+	_triangles{},
+	_bins(static_cast<size_t>(_tilesX) * _tilesY),
+	_stats{},
+	_workers{},
+	_lock{},
+	_wake{},
+	_done{},
+	_frame{ 0 },
+	_busy{ 0 },
+	_stopping{ false },
+	_nextTile{ 0 },
+	_pixels{ 0 }
+{
+	_palette.reserve(_registry.getTextureCount());
+	for (size_t i = 0; i < _registry.getTextureCount(); ++i)
+		_palette.emplace_back(defaultTextureColor(static_cast<TextureId>(i)));
+
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	for (uint32_t i = 1; i < threads; ++i)
+		_workers.emplace_back(&SoftwareRasterizer::work, this);
+}
+
+SoftwareRasterizer::~SoftwareRasterizer()
+{
+	{
+		std::lock_guard<std::mutex> lock{ _lock };
+		_stopping = true;
+	}
+	_wake.notify_all();
+	for (std::thread& worker : _workers)
+		worker.join();
+}
+
+void SoftwareRasterizer::setTextureColor(TextureId texture, const Color& color)
+{
+	if (texture >= _palette.size())
+		_palette.resize(static_cast<size_t>(texture) + 1, Color::WHITE);
+	_palette[texture] = color;
+}
+
+void SoftwareRasterizer::clear(const Color& color, float depth)
+{
+	std::fill(_colors.begin(), _colors.end(), color);
+	std::fill(_depths.begin(), _depths.end(), depth);
+	_stats = {};
+}
+
+void SoftwareRasterizer::draw(const ChunkMesh& mesh, const Matrix4x4& viewProjection)
+{
+	const float originX = static_cast<float>(mesh.coords.x * Chunk::SIZE);
+	const float originY = static_cast<float>(mesh.coords.y * Chunk::SIZE);
+	const float originZ = static_cast<float>(mesh.coords.z * Chunk::SIZE);
+	const float (&m)[4][4] = viewProjection.mat;
+	const uint32_t* tints = _registry.tintTable();
+
+	for (size_t q = 0; q < mesh.quads.size(); ++q)
+	{
+		const MeshQuad& quad = mesh.quads[q];
+		ClipVertex corners[4];
+		for (size_t i = 0; i < 4; ++i)
+		{
+			const VoxelVertex v = voxel_vertex::unpack(mesh.vertices[q * 4 + i]);
+			const float x = originX + v.x, y = originY + v.y, z = originZ + v.z;
+			corners[i] = {
+				x * m[0][0] + y * m[1][0] + z * m[2][0] + m[3][0],
+				x * m[0][1] + y * m[1][1] + z * m[2][1] + m[3][1],
+				x * m[0][2] + y * m[1][2] + z * m[2][2] + m[3][2],
+				x * m[0][3] + y * m[1][3] + z * m[2][3] + m[3][3],
+				vertex_shade(v)
+			};
+		}
+
+		const uint32_t base = quad.texture < _palette.size() ? _palette[quad.texture].rgba() : Color::WHITE.rgba();
+		const uint32_t color = modulate(base, tints[quad.block]);
+
+		// The two triangles of voxel_vertex::emitQuad()
+		drawTriangle(corners[0], corners[1], corners[2], color);
+		drawTriangle(corners[0], corners[2], corners[3], color);
+	}
+}
+
+void SoftwareRasterizer::drawTriangle(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2, uint32_t color)
+{
+	++_stats.triangles;
+
+	// Near plane at z = 0 in clip space, as perspectiveFov() maps it
+	const ClipVertex* in[3] = { &v0, &v1, &v2 };
+	const int32_t behind = (v0.z < 0.f) + (v1.z < 0.f) + (v2.z < 0.f);
+	if (behind == 3)
+	{
+		++_stats.culled;
+		return;
+	}
+	if (behind == 0)
+	{
+		setup(v0, v1, v2, color);
+		return;
+	}
+
+	++_stats.clipped;
+	ClipVertex polygon[4];
+	size_t count = 0;
+	for (size_t i = 0; i < 3; ++i)
+	{
+		const ClipVertex& a = *in[i];
+		const ClipVertex& b = *in[(i + 1) % 3];
+		if (a.z >= 0.f)
+			polygon[count++] = a;
+		if ((a.z >= 0.f) != (b.z >= 0.f))
+		{
+			const float t = a.z / (a.z - b.z);
+			polygon[count++] = {
+				a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, 0.f, a.w + (b.w - a.w) * t,
+				a.shade + (b.shade - a.shade) * t
+			};
+		}
+	}
+	for (size_t i = 2; i < count; ++i)
+		setup(polygon[0], polygon[i - 1], polygon[i], color);
+}
+
+void SoftwareRasterizer::setup(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2, uint32_t color)
+{
+	const ClipVertex* in[3] = { &v0, &v1, &v2 };
+	const float (&m)[4][4] = _viewport.mat;
+	float sx[3], sy[3];
+	Triangle t;
+	for (size_t i = 0; i < 3; ++i)
+	{
+		const ClipVertex& v = *in[i];
+		const float invW = 1.f / v.w;
+		const float x = v.x * invW, y = v.y * invW;
+		sx[i] = x * m[0][0] + y * m[1][0] + m[3][0];
+		sy[i] = x * m[0][1] + y * m[1][1] + m[3][1];
+		t.z[i] = v.z * invW;
+		t.shade[i] = v.shade * invW;
+		t.invW[i] = invW;
+	}
+
+	// The viewport flips y: faces counter-clockwise from the outside have a negative area on screen
+	const float area = (sx[1] - sx[0]) * (sy[2] - sy[0]) - (sx[2] - sx[0]) * (sy[1] - sy[0]);
+	// Clamped before the conversion, vertices near the near plane project far off screen
+	const float width = static_cast<float>(_width), height = static_cast<float>(_height);
+	t.minX = static_cast<int32_t>(std::floor(utils::clamp(std::min({ sx[0], sx[1], sx[2] }), 0.f, width)));
+	t.minY = static_cast<int32_t>(std::floor(utils::clamp(std::min({ sy[0], sy[1], sy[2] }), 0.f, height)));
+	t.maxX = std::min(_width - 1, static_cast<int32_t>(std::ceil(utils::clamp(std::max({ sx[0], sx[1], sx[2] }), -1.f, width))));
+	t.maxY = std::min(_height - 1, static_cast<int32_t>(std::ceil(utils::clamp(std::max({ sy[0], sy[1], sy[2] }), -1.f, height))));
+	if (!(area < 0.f) || t.minX > t.maxX || t.minY > t.maxY)
+	{
+		++_stats.culled;
+		return;
+	}
+
+	// Swaps the last two vertices for a positive area, then the edge opposite vertex i goes
+	// from j to k: a = yj - yk, b = xk - xj, c = xj yk - xk yj
+	std::swap(sx[1], sx[2]);
+	std::swap(sy[1], sy[2]);
+	std::swap(t.z[1], t.z[2]);
+	std::swap(t.shade[1], t.shade[2]);
+	std::swap(t.invW[1], t.invW[2]);
+	for (size_t i = 0; i < 3; ++i)
+	{
+		const size_t j = (i + 1) % 3, k = (i + 2) % 3;
+		t.a[i] = sy[j] - sy[k];
+		t.b[i] = sx[k] - sx[j];
+		t.c[i] = sx[j] * sy[k] - sx[k] * sy[j];
+		t.topLeft[i] = t.a[i] > 0.f || (t.a[i] == 0.f && t.b[i] > 0.f);
+	}
+	// Interpolated from vertex 0: depths all lie close to 1, their sum with barycentrics adding
+	// up to 1 only within rounding would lose everything
+	for (float* values : { t.z, t.shade, t.invW })
+	{
+		values[1] -= values[0];
+		values[2] -= values[0];
+	}
+	t.invArea = -1.f / area;
+	t.color = color;
+
+	const uint32_t index = static_cast<uint32_t>(_triangles.size());
+	_triangles.push_back(t);
+	for (int32_t ty = t.minY / TILE_SIZE; ty <= t.maxY / TILE_SIZE; ++ty)
+		for (int32_t tx = t.minX / TILE_SIZE; tx <= t.maxX / TILE_SIZE; ++tx)
+		{
+			_bins[static_cast<size_t>(ty) * _tilesX + tx].push_back(index);
+			++_stats.binned;
+		}
+}
+
+void SoftwareRasterizer::flush()
+{
+	{
+		std::lock_guard<std::mutex> lock{ _lock };
+		_nextTile.store(0, std::memory_order_relaxed);
+		_pixels.store(0, std::memory_order_relaxed);
+		_busy = _workers.size();
+		++_frame;
+	}
+	_wake.notify_all();
+	rasterizeTiles();
+	{
+		std::unique_lock<std::mutex> lock{ _lock };
+		_done.wait(lock, [this]() { return _busy == 0; });
+	}
+
+	_stats.pixels += _pixels.load(std::memory_order_relaxed);
+	_triangles.clear();
+	for (std::vector<uint32_t>& bin : _bins)
+		bin.clear();
+}
+
+void SoftwareRasterizer::rasterizeTiles()
+{
+	size_t pixels = 0;
+	for (;;)
+	{
+		const size_t tile = _nextTile.fetch_add(1, std::memory_order_relaxed);
+		if (tile >= _bins.size())
+			break;
+		pixels += rasterizeTile(tile);
+	}
+	_pixels.fetch_add(pixels, std::memory_order_relaxed);
+}
+
+size_t SoftwareRasterizer::rasterizeTile(size_t tile)
+{
+	const int32_t tileX = static_cast<int32_t>(tile % _tilesX) * TILE_SIZE;
+	const int32_t tileY = static_cast<int32_t>(tile / _tilesX) * TILE_SIZE;
+	size_t pixels = 0;
+
+	for (uint32_t index : _bins[tile])
+	{
+		const Triangle& t = _triangles[index];
+		const int32_t minX = std::max(t.minX, tileX) & ~3;
+		const int32_t maxX = std::min(t.maxX, tileX + TILE_SIZE - 1);
+		const int32_t minY = std::max(t.minY, tileY);
+		const int32_t maxY = std::min(t.maxY, tileY + TILE_SIZE - 1);
+
+		for (int32_t y = minY; y <= maxY; ++y)
+		{
+			const float py = static_cast<float>(y) + 0.5f;
+			const float row[3] = { t.b[0] * py + t.c[0], t.b[1] * py + t.c[1], t.b[2] * py + t.c[2] };
+			Color* colors = _colors.data() + static_cast<size_t>(y) * _stride;
+			float* depths = _depths.data() + static_cast<size_t>(y) * _stride;
+
+			for (int32_t x = minX; x <= maxX; x += 4)
+			{
+				// Pixels of the block covered and in front, one bit each
+				uint32_t mask;
+				alignas(16) float shade[4];
+#ifdef RASTERIZER_SSE2
+				const __m128 zero = _mm_setzero_ps();
+				const __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f));
+				__m128 e[3];
+				__m128 inside = _mm_castsi128_ps(_mm_cmplt_epi32(
+					_mm_add_epi32(_mm_set1_epi32(x), _mm_set_epi32(3, 2, 1, 0)), _mm_set1_epi32(_width)));
+				for (size_t i = 0; i < 3; ++i)
+				{
+					e[i] = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.a[i]), px), _mm_set1_ps(row[i]));
+					__m128 edge = _mm_cmpgt_ps(e[i], zero);
+					if (t.topLeft[i])
+						edge = _mm_or_ps(edge, _mm_cmpeq_ps(e[i], zero));
+					inside = _mm_and_ps(inside, edge);
+				}
+				if (_mm_movemask_ps(inside) == 0)
+					continue;
+
+				const __m128 invArea = _mm_set1_ps(t.invArea);
+				const __m128 l1 = _mm_mul_ps(e[1], invArea), l2 = _mm_mul_ps(e[2], invArea);
+				auto interpolate = [&](const float* values) {
+					return _mm_add_ps(_mm_set1_ps(values[0]), _mm_add_ps(_mm_mul_ps(l1, _mm_set1_ps(values[1])), _mm_mul_ps(l2, _mm_set1_ps(values[2]))));
+				};
+
+				const __m128 z = interpolate(t.z);
+				const __m128 previous = _mm_loadu_ps(depths + x);
+				inside = _mm_and_ps(inside, _mm_cmplt_ps(z, previous));
+				mask = static_cast<uint32_t>(_mm_movemask_ps(inside));
+				if (mask == 0)
+					continue;
+
+				_mm_storeu_ps(depths + x, _mm_or_ps(_mm_and_ps(inside, z), _mm_andnot_ps(inside, previous)));
+				_mm_store_ps(shade, _mm_div_ps(interpolate(t.shade), interpolate(t.invW)));
+#else
+				mask = 0;
+				for (int32_t k = 0; k < 4; ++k)
+				{
+					const float px = static_cast<float>(x + k) + 0.5f;
+					float e[3];
+					bool inside = x + k < _width;
+					for (size_t i = 0; i < 3; ++i)
+					{
+						e[i] = t.a[i] * px + row[i];
+						inside = inside && (e[i] > 0.f || (e[i] == 0.f && t.topLeft[i]));
+					}
+					if (!inside)
+						continue;
+
+					const float l1 = e[1] * t.invArea, l2 = e[2] * t.invArea;
+					const float z = t.z[0] + (l1 * t.z[1] + l2 * t.z[2]);
+					if (!(z < depths[x + k]))
+						continue;
+
+					depths[x + k] = z;
+					shade[k] = (t.shade[0] + (l1 * t.shade[1] + l2 * t.shade[2])) / (t.invW[0] + (l1 * t.invW[1] + l2 * t.invW[2]));
+					mask |= 1u << k;
+				}
+#endif
+				for (int32_t k = 0; k < 4; ++k)
+				{
+					if (mask >> k & 1)
+					{
+						colors[x + k].rgba(shaded(t.color, utils::clamp(shade[k], 0.f, 1.f)));
+						++pixels;
+					}
+				}
+			}
+		}
+	}
+	return pixels;
+}
+
+void SoftwareRasterizer::work()
+{
+	uint64_t frame = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock{ _lock };
+			_wake.wait(lock, [this, frame]() { return _stopping || _frame != frame; });
+			if (_stopping)
+				return;
+			frame = _frame;
+		}
+
+		rasterizeTiles();
+
+		std::lock_guard<std::mutex> lock{ _lock };
+		if (--_busy == 0)
+			_done.notify_one();
+	}
+}
+
+vec3f SoftwareRasterizer::defaultTextureColor(TextureId texture)
+{
+	const float hue = std::fmod(static_cast<float>(texture) * 0.618034f, 1.f) * 6.f;
+	auto channel = [hue](float offset) { return 0.35f + 0.5f * utils::clamp(std::fabs(std::fmod(hue + offset, 6.f) - 3.f) - 1.f, 0.f, 1.f); };
+	return { channel(0.f), channel(4.f), channel(2.f) };
+}
+
+bool SoftwareRasterizer::savePPM(const std::string& path) const
+{
+	std::ofstream out{ path, std::ios::binary };
+	if (!out)
+	{
+		std::cerr << "Rasterizer error: cannot write " << path << std::endl;
+		return false;
+	}
+
+	out << "P6\n" << _width << " " << _height << "\n255\n";
+	std::vector<char> line(static_cast<size_t>(_width) * 3);
+	for (int32_t y = 0; y < _height; ++y)
+	{
+		for (int32_t x = 0; x < _width; ++x)
+		{
+			const Color& color = getColor(x, y);
+			line[x * 3] = static_cast<char>(color.getRed());
+			line[x * 3 + 1] = static_cast<char>(color.getGreen());
+			line[x * 3 + 2] = static_cast<char>(color.getBlue());
+		}
+		out.write(line.data(), static_cast<std::streamsize>(line.size()));
+	}
+	return static_cast<bool>(out);
+}
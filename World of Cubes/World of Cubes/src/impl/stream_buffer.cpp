@@ -0,0 +1,146 @@
+#include "support/stream_buffer.h"
+
+#include <opengl/glew.h>
+#include <algorithm>
+#include <iostream>
+
+namespace
+{
+	// Waits are short: the GPU only has to finish a frame it already has
+	constexpr GLuint64 WAIT_STEP = 1000000;		// In nanoseconds
+
+	inline size_t align_up(size_t value, size_t alignment) { return (value + alignment - 1) & ~(alignment - 1); }
+}
+
+StreamBuffer::StreamBuffer() :
+	_buffer{ 0 },
+	_mapped{ nullptr },
+	_regionSize{ 0 },
+	_region{ 0 },
+	_head{ 0 },
+	_allocations{ 0 },
+	_failed{ 0 },
+	_fences{},
+	_uniformAlignment{ 256 },
+	_stats{},
+	_clock{}
+{}
+
+StreamBuffer::~StreamBuffer()
+{
+	destroy();
+}
+
+bool StreamBuffer::create(size_t regionSize)
+{
+	destroy();
+	if (!GLEW_ARB_buffer_storage && !GLEW_VERSION_4_4)
+	{
+		std::cerr << "StreamBuffer error: persistent mapping is not supported" << std::endl;
+		return false;
+	}
+
+	GLint alignment = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	_uniformAlignment = alignment > 0 ? static_cast<size_t>(alignment) : 256;
+	_regionSize = align_up(regionSize, _uniformAlignment);
+
+	// The copy target leaves the array and element buffer bindings alone
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	const GLsizeiptr size = static_cast<GLsizeiptr>(_regionSize * REGIONS);
+	glGenBuffers(1, &_buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, _buffer);
+	glBufferStorage(GL_COPY_WRITE_BUFFER, size, nullptr, flags);
+	_mapped = static_cast<uint8_t*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags));
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	if (!_mapped)
+	{
+		std::cerr << "StreamBuffer error: cannot map " << size << " bytes" << std::endl;
+		destroy();
+		return false;
+	}
+
+	_region = REGIONS - 1;
+	_head.store(_regionSize, std::memory_order_relaxed);
+	_stats = {};
+	return true;
+}
+
+void StreamBuffer::destroy()
+{
+	for (void*& fence : _fences)
+		if (fence)
+		{
+			glDeleteSync(static_cast<GLsync>(fence));
+			fence = nullptr;
+		}
+
+	if (_buffer)
+	{
+		// Deleting a buffer unmaps it
+		glDeleteBuffers(1, &_buffer);
+		_buffer = 0;
+	}
+	_mapped = nullptr;
+	_regionSize = 0;
+}
+
+void StreamBuffer::beginFrame()
+{
+	_region = (_region + 1) % REGIONS;
+	++_stats.frames;
+
+	void*& fence = _fences[_region];
+	if (fence)
+	{
+		GLsync sync = static_cast<GLsync>(fence);
+		GLenum status = glClientWaitSync(sync, 0, 0);
+		if (status == GL_TIMEOUT_EXPIRED)
+		{
+			++_stats.waits;
+			_clock.reset();
+			do
+				status = glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, WAIT_STEP);
+			while (status == GL_TIMEOUT_EXPIRED);
+			_stats.waitTime += _clock.getElapsedTime();
+		}
+		if (status == GL_WAIT_FAILED)
+			std::cerr << "StreamBuffer error: fence wait failed, the region is reused anyway" << std::endl;
+
+		glDeleteSync(sync);
+		fence = nullptr;
+	}
+
+	_head.store(0, std::memory_order_relaxed);
+	_allocations.store(0, std::memory_order_relaxed);
+	_failed.store(0, std::memory_order_relaxed);
+}
+
+void StreamBuffer::endFrame()
+{
+	_fences[_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	_stats.allocated = std::min(_head.load(std::memory_order_relaxed), _regionSize);
+	_stats.allocations = _allocations.load(std::memory_order_relaxed);
+	_stats.failed = _failed.load(std::memory_order_relaxed);
+}
+
+StreamRange StreamBuffer::allocate(size_t size, size_t alignment)
+{
+	// Bump allocation shared by the writing threads
+	size_t head = _head.load(std::memory_order_relaxed);
+	size_t start;
+	do
+	{
+		start = align_up(head, alignment);
+		if (start + size > _regionSize)
+		{
+			_failed.fetch_add(1, std::memory_order_relaxed);
+			return { nullptr, 0, 0 };
+		}
+	} while (!_head.compare_exchange_weak(head, start + size, std::memory_order_relaxed));
+
+	_allocations.fetch_add(1, std::memory_order_relaxed);
+	const size_t offset = static_cast<size_t>(_region) * _regionSize + start;
+	return { _mapped + offset, offset, size };
+}
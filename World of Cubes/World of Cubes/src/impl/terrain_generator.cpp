@@ -0,0 +1,131 @@
+#include "engine/terrain_generator.h"
+
+#include <cmath>
+
+#include "engine/block_registry.h"
+#include "support/bits.h"
+
+namespace
+{
+	inline float lattice(int32_t x, int32_t y, int32_t z, uint64_t seed)
+	{
+		uint64_t h = bits::mix64(seed ^ (static_cast<uint64_t>(static_cast<uint32_t>(x)) * 0x9e3779b97f4a7c15ULL) ^
+			(static_cast<uint64_t>(static_cast<uint32_t>(y)) * 0xc2b2ae3d27d4eb4fULL) ^
+			(static_cast<uint64_t>(static_cast<uint32_t>(z)) * 0x165667b19e3779f9ULL));
+		return static_cast<float>(h >> 40) * (1.0f / 16777216.0f);
+	}
+
+	inline float smooth(float t) { return t * t * (3.0f - 2.0f * t); }
+	inline float lerp(float a, float b, float t) { return a + (b - a) * t; }
+}
+
+TerrainGenerator::TerrainGenerator(const BlockRegistry& registry, uint64_t seed) :
+	_seed{ seed },
+	_stone{ registry.find("stone") },
+	_dirt{ registry.find("dirt", _stone) },
+	_grass{ registry.find("grass", _dirt) },
+	_sand{ registry.find("sand", _dirt) },
+	_water{ registry.find("water") },
+	_bedrock{ registry.find("bedrock", _stone) },
+	_snow{ registry.find("snow", _grass) }
+{}
+
+void TerrainGenerator::generate(Chunk& chunk) const
+{
+	const vec3i origin = Chunk::origin(chunk.getCoords());
+
+	int32_t heights[Chunk::AREA];
+	int32_t maxHeight = SEA_LEVEL;
+	for (int32_t z = 0; z < Chunk::SIZE; ++z)
+		for (int32_t x = 0; x < Chunk::SIZE; ++x)
+		{
+			int32_t h = getHeight(origin.x + x, origin.z + z);
+			heights[z * Chunk::SIZE + x] = h;
+			if (h > maxHeight)
+				maxHeight = h;
+		}
+
+	for (int32_t s = 0; s < Chunk::SECTION_COUNT; ++s)
+	{
+		const vec3i sectionOrigin = Chunk::sectionOrigin(s);
+		const int32_t baseY = origin.y + sectionOrigin.y;
+		if (baseY > maxHeight || baseY + ChunkSection::SIZE <= 0)
+		{
+			chunk.clearSection(s);
+			continue;
+		}
+
+		BlockId* blocks = chunk.editSection(s);
+		for (int32_t y = 0; y < ChunkSection::SIZE; ++y)
+			for (int32_t z = 0; z < ChunkSection::SIZE; ++z)
+				for (int32_t x = 0; x < ChunkSection::SIZE; ++x)
+				{
+					const int32_t wx = origin.x + sectionOrigin.x + x;
+					const int32_t wy = baseY + y;
+					const int32_t wz = origin.z + sectionOrigin.z + z;
+					const int32_t height = heights[(sectionOrigin.z + z) * Chunk::SIZE + sectionOrigin.x + x];
+
+					BlockId id = blocks::AIR;
+					if (wy <= 0)
+						id = _bedrock;
+					else if (wy > height)
+						id = wy <= SEA_LEVEL ? _water : blocks::AIR;
+					else if (isCave(wx, wy, wz))
+						id = blocks::AIR;
+					else if (wy == height)
+						id = height <= SEA_LEVEL + 1 ? _sand : (height > SEA_LEVEL + 48 ? _snow : _grass);
+					else if (wy > height - 4)
+						id = height <= SEA_LEVEL + 1 ? _sand : _dirt;
+					else id = _stone;
+
+					blocks[ChunkSection::index(x, y, z)] = id;
+				}
+	}
+}
+
+int32_t TerrainGenerator::getHeight(int32_t x, int32_t z) const
+{
+	float fx = static_cast<float>(x), fz = static_cast<float>(z);
+	float continent = noise2(fx / 256.0f, fz / 256.0f, 1);
+	float hills = noise2(fx / 64.0f, fz / 64.0f, 2);
+	float detail = noise2(fx / 16.0f, fz / 16.0f, 3);
+
+	float height = (continent - 0.45f) * 80.0f + hills * 24.0f + detail * 4.0f;
+	return SEA_LEVEL + static_cast<int32_t>(std::floor(height));
+}
+
+float TerrainGenerator::noise2(float x, float z, uint64_t salt) const
+{
+	const float fx = std::floor(x), fz = std::floor(z);
+	const int32_t ix = static_cast<int32_t>(fx), iz = static_cast<int32_t>(fz);
+	const float tx = smooth(x - fx), tz = smooth(z - fz);
+	const uint64_t seed = _seed + salt;
+
+	return lerp(
+		lerp(lattice(ix, 0, iz, seed), lattice(ix + 1, 0, iz, seed), tx),
+		lerp(lattice(ix, 0, iz + 1, seed), lattice(ix + 1, 0, iz + 1, seed), tx),
+		tz);
+}
+
+float TerrainGenerator::noise3(float x, float y, float z, uint64_t salt) const
+{
+	const float fx = std::floor(x), fy = std::floor(y), fz = std::floor(z);
+	const int32_t ix = static_cast<int32_t>(fx), iy = static_cast<int32_t>(fy), iz = static_cast<int32_t>(fz);
+	const float tx = smooth(x - fx), ty = smooth(y - fy), tz = smooth(z - fz);
+	const uint64_t seed = _seed + salt;
+
+	float c00 = lerp(lattice(ix, iy, iz, seed), lattice(ix + 1, iy, iz, seed), tx);
+	float c10 = lerp(lattice(ix, iy + 1, iz, seed), lattice(ix + 1, iy + 1, iz, seed), tx);
+	float c01 = lerp(lattice(ix, iy, iz + 1, seed), lattice(ix + 1, iy, iz + 1, seed), tx);
+	float c11 = lerp(lattice(ix, iy + 1, iz + 1, seed), lattice(ix + 1, iy + 1, iz + 1, seed), tx);
+	return lerp(lerp(c00, c10, ty), lerp(c01, c11, ty), tz);
+}
+
+bool TerrainGenerator::isCave(int32_t x, int32_t y, int32_t z) const
+{
+	if (y < 4)
+		return false;
+
+	float n = noise3(x / 24.0f, y / 16.0f, z / 24.0f, 4);
+	return n > 0.72f;
+}
@@ -0,0 +1,360 @@
+#include "engine/voxel_dag.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <thread>
+#include <utility>
+
+size_t VoxelDAG::NodeHash::operator() (const Node& node) const
+{
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (NodeRef ref : node.children)
+	{
+		hash ^= ref;
+		hash *= 0x100000001b3ull;
+		hash ^= hash >> 29;
+	}
+	return static_cast<size_t>(hash);
+}
+
+bool VoxelDAG::NodeEqual::operator() (const Node& n0, const Node& n1) const
+{
+	return std::equal(n0.children, n0.children + 8, n1.children);
+}
+
+VoxelDAG::NodeRef VoxelDAG::Builder::intern(const Node& node)
+{
+	NodeRef first = node.children[0];
+	if (isUniform(first) && std::all_of(node.children + 1, node.children + 8, [first](NodeRef ref) { return ref == first; }))
+		return first;
+
+	auto result = lookup.emplace(node, static_cast<NodeRef>(nodes.size()));
+	if (result.second)
+		nodes.push_back(node);
+	return result.first->second;
+}
+
+
+
+VoxelDAG::VoxelDAG() :
+	VoxelDAG{ {}, 0 }
+{}
+
+VoxelDAG::VoxelDAG(const vec3i& originChunk, uint32_t chunksPerSideLog2) :
+	_originChunk{ originChunk },
+	_chunksLog2{ chunksPerSideLog2 },
+	_levels{ chunksPerSideLog2 + Chunk::SIZE_BITS },
+	_root{ uniform(blocks::AIR) },
+	_data{}
+{}
+
+void VoxelDAG::insertChunk(const Chunk& chunk)
+{
+	const vec3i& coords = chunk.getCoords();
+	vec3i offset = { coords.x - _originChunk.x, coords.y - _originChunk.y, coords.z - _originChunk.z };
+	int32_t side = 1 << _chunksLog2;
+	if (offset.x < 0 || offset.y < 0 || offset.z < 0 || offset.x >= side || offset.y >= side || offset.z >= side)
+		return;
+
+	Builder local;
+	NodeRef chunkRoot = buildChunk(local, chunk, 0, 0, 0, Chunk::SIZE);
+
+	std::vector<NodeRef> remap;
+	merge(_data, local, remap);
+	if (!isUniform(chunkRoot))
+		chunkRoot = remap[chunkRoot];
+
+	_root = replace(_root, _levels, Chunk::origin(offset), Chunk::SIZE_BITS, chunkRoot);
+}
+
+BlockId VoxelDAG::getBlock(const vec3i& blockPos) const
+{
+	vec3i local;
+	if (!toLocal(blockPos, local))
+		return blocks::AIR;
+
+	uint32_t level;
+	return uniformBlock(findUniform(local, level));
+}
+
+void VoxelDAG::setBlock(const vec3i& blockPos, BlockId id)
+{
+	vec3i local;
+	if (toLocal(blockPos, local))
+		_root = replace(_root, _levels, local, 0, uniform(id));
+}
+
+VoxelDAG::RayHit VoxelDAG::raycast(const vec3f& origin, const vec3f& direction, float maxDistance) const
+{
+	RayHit result{ false, {}, {}, blocks::AIR, 0.f };
+
+	float len = static_cast<float>(direction.length());
+	if (len <= 0.f)
+		return result;
+
+	const vec3i base = getOrigin();
+	const float side = static_cast<float>(getSideLength());
+	const float o[3] = { origin.x - base.x, origin.y - base.y, origin.z - base.z };
+	const float d[3] = { direction.x / len, direction.y / len, direction.z / len };
+	constexpr float inf = std::numeric_limits<float>::infinity();
+
+	// Clip the ray against the DAG bounds, the entry face giving the normal of a hit on the first cell
+	float tmin = 0.f, tmax = maxDistance;
+	int entryAxis = -1;
+	for (int a = 0; a < 3; ++a)
+	{
+		if (d[a] == 0.f)
+		{
+			if (o[a] < 0.f || o[a] >= side)
+				return result;
+			continue;
+		}
+		float t0 = (0.f - o[a]) / d[a];
+		float t1 = (side - o[a]) / d[a];
+		if (t0 > t1)
+			std::swap(t0, t1);
+		if (t0 > tmin)
+		{
+			tmin = t0;
+			entryAxis = a;
+		}
+		tmax = std::min(tmax, t1);
+	}
+	if (tmin > tmax)
+		return result;
+
+	const int32_t iside = getSideLength();
+	float t = tmin;
+	vec3i cell, normal;
+	for (int a = 0; a < 3; ++a)
+		cell[a] = utils::clamp(static_cast<int32_t>(std::floor(o[a] + d[a] * t)), 0, iside - 1);
+	// A ray starting inside the volume crosses no face to its first cell
+	if (entryAxis >= 0)
+		normal[entryAxis] = d[entryAxis] > 0.f ? -1 : 1;
+
+	const int32_t maxSteps = iside * 6;
+	for (int32_t step = 0; step < maxSteps; ++step)
+	{
+		uint32_t level;
+		NodeRef ref = findUniform(cell, level);
+		if (uniformBlock(ref) != blocks::AIR)
+		{
+			result.hit = true;
+			result.position = { cell.x + base.x, cell.y + base.y, cell.z + base.z };
+			result.normal = normal;
+			result.block = uniformBlock(ref);
+			result.distance = t;
+			return result;
+		}
+
+		// Skip the whole empty node at once
+		const int32_t size = 1 << level;
+		const int32_t mask = ~(size - 1);
+		const int32_t nodeMin[3] = { cell.x & mask, cell.y & mask, cell.z & mask };
+
+		float exit = inf;
+		int axis = 0;
+		for (int a = 0; a < 3; ++a)
+		{
+			if (d[a] == 0.f)
+				continue;
+			float bound = static_cast<float>(d[a] > 0.f ? nodeMin[a] + size : nodeMin[a]);
+			float ta = (bound - o[a]) / d[a];
+			if (ta < exit)
+			{
+				exit = ta;
+				axis = a;
+			}
+		}
+		if (exit > tmax)
+			return result;
+
+		t = std::max(t, exit);
+		for (int a = 0; a < 3; ++a)
+		{
+			if (a == axis)
+				cell[a] = d[a] > 0.f ? nodeMin[a] + size : nodeMin[a] - 1;
+			else cell[a] = utils::clamp(static_cast<int32_t>(std::floor(o[a] + d[a] * t)), nodeMin[a], nodeMin[a] + size - 1);
+		}
+		if (cell[axis] < 0 || cell[axis] >= iside)
+			return result;
+
+		normal = {};
+		normal[axis] = d[axis] > 0.f ? -1 : 1;
+	}
+
+	return result;
+}
+
+void VoxelDAG::compact()
+{
+	Builder compacted;
+	std::vector<NodeRef> remap(_data.nodes.size(), UNIFORM_FLAG);
+
+	std::function<NodeRef(NodeRef)> copy = [&](NodeRef ref) -> NodeRef {
+		if (isUniform(ref))
+			return ref;
+		if (remap[ref] != UNIFORM_FLAG)
+			return remap[ref];
+
+		Node node = _data.nodes[ref];
+		for (NodeRef& child : node.children)
+			child = copy(child);
+		return remap[ref] = compacted.intern(node);
+	};
+
+	_root = copy(_root);
+	_data = std::move(compacted);
+}
+
+size_t VoxelDAG::getDenseMemoryUsage() const
+{
+	size_t side = static_cast<size_t>(getSideLength());
+	return side * side * side * sizeof(BlockId);
+}
+
+VoxelDAG VoxelDAG::build(const vec3i& originChunk, uint32_t chunksPerSideLog2, const ChunkProvider& provider, unsigned int threads)
+{
+	VoxelDAG dag{ originChunk, chunksPerSideLog2 };
+
+	const int32_t side = 1 << chunksPerSideLog2;
+	const size_t total = static_cast<size_t>(side) * side * side;
+
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	threads = static_cast<unsigned int>(std::min<size_t>(threads, total));
+
+	std::vector<Builder> builders(threads);
+	std::vector<NodeRef> roots(total, uniform(blocks::AIR));
+	std::vector<unsigned int> owners(total, 0);
+	std::atomic<size_t> next{ 0 };
+
+	// Chunks are built independently into per-thread tables, then merged serially
+	auto work = [&](unsigned int thread) {
+		for (size_t i = next++; i < total; i = next++)
+		{
+			vec3i offset = {
+				static_cast<int32_t>(i % side),
+				static_cast<int32_t>((i / side) % side),
+				static_cast<int32_t>(i / (static_cast<size_t>(side) * side))
+			};
+			const Chunk* chunk = provider(originChunk + offset);
+			if (chunk)
+			{
+				roots[i] = buildChunk(builders[thread], *chunk, 0, 0, 0, Chunk::SIZE);
+				owners[i] = thread;
+			}
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (unsigned int t = 1; t < threads; ++t)
+		workers.emplace_back(work, t);
+	work(0);
+	for (std::thread& worker : workers)
+		worker.join();
+
+	std::vector<std::vector<NodeRef>> remaps(threads);
+	for (unsigned int t = 0; t < threads; ++t)
+	{
+		merge(dag._data, builders[t], remaps[t]);
+		builders[t] = {};
+	}
+
+	for (size_t i = 0; i < total; ++i)
+		if (!isUniform(roots[i]))
+			roots[i] = remaps[owners[i]][roots[i]];
+
+	dag._root = dag.buildTop(roots, chunksPerSideLog2);
+	return dag;
+}
+
+bool VoxelDAG::toLocal(const vec3i& blockPos, vec3i& local) const
+{
+	const vec3i base = getOrigin();
+	const int32_t side = getSideLength();
+	local = { blockPos.x - base.x, blockPos.y - base.y, blockPos.z - base.z };
+	return local.x >= 0 && local.y >= 0 && local.z >= 0 && local.x < side && local.y < side && local.z < side;
+}
+
+VoxelDAG::NodeRef VoxelDAG::replace(NodeRef node, uint32_t level, const vec3i& local, uint32_t targetLevel, NodeRef replacement)
+{
+	if (level == targetLevel)
+		return replacement;
+
+	Node copy;
+	if (isUniform(node))
+		std::fill(copy.children, copy.children + 8, node);
+	else copy = _data.nodes[node];
+
+	uint32_t child = childIndex(local, level - 1);
+	copy.children[child] = replace(copy.children[child], level - 1, local, targetLevel, replacement);
+	return _data.intern(copy);
+}
+
+VoxelDAG::NodeRef VoxelDAG::findUniform(const vec3i& local, uint32_t& level) const
+{
+	NodeRef ref = _root;
+	level = _levels;
+	while (!isUniform(ref))
+	{
+		--level;
+		ref = _data.nodes[ref].children[childIndex(local, level)];
+	}
+	return ref;
+}
+
+VoxelDAG::NodeRef VoxelDAG::buildTop(std::vector<NodeRef>& grid, uint32_t sideLog2)
+{
+	for (int32_t side = 1 << sideLog2; side > 1; side >>= 1)
+	{
+		const int32_t half = side >> 1;
+		std::vector<NodeRef> upper(static_cast<size_t>(half) * half * half);
+		for (int32_t z = 0; z < half; ++z)
+			for (int32_t y = 0; y < half; ++y)
+				for (int32_t x = 0; x < half; ++x)
+				{
+					Node node;
+					for (int32_t c = 0; c < 8; ++c)
+					{
+						int32_t cx = x * 2 + (c & 1), cy = y * 2 + ((c >> 1) & 1), cz = z * 2 + ((c >> 2) & 1);
+						node.children[c] = grid[(static_cast<size_t>(cz) * side + cy) * side + cx];
+					}
+					upper[(static_cast<size_t>(z) * half + y) * half + x] = _data.intern(node);
+				}
+		grid = std::move(upper);
+	}
+	return grid.front();
+}
+
+VoxelDAG::NodeRef VoxelDAG::buildChunk(Builder& builder, const Chunk& chunk, int32_t x, int32_t y, int32_t z, int32_t size)
+{
+	Node node;
+	if (size == 2)
+	{
+		for (int32_t c = 0; c < 8; ++c)
+			node.children[c] = uniform(chunk.getBlock(x + (c & 1), y + ((c >> 1) & 1), z + ((c >> 2) & 1)));
+		return builder.intern(node);
+	}
+
+	const int32_t half = size >> 1;
+	for (int32_t c = 0; c < 8; ++c)
+		node.children[c] = buildChunk(builder, chunk, x + (c & 1) * half, y + ((c >> 1) & 1) * half, z + ((c >> 2) & 1) * half, half);
+	return builder.intern(node);
+}
+
+void VoxelDAG::merge(Builder& target, const Builder& source, std::vector<NodeRef>& remap)
+{
+	// Children are always interned before their parents, so one forward pass suffices
+	remap.resize(source.nodes.size());
+	for (size_t i = 0; i < source.nodes.size(); ++i)
+	{
+		Node node = source.nodes[i];
+		for (NodeRef& child : node.children)
+			if (!isUniform(child))
+				child = remap[child];
+		remap[i] = target.intern(node);
+	}
+}
@@ -0,0 +1,56 @@
+#include "engine/voxel_vertex.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <utility>
+
+#include "engine/chunk_mesher.h"
+
+namespace
+{
+	// Sign of the cross product of the face-plane axes, see block_face, along the face axis
+	const int32_t UV_SIGN[3] = { -1, -1, 1 };
+}
+
+void voxel_vertex::corners(const MeshQuad& quad, uint8_t out[4][3])
+{
+	const int32_t axis = static_cast<int32_t>(quad.face) / 2;
+	const bool positive = (static_cast<int32_t>(quad.face) & 1) != 0;
+
+	uint8_t base[3] = { quad.x, quad.y, quad.z };
+	if (positive)
+		++base[axis];
+
+	for (int32_t i = 0; i < 4; ++i)
+		for (int32_t c = 0; c < 3; ++c)
+			out[i][c] = base[c];
+	out[1][block_face::U_AXIS[axis]] += quad.width;
+	out[2][block_face::U_AXIS[axis]] += quad.width;
+	out[2][block_face::V_AXIS[axis]] += quad.height;
+	out[3][block_face::V_AXIS[axis]] += quad.height;
+}
+
+void voxel_vertex::emitQuad(const MeshQuad& quad, const uint8_t ao[4], const uint8_t skyLight[4], const uint8_t blockLight[4], std::vector<PackedVertex>& out)
+{
+	const int32_t axis = static_cast<int32_t>(quad.face) / 2;
+	const bool positive = (static_cast<int32_t>(quad.face) & 1) != 0;
+
+	uint8_t positions[4][3];
+	corners(quad, positions);
+
+	// u, v is clockwise from outside on half of the faces
+	int32_t order[4] = { 0, 1, 2, 3 };
+	if (UV_SIGN[axis] * (positive ? 1 : -1) < 0)
+		std::swap(order[1], order[3]);
+
+	// Quads are split along the diagonal from their first vertex: start from the other one if its
+	// ends are closer in brightness, so that AO and light gradients stay symmetric
+	int32_t brightness[4];
+	for (int32_t i = 0; i < 4; ++i)
+		brightness[i] = ao[i] * 5 + std::max(skyLight[i], blockLight[i]);
+	if (std::abs(brightness[0] - brightness[2]) > std::abs(brightness[1] - brightness[3]))
+		std::rotate(order, order + 1, order + 4);
+
+	for (int32_t i : order)
+		out.push_back(pack({ positions[i][0], positions[i][1], positions[i][2], quad.face, ao[i], quad.texture, skyLight[i], blockLight[i] }));
+}
@@ -0,0 +1,80 @@
+#include "engine/world.h"
+
+#include <iterator>
+
+World::World(const BlockRegistry* registry) :
+	_chunks{},
+	_dirty{},
+	_evicted{},
+	_heights{ registry ? new Heightmaps{ *registry } : nullptr }
+{}
+
+bool World::addChunk(std::unique_ptr<Chunk> chunk, bool dirty)
+{
+	const vec3i coords = chunk->getCoords();
+	const Chunk* added = chunk.get();
+	if (!_chunks.insert(coords, std::move(chunk)))
+		return false;
+
+	if (_heights)
+		_heights->addChunk(*added);
+	if (dirty)
+		markDirty(coords);
+	return true;
+}
+
+bool World::removeChunk(const vec3i& coords)
+{
+	Chunk* chunk = _chunks.find(coords);
+	if (!chunk)
+		return false;
+
+	if (_dirty.erase(ChunkMap<Chunk>::pack(coords)))
+		_evicted.push_back(chunk->snapshot());
+	if (_heights)
+		_heights->removeChunk(coords);
+	return _chunks.erase(coords);
+}
+
+BlockId World::getBlock(const vec3i& position) const
+{
+	const Chunk* chunk = _chunks.find(Chunk::chunkCoords(position));
+	return chunk ? chunk->getBlock(Chunk::localCoords(position)) : blocks::AIR;
+}
+
+bool World::setBlock(const vec3i& position, BlockId id)
+{
+	const vec3i coords = Chunk::chunkCoords(position);
+	Chunk* chunk = _chunks.find(coords);
+	if (!chunk)
+		return false;
+
+	const vec3i local = Chunk::localCoords(position);
+	const BlockId previous = chunk->getBlock(local);
+	chunk->setBlock(local, id);
+	if (_heights && previous != id)
+		_heights->update(*chunk, local, previous);
+	markDirty(coords);
+	return true;
+}
+
+void World::markDirty(const vec3i& coords)
+{
+	_dirty.insert(ChunkMap<Chunk>::pack(coords));
+}
+
+size_t World::collectDirty(std::vector<ChunkSnapshot>& out)
+{
+	const size_t start = out.size();
+	out.reserve(start + _dirty.size() + _evicted.size());
+
+	out.insert(out.end(), std::make_move_iterator(_evicted.begin()), std::make_move_iterator(_evicted.end()));
+	_evicted.clear();
+
+	for (uint64_t key : _dirty)
+		if (const Chunk* chunk = _chunks.find(ChunkMap<Chunk>::unpack(key)))
+			out.push_back(chunk->snapshot());
+	_dirty.clear();
+
+	return out.size() - start;
+}
@@ -0,0 +1,237 @@
+#include "engine/world_saver.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <unordered_map>
+
+#include "engine/world.h"
+#include "support/clock.h"
+
+WorldSaver::WorldSaver(RegionStorage& storage, const std::string& journalPath, ChunkCompression compression) :
+	_storage{ storage },
+	_journalPath{ journalPath },
+	_journal{},
+	_compression{ compression },
+	_batchDelay{ Time::milliseconds(50) },
+	_thread{},
+	_lock{},
+	_wake{},
+	_done{},
+	_pending{},
+	_submitted{ 0 },
+	_completed{ 0 },
+	_flushing{ false },
+	_running{ false },
+	_failed{ false },
+	_stats{},
+	_handoff{},
+	_payloads{}
+{}
+
+WorldSaver::~WorldSaver() { stop(); }
+
+bool WorldSaver::recover()
+{
+	if (!openJournal())
+		return false;
+	if (_journal.size() == 0)
+		return true;
+
+	bool ok = true;
+	_journal.replay([this, &ok](const vec3i& coords, uint64_t version, ChunkCompression compression, const uint8_t* payload, size_t size) {
+		RegionFile* region = _storage.getRegion(RegionFile::regionCoords(coords), true);
+		ok = region && region->writeRecord(RegionFile::localCoords(coords), payload, size, compression, version) && ok;
+	});
+
+	return ok && checkpoint();
+}
+
+bool WorldSaver::start()
+{
+	if (_running)
+		return true;
+	if (!openJournal())
+		return false;
+
+	_running = true;
+	_thread = std::thread{ &WorldSaver::run, this };
+	return true;
+}
+
+void WorldSaver::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock{ _lock };
+		if (!_running)
+			return;
+		_running = false;
+	}
+	_wake.notify_all();
+	_thread.join();
+}
+
+void WorldSaver::submit(ChunkSnapshot snapshot)
+{
+	{
+		std::lock_guard<std::mutex> lock{ _lock };
+		_pending.push_back(std::move(snapshot));
+		++_submitted;
+	}
+	_wake.notify_one();
+}
+
+void WorldSaver::submit(std::vector<ChunkSnapshot>& snapshots)
+{
+	if (snapshots.empty())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock{ _lock };
+		_submitted += snapshots.size();
+		if (_pending.empty())
+			_pending.swap(snapshots);
+		else _pending.insert(_pending.end(), std::make_move_iterator(snapshots.begin()), std::make_move_iterator(snapshots.end()));
+	}
+	snapshots.clear();
+	_wake.notify_one();
+}
+
+Time WorldSaver::autosave(World& world)
+{
+	Clock clock;
+	world.collectDirty(_handoff);
+	submit(_handoff);
+	Time stall = clock.getElapsedTime();
+
+	std::lock_guard<std::mutex> lock{ _lock };
+	_stats.lastStall = stall;
+	return stall;
+}
+
+bool WorldSaver::flush()
+{
+	std::unique_lock<std::mutex> lock{ _lock };
+	if (!_running)
+		return !_failed && _completed == _submitted;
+
+	const uint64_t ticket = _submitted;
+	_flushing = true;
+	_wake.notify_one();
+	_done.wait(lock, [this, ticket]() { return _completed >= ticket; });
+	_flushing = false;
+	return !_failed;
+}
+
+SaveStats WorldSaver::getStats() const
+{
+	std::lock_guard<std::mutex> lock{ _lock };
+	return _stats;
+}
+
+void WorldSaver::run()
+{
+	std::vector<ChunkSnapshot> batch;
+	std::unique_lock<std::mutex> lock{ _lock };
+	for (;;)
+	{
+		_wake.wait(lock, [this]() { return !_pending.empty() || !_running; });
+		if (_pending.empty())
+			break;
+
+		// Give the rest of the batch a chance to arrive so that it shares one journal sync
+		if (_running && !_flushing)
+			_wake.wait_for(lock, std::chrono::microseconds{ _batchDelay.asMicroseconds() }, [this]() { return !_running || _flushing; });
+
+		batch.swap(_pending);
+		const uint64_t ticket = _submitted;
+		lock.unlock();
+
+		bool ok = save(batch);
+		batch.clear();
+
+		lock.lock();
+		_failed = _failed || !ok;
+		_completed = ticket;
+		_done.notify_all();
+	}
+	lock.unlock();
+
+	if (!checkpoint())
+	{
+		lock.lock();
+		_failed = true;
+	}
+}
+
+bool WorldSaver::save(std::vector<ChunkSnapshot>& batch)
+{
+	Clock clock;
+
+	// Only the newest snapshot of every chunk is worth writing
+	std::unordered_map<uint64_t, size_t> latest;
+	latest.reserve(batch.size());
+	for (size_t i = 0; i < batch.size(); ++i)
+		latest[ChunkMap<Chunk>::pack(batch[i].getCoords())] = i;
+
+	std::vector<size_t> order;
+	order.reserve(latest.size());
+	for (const auto& entry : latest)
+		order.push_back(entry.second);
+	std::sort(order.begin(), order.end());
+
+	if (_payloads.size() < order.size())
+		_payloads.resize(order.size());
+
+	for (size_t i = 0; i < order.size(); ++i)
+	{
+		const ChunkSnapshot& chunk = batch[order[i]];
+		chunk_io::encode(chunk, _compression, _payloads[i]);
+		_journal.append(chunk.getCoords(), chunk.getVersion(), _compression, _payloads[i].data(), _payloads[i].size());
+	}
+	if (!_journal.commit())
+		return false;
+
+	bool ok = true;
+	for (size_t i = 0; i < order.size(); ++i)
+	{
+		const ChunkSnapshot& chunk = batch[order[i]];
+		RegionFile* region = _storage.getRegion(RegionFile::regionCoords(chunk.getCoords()), true);
+		ok = region && region->writeRecord(RegionFile::localCoords(chunk.getCoords()), _payloads[i].data(), _payloads[i].size(), _compression, chunk.getVersion()) && ok;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock{ _lock };
+		_stats.chunks += order.size();
+		++_stats.batches;
+		_stats.lastBatch = clock.getElapsedTime();
+	}
+
+	return ok && (_journal.size() < CHECKPOINT_BYTES || checkpoint());
+}
+
+bool WorldSaver::openJournal()
+{
+	if (_journal.isOpen())
+		return true;
+
+	File::createDirectory(_storage.getDirectory());
+	return _journal.open(_journalPath);
+}
+
+bool WorldSaver::checkpoint()
+{
+	// After a failed region write the journal is the only complete copy, keep it for recover()
+	{
+		std::lock_guard<std::mutex> lock{ _lock };
+		if (_failed)
+			return false;
+	}
+
+	if (!_storage.syncAll() || !_journal.reset())
+		return false;
+
+	std::lock_guard<std::mutex> lock{ _lock };
+	++_stats.checkpoints;
+	return true;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * Offline measurements of the engine subsystems, started with "--bench <name> [args...]".
+ * Results are printed to stdout.
+ */
+namespace bench
+{
+	// False for unknown benchmarks or when a benchmark fails
+	bool run(const std::string& name, const std::vector<std::string>& args);
+
+	void list();
+
+	// Saves a generated 32x32 chunk area to region files, then reloads it cold and warm
+	bool region_load(const std::string& directory);
+
+	// Compression ratio and encode/decode throughput of every chunk codec on generated terrain
+	bool chunk_codec();
+
+	// Main thread stall per autosave while the saver thread journals and writes the chunks
+	bool autosave(const std::string& directory);
+
+	// Cold reads of every chunk record through AsyncIO, against one blocking read per chunk
+	bool async_io(const std::string& directory, uint32_t queueDepth);
+
+	// Per-frame streaming cost and how far ahead the world is ready while flying in a straight line
+	bool streaming(float speed);
+
+	// Greedy mesher cost and quad count per chunk on generated terrain
+	bool meshing();
+
+	// Time from a block edit until the remeshed sections are uploaded, and the sections it rebuilds
+	bool remeshing(uint32_t edits);
+
+	// Quads and memory per chunk at each level of detail, and the quads of growing view distances
+	bool lod(int32_t fullRadius);
+
+	// Software rasterizer time per frame circling a generated area, saving the last frame if a path is given
+	bool render(uint32_t threads, const std::string& imagePath);
+
+	// Chunks culled by the occlusion culler walking through generated terrain, checked against the unculled image
+	bool occlusion(size_t occluders);
+
+	// Sections reached by the cave culling search underground and above, checked against drawing every section
+	bool caves(int32_t radius);
+
+	// State changes submitting a frame of draws through the command buffer, unsorted and sorted, on a mock backend
+	bool commands(size_t draws);
+
+	// Per-frame upload of chunk meshes and uniforms through glBufferSubData and through the persistent-mapped stream buffer; opens an OpenGL window
+	bool uploads(size_t meshes);
+
+	// Building the block texture array and its mips, against loading it from the cache, with checks of the filter
+	bool textures(uint32_t size, uint32_t threads);
+
+	// Invalid GL calls reported through the debug output queue, and the cost per call of polling glGetError against it; opens an OpenGL window
+	bool gl_debug(size_t calls);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+typedef uint16_t BlockEntityType;
+
+/*
+ * Extra per-block data (inventories, sign text, orientation...) for the few blocks of a chunk
+ * that need it, kept in a vector sorted by the Y-major block index.
+ * The payload is opaque to the storage; its meaning depends on the entity type.
+ */
+class BlockEntities
+{
+public:
+	struct Entry
+	{
+		uint16_t index;
+		BlockEntityType type;
+		std::vector<uint8_t> data;
+	};
+
+private:
+	std::vector<Entry> _entries;
+
+public:
+	BlockEntities() = default;
+	BlockEntities(const BlockEntities&) = default;
+	BlockEntities(BlockEntities&&) noexcept = default;
+
+	BlockEntities& operator= (const BlockEntities&) = default;
+	BlockEntities& operator= (BlockEntities&&) noexcept = default;
+
+	inline size_t size() const { return _entries.size(); }
+	inline bool empty() const { return _entries.empty(); }
+
+	const Entry* find(uint16_t index) const;
+	Entry* find(uint16_t index);
+
+	// Replaces any entity already at that index
+	Entry& set(uint16_t index, BlockEntityType type, const uint8_t* data = nullptr, size_t size = 0);
+	bool erase(uint16_t index);
+	inline void clear() { _entries.clear(); }
+
+	inline std::vector<Entry>::const_iterator begin() const { return _entries.begin(); }
+	inline std::vector<Entry>::const_iterator end() const { return _entries.end(); }
+	inline std::vector<Entry>::iterator begin() { return _entries.begin(); }
+	inline std::vector<Entry>::iterator end() { return _entries.end(); }
+
+private:
+	std::vector<Entry>::const_iterator lowerBound(uint16_t index) const;
+};
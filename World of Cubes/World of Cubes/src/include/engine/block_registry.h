@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include <support/color.h>
+#include "chunk.h"
+
+enum class BlockFace : uint8_t
+{
+	West = 0,	// -X
+	East,		// +X
+	Bottom,		// -Y
+	Top,		// +Y
+	North,		// -Z
+	South		// +Z
+};
+
+constexpr size_t BLOCK_FACE_COUNT = 6;
+
+namespace block_face
+{
+	// Offsets of the neighbor through each face, in BlockFace order
+	const vec3i OFFSETS[BLOCK_FACE_COUNT] = {
+		{ -1, 0, 0 }, { 1, 0, 0 }, { 0, -1, 0 }, { 0, 1, 0 }, { 0, 0, -1 }, { 0, 0, 1 }
+	};
+
+	// Axes of the face plane for faces along each axis, see MeshQuad
+	const int32_t U_AXIS[3] = { 2, 0, 0 };
+	const int32_t V_AXIS[3] = { 1, 2, 1 };
+
+	// Position of the face-plane cell (u, v) of a layer along an axis
+	inline vec3i cell_position(int32_t axis, int32_t layer, int32_t u, int32_t v)
+	{
+		switch (axis)
+		{
+			case 0: return { layer, v, u };
+			case 1: return { u, layer, v };
+			default: return { u, v, layer };
+		}
+	}
+}
+
+enum class CollisionShape : uint8_t
+{
+	None = 0,
+	Cube,
+	Slab,
+	Cross
+};
+
+typedef uint16_t TextureId;
+
+/*
+ * Block properties compiled into one flat array per property, indexed by BlockId.
+ * Definitions come from JSON; the compiled tables can be cached in a binary file that is
+ * reused as long as the JSON source does not change.
+ */
+class BlockRegistry
+{
+public:
+	static constexpr uint32_t CACHE_VERSION = 1;
+
+private:
+	std::vector<std::string> _names;
+	std::unordered_map<std::string, BlockId> _ids;
+	std::vector<std::string> _textureNames;
+
+	std::vector<uint8_t> _solid;
+	std::vector<uint8_t> _opaque;
+	std::vector<uint8_t> _lightEmission;
+	std::vector<uint32_t> _tint;
+	std::vector<CollisionShape> _collision;
+	std::vector<TextureId> _textures;
+
+public:
+	BlockRegistry();
+	BlockRegistry(const BlockRegistry&) = default;
+	BlockRegistry(BlockRegistry&&) noexcept = default;
+
+	BlockRegistry& operator= (const BlockRegistry&) = default;
+	BlockRegistry& operator= (BlockRegistry&&) noexcept = default;
+
+	// Uses cachePath when it was compiled from the current definitions, rebuilding it otherwise
+	bool load(const std::string& definitionsPath, const std::string& cachePath);
+
+	bool loadDefinitions(const std::string& path);
+	bool parseDefinitions(const std::string& json);
+
+	bool loadCache(const std::string& path, uint64_t sourceHash);
+	bool saveCache(const std::string& path, uint64_t sourceHash) const;
+
+	void clear();
+
+	inline size_t size() const { return _names.size(); }
+	inline size_t getTextureCount() const { return _textureNames.size(); }
+
+	BlockId find(const std::string& name, BlockId defaultId = blocks::AIR) const;
+	inline const std::string& getName(BlockId id) const { return _names[id]; }
+	inline const std::string& getTextureName(TextureId id) const { return _textureNames[id]; }
+
+	inline bool isSolid(BlockId id) const { return _solid[id] != 0; }
+	inline bool isOpaque(BlockId id) const { return _opaque[id] != 0; }
+	inline uint8_t getLightEmission(BlockId id) const { return _lightEmission[id]; }
+	inline Color getTint(BlockId id) const { return Color{ _tint[id] }; }
+	inline CollisionShape getCollisionShape(BlockId id) const { return _collision[id]; }
+	inline TextureId getTexture(BlockId id, BlockFace face) const { return _textures[id * BLOCK_FACE_COUNT + static_cast<size_t>(face)]; }
+
+	// Raw tables for hot loops
+	inline const uint8_t* solidTable() const { return _solid.data(); }
+	inline const uint8_t* opaqueTable() const { return _opaque.data(); }
+	inline const uint8_t* lightEmissionTable() const { return _lightEmission.data(); }
+	inline const uint32_t* tintTable() const { return _tint.data(); }
+	inline const TextureId* textureTable() const { return _textures.data(); }
+
+	static uint64_t hashSource(const std::string& text);
+
+private:
+	BlockId add(const std::string& name);
+
+	TextureId internTexture(const std::string& name);
+};
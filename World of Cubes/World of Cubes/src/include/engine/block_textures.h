@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <support/color.h>
+#include <support/time.h>
+#include "block_registry.h"
+
+struct BlockTexturesStats
+{
+	// During the last load()
+	size_t loaded;			// Layers read from a source image
+	size_t generated;		// Placeholders for missing or unreadable sources
+	bool fromCache;
+	Time readTime;			// Sources read and hashed
+	Time decodeTime;
+	Time filterTime;
+	Time cacheTime;			// Loading or saving the cache
+};
+
+/*
+ * The block textures packed in a 2D texture array, with their mip chains.
+ * Layer i holds the texture TextureId i of the registry, so that meshes reference a texture by
+ * its layer alone (see PackedVertex). Sources are <directory>/<name>.png, square and of the
+ * size of the array; missing ones get a placeholder colored like in SoftwareRasterizer.
+ * Mips are filtered on the CPU, each level a 2x2 box of the previous one: in linear space, the
+ * colors weighted by alpha so that cutout edges do not darken, with the 4 channels in one SIMD
+ * register. Layers are split between threads. The chain is cached in a file reused as long as
+ * the sources, their names and the size hash the same, so startup does not filter.
+ */
+class BlockTextures
+{
+public:
+	static constexpr uint32_t CACHE_VERSION = 1;
+
+private:
+	const BlockRegistry& _registry;
+	uint32_t _size;
+	uint32_t _levelCount;
+	std::vector<std::vector<Color>> _levels;	// The layers of each level one after the other
+	BlockTexturesStats _stats;
+
+public:
+	// size is a power of 2
+	explicit BlockTextures(const BlockRegistry& registry, uint32_t size = 16);
+	BlockTextures(const BlockTextures&) = delete;
+	BlockTextures& operator= (const BlockTextures&) = delete;
+
+	// Uses cachePath when it was built from the current sources, rebuilding it otherwise;
+	// false only when nothing could be built
+	bool load(const std::string& directory, const std::string& cachePath, uint32_t threads = 0);
+
+	// Every level from level 0
+	void generateMips(uint32_t threads = 0);
+
+	bool loadCache(const std::string& path, uint32_t sourceHash);
+	bool saveCache(const std::string& path, uint32_t sourceHash) const;
+
+	// Creates a GL_TEXTURE_2D_ARRAY with the whole chain in sRGB; 0 on failure
+	uint32_t upload() const;
+
+	inline uint32_t getSize(uint32_t level = 0) const { return _size >> level; }
+	inline uint32_t getLevelCount() const { return _levelCount; }
+	inline size_t getLayerCount() const { return _registry.getTextureCount(); }
+	inline Color* getLayer(uint32_t level, size_t layer) { return _levels[level].data() + layer * getSize(level) * getSize(level); }
+	inline const Color* getLayer(uint32_t level, size_t layer) const { return _levels[level].data() + layer * getSize(level) * getSize(level); }
+	inline const BlockTexturesStats& getStats() const { return _stats; }
+
+	// Halves a square texture into target
+	static void downsample(const Color* source, uint32_t sourceSize, Color* target);
+
+	static Color placeholder(TextureId texture, uint32_t x, uint32_t y);
+
+private:
+	void allocate();
+};
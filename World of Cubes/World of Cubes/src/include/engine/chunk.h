@@ -0,0 +1,212 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <memory>
+
+#include <support/vectors.h>
+#include "block_entities.h"
+
+typedef uint16_t BlockId;
+
+namespace blocks
+{
+	constexpr BlockId AIR = 0;
+}
+
+class SlabPool;
+
+/*
+ * 16^3 block storage shared between a chunk and its snapshots.
+ * Sections are reference counted and never written while shared: the owning chunk clones
+ * them on its first write after a snapshot was taken.
+ */
+struct ChunkSection
+{
+	static constexpr int32_t SIZE_BITS = 4;
+	static constexpr int32_t SIZE = 1 << SIZE_BITS;
+	static constexpr int32_t MASK = SIZE - 1;
+	static constexpr int32_t VOLUME = SIZE * SIZE * SIZE;
+
+	std::atomic<uint32_t> refs;
+	bool pooled;
+	BlockId blocks[VOLUME];
+
+	static ChunkSection* create(BlockId fillId);
+	static ChunkSection* clone(const ChunkSection& section);
+
+	static inline void acquire(ChunkSection* section) { if (section) section->refs.fetch_add(1, std::memory_order_relaxed); }
+	static void release(ChunkSection* section);
+
+	static SlabPool& pool();
+
+	static inline size_t index(int32_t x, int32_t y, int32_t z)
+	{
+		return static_cast<size_t>(((y & MASK) << (SIZE_BITS * 2)) | ((z & MASK) << SIZE_BITS) | (x & MASK));
+	}
+};
+
+
+class ChunkSnapshot;
+
+class Chunk
+{
+public:
+	static constexpr int32_t SIZE_BITS = 5;
+	static constexpr int32_t SIZE = 1 << SIZE_BITS;
+	static constexpr int32_t MASK = SIZE - 1;
+	static constexpr int32_t AREA = SIZE * SIZE;
+	static constexpr int32_t VOLUME = SIZE * SIZE * SIZE;
+
+	static constexpr int32_t SECTIONS_PER_AXIS = SIZE / ChunkSection::SIZE;
+	static constexpr int32_t SECTION_COUNT = SECTIONS_PER_AXIS * SECTIONS_PER_AXIS * SECTIONS_PER_AXIS;
+
+private:
+	vec3i _coords;
+	uint64_t _version;
+	ChunkSection* _sections[SECTION_COUNT];
+	std::shared_ptr<BlockEntities> _entities;
+
+public:
+	explicit Chunk(const vec3i& coords = {});
+	Chunk(const Chunk& c);
+	Chunk(Chunk&& c) noexcept;
+	~Chunk();
+
+	Chunk& operator= (const Chunk& c);
+	Chunk& operator= (Chunk&& c) noexcept;
+
+	inline const vec3i& getCoords() const { return _coords; }
+
+	// Increases on every modification
+	inline uint64_t getVersion() const { return _version; }
+
+	inline BlockId getBlock(int32_t x, int32_t y, int32_t z) const
+	{
+		const ChunkSection* section = _sections[sectionIndex(x, y, z)];
+		return section ? section->blocks[ChunkSection::index(x, y, z)] : blocks::AIR;
+	}
+	inline BlockId getBlock(const vec3i& local) const { return getBlock(local.x, local.y, local.z); }
+
+	void setBlock(int32_t x, int32_t y, int32_t z, BlockId id);
+	inline void setBlock(const vec3i& local, BlockId id) { setBlock(local.x, local.y, local.z, id); }
+
+	void fill(BlockId id);
+
+	bool isEmpty() const;
+
+	// Null for sections that are entirely air
+	inline const ChunkSection* getSection(int32_t index) const { return _sections[index]; }
+
+	// Writable blocks of a section for bulk edits, detached from any snapshot
+	BlockId* editSection(int32_t index);
+	void clearSection(int32_t index);
+
+	// Null while the chunk has no block entities.
+	// Changing the block under an entity through setBlock() or fill() removes the entity.
+	inline const BlockEntities* getEntities() const { return _entities.get(); }
+	const BlockEntities::Entry* getEntity(int32_t x, int32_t y, int32_t z) const;
+	inline const BlockEntities::Entry* getEntity(const vec3i& local) const { return getEntity(local.x, local.y, local.z); }
+
+	BlockEntities::Entry& setEntity(const vec3i& local, BlockEntityType type, const uint8_t* data = nullptr, size_t size = 0);
+	bool removeEntity(const vec3i& local);
+
+	// Writable entities, detached from any snapshot and created if needed
+	BlockEntities& editEntities();
+	void clearEntities();
+
+	ChunkSnapshot snapshot() const;
+
+
+	// Y-major layout: consecutive x first, then z, then y
+	static inline size_t index(int32_t x, int32_t y, int32_t z)
+	{
+		return static_cast<size_t>((y << (SIZE_BITS * 2)) | (z << SIZE_BITS) | x);
+	}
+	static inline size_t index(const vec3i& local) { return index(local.x, local.y, local.z); }
+
+	static inline vec3i position(size_t index)
+	{
+		return {
+			static_cast<int32_t>(index) & MASK,
+			static_cast<int32_t>(index >> (SIZE_BITS * 2)) & MASK,
+			static_cast<int32_t>(index >> SIZE_BITS) & MASK
+		};
+	}
+
+	static inline int32_t sectionIndex(int32_t x, int32_t y, int32_t z)
+	{
+		constexpr int32_t shift = ChunkSection::SIZE_BITS;
+		return ((y >> shift) * SECTIONS_PER_AXIS + (z >> shift)) * SECTIONS_PER_AXIS + (x >> shift);
+	}
+
+	static inline vec3i sectionOrigin(int32_t index)
+	{
+		return {
+			(index % SECTIONS_PER_AXIS) * ChunkSection::SIZE,
+			(index / (SECTIONS_PER_AXIS * SECTIONS_PER_AXIS)) * ChunkSection::SIZE,
+			((index / SECTIONS_PER_AXIS) % SECTIONS_PER_AXIS) * ChunkSection::SIZE
+		};
+	}
+
+	static inline vec3i chunkCoords(const vec3i& blockPos)
+	{
+		return { blockPos.x >> SIZE_BITS, blockPos.y >> SIZE_BITS, blockPos.z >> SIZE_BITS };
+	}
+
+	static inline vec3i localCoords(const vec3i& blockPos)
+	{
+		return { blockPos.x & MASK, blockPos.y & MASK, blockPos.z & MASK };
+	}
+
+	static inline vec3i origin(const vec3i& chunkCoords)
+	{
+		return { chunkCoords.x * SIZE, chunkCoords.y * SIZE, chunkCoords.z * SIZE };
+	}
+
+private:
+	void releaseSections();
+};
+
+
+/*
+ * Immutable, version-stamped view of a chunk at the time it was taken.
+ * Taking one only bumps the section reference counts; it is safe to read from any thread
+ * while the owning chunk keeps being modified.
+ */
+class ChunkSnapshot
+{
+private:
+	vec3i _coords;
+	uint64_t _version;
+	ChunkSection* _sections[Chunk::SECTION_COUNT];
+	std::shared_ptr<const BlockEntities> _entities;
+
+public:
+	ChunkSnapshot();
+	ChunkSnapshot(const ChunkSnapshot& s);
+	ChunkSnapshot(ChunkSnapshot&& s) noexcept;
+	~ChunkSnapshot();
+
+	ChunkSnapshot& operator= (const ChunkSnapshot& s);
+	ChunkSnapshot& operator= (ChunkSnapshot&& s) noexcept;
+
+	inline const vec3i& getCoords() const { return _coords; }
+	inline uint64_t getVersion() const { return _version; }
+
+	inline BlockId getBlock(int32_t x, int32_t y, int32_t z) const
+	{
+		const ChunkSection* section = _sections[Chunk::sectionIndex(x, y, z)];
+		return section ? section->blocks[ChunkSection::index(x, y, z)] : blocks::AIR;
+	}
+	inline BlockId getBlock(const vec3i& local) const { return getBlock(local.x, local.y, local.z); }
+
+	inline const ChunkSection* getSection(int32_t index) const { return _sections[index]; }
+
+	// Null when the chunk had no block entities
+	inline const BlockEntities* getEntities() const { return _entities.get(); }
+
+	bool isEmpty() const;
+
+	friend class Chunk;
+};
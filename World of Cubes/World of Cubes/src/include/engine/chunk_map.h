@@ -0,0 +1,314 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define WOC_CHUNK_MAP_SSE2
+#include <emmintrin.h>
+#endif
+
+#include <support/vectors.h>
+#include <support/bits.h>
+#include <support/epoch.h>
+
+/*
+ * Open addressing hash map from chunk coordinates to owned values.
+ * Slots are probed 16 at a time through a control byte per slot (7 hash bits or EMPTY/DELETED).
+ * find() is lock-free and must run inside an epoch::Guard; insert/erase are serialized between
+ * writers but never block readers. Erased slots stay tombstones until the next rehash(), and
+ * erased values and replaced tables are reclaimed through epochs.
+ */
+template<typename _Ty>
+class ChunkMap
+{
+public:
+	static constexpr size_t GROUP_SIZE = 16;
+
+private:
+	static constexpr uint8_t EMPTY = 0x80;
+	static constexpr uint8_t DELETED = 0xfe;
+
+	struct Table
+	{
+		size_t capacity;
+		size_t groupMask;
+		size_t tombstones;
+		std::unique_ptr<std::atomic<uint8_t>[]> control;
+		std::unique_ptr<std::atomic<uint64_t>[]> keys;
+		std::unique_ptr<std::atomic<_Ty*>[]> values;
+
+		explicit Table(size_t capacity);
+	};
+
+	std::atomic<Table*> _table;
+	std::atomic<size_t> _size;
+	std::mutex _writeLock;
+
+public:
+	explicit ChunkMap(size_t initialCapacity = 1024);
+	~ChunkMap();
+
+	ChunkMap(const ChunkMap&) = delete;
+	ChunkMap& operator= (const ChunkMap&) = delete;
+
+	_Ty* find(const vec3i& coords) const;
+	inline bool contains(const vec3i& coords) const { return find(coords) != nullptr; }
+
+	bool insert(const vec3i& coords, std::unique_ptr<_Ty> value);
+	bool erase(const vec3i& coords);
+
+	inline size_t size() const { return _size.load(std::memory_order_relaxed); }
+	inline bool empty() const { return size() == 0; }
+	inline size_t capacity() const { return _table.load(std::memory_order_acquire)->capacity; }
+
+	template<typename _Func>
+	void forEach(_Func action) const;
+
+	static inline uint64_t pack(const vec3i& coords)
+	{
+		return (static_cast<uint64_t>(coords.x & 0x1fffff) << 42) |
+			(static_cast<uint64_t>(coords.y & 0x1fffff) << 21) |
+			static_cast<uint64_t>(coords.z & 0x1fffff);
+	}
+
+	static inline vec3i unpack(uint64_t key)
+	{
+		auto extend = [](uint64_t v) { return static_cast<int32_t>(static_cast<uint32_t>(v << 11)) >> 11; };
+		return { extend((key >> 42) & 0x1fffff), extend((key >> 21) & 0x1fffff), extend(key & 0x1fffff) };
+	}
+
+private:
+	static inline uint32_t match(const Table& table, size_t group, uint8_t tag);
+
+	void rehash(size_t newCapacity);
+
+	static void place(Table& table, uint64_t key, uint64_t hash, _Ty* value);
+};
+
+
+
+/* Implementation */
+
+template<typename _Ty>
+ChunkMap<_Ty>::Table::Table(size_t capacity) :
+	capacity{ capacity },
+	groupMask{ capacity / GROUP_SIZE - 1 },
+	tombstones{ 0 },
+	control{ new std::atomic<uint8_t>[capacity] },
+	keys{ new std::atomic<uint64_t>[capacity] },
+	values{ new std::atomic<_Ty*>[capacity] }
+{
+	for (size_t i = 0; i < capacity; ++i)
+	{
+		control[i].store(EMPTY, std::memory_order_relaxed);
+		keys[i].store(0, std::memory_order_relaxed);
+		values[i].store(nullptr, std::memory_order_relaxed);
+	}
+}
+
+template<typename _Ty>
+ChunkMap<_Ty>::ChunkMap(size_t initialCapacity) :
+	_table{ nullptr },
+	_size{ 0 },
+	_writeLock{}
+{
+	size_t capacity = GROUP_SIZE;
+	while (capacity < initialCapacity)
+		capacity <<= 1;
+	_table.store(new Table{ capacity });
+}
+
+template<typename _Ty>
+ChunkMap<_Ty>::~ChunkMap()
+{
+	Table* table = _table.load();
+	for (size_t i = 0; i < table->capacity; ++i)
+		delete table->values[i].load(std::memory_order_relaxed);
+	delete table;
+}
+
+template<typename _Ty>
+inline uint32_t ChunkMap<_Ty>::match(const Table& table, size_t group, uint8_t tag)
+{
+	const std::atomic<uint8_t>* ctrl = table.control.get() + group * GROUP_SIZE;
+#ifdef WOC_CHUNK_MAP_SSE2
+	// Control bytes are single byte lock-free atomics, loaded here as one 16-byte vector
+	__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(static_cast<char>(tag)))));
+#else
+	uint32_t mask = 0;
+	for (size_t i = 0; i < GROUP_SIZE; ++i)
+		if (ctrl[i].load(std::memory_order_acquire) == tag)
+			mask |= 1u << i;
+	return mask;
+#endif
+}
+
+template<typename _Ty>
+_Ty* ChunkMap<_Ty>::find(const vec3i& coords) const
+{
+	const uint64_t key = pack(coords);
+	const uint64_t hash = bits::mix64(key);
+	const uint8_t tag = static_cast<uint8_t>(hash & 0x7f);
+
+	const Table& table = *_table.load(std::memory_order_acquire);
+	size_t group = static_cast<size_t>(hash >> 7) & table.groupMask;
+	for (size_t probe = 1; probe <= table.groupMask + 1; ++probe)
+	{
+		for (uint32_t mask = match(table, group, tag); mask; mask &= mask - 1)
+		{
+			size_t slot = group * GROUP_SIZE + bits::ctz32(mask);
+			if (table.keys[slot].load(std::memory_order_acquire) == key)
+			{
+				_Ty* value = table.values[slot].load(std::memory_order_acquire);
+				if (value)
+					return value;
+			}
+		}
+		if (match(table, group, EMPTY))
+			return nullptr;
+		group = (group + probe) & table.groupMask;
+	}
+	return nullptr;
+}
+
+template<typename _Ty>
+bool ChunkMap<_Ty>::insert(const vec3i& coords, std::unique_ptr<_Ty> value)
+{
+	if (!value)
+		return false;
+
+	const uint64_t key = pack(coords);
+	const uint64_t hash = bits::mix64(key);
+	const uint8_t tag = static_cast<uint8_t>(hash & 0x7f);
+
+	std::lock_guard<std::mutex> lock{ _writeLock };
+
+	Table* table = _table.load(std::memory_order_relaxed);
+	size_t target = table->capacity;
+	size_t group = static_cast<size_t>(hash >> 7) & table->groupMask;
+	for (size_t probe = 1; probe <= table->groupMask + 1; ++probe)
+	{
+		for (uint32_t mask = match(*table, group, tag); mask; mask &= mask - 1)
+		{
+			size_t slot = group * GROUP_SIZE + bits::ctz32(mask);
+			if (table->keys[slot].load(std::memory_order_relaxed) == key)
+				return false;
+		}
+
+		// Tombstones are never reused while readers may run: one still matching the erased key
+		// would read the new value. rehash() is what reclaims them
+		uint32_t free = match(*table, group, EMPTY);
+		if (free)
+		{
+			target = group * GROUP_SIZE + bits::ctz32(free);
+			break;
+		}
+		group = (group + probe) & table->groupMask;
+	}
+
+	if (target == table->capacity || (_size + table->tombstones + 1) * 8 > table->capacity * 7)
+	{
+		rehash(_size * 2 >= table->capacity / 2 ? table->capacity * 2 : table->capacity);
+		place(*_table.load(std::memory_order_relaxed), key, hash, value.release());
+	}
+	else
+	{
+		table->values[target].store(value.release(), std::memory_order_release);
+		table->keys[target].store(key, std::memory_order_release);
+		table->control[target].store(tag, std::memory_order_release);
+	}
+
+	_size.fetch_add(1, std::memory_order_relaxed);
+	return true;
+}
+
+template<typename _Ty>
+bool ChunkMap<_Ty>::erase(const vec3i& coords)
+{
+	const uint64_t key = pack(coords);
+	const uint64_t hash = bits::mix64(key);
+	const uint8_t tag = static_cast<uint8_t>(hash & 0x7f);
+
+	std::lock_guard<std::mutex> lock{ _writeLock };
+
+	Table* table = _table.load(std::memory_order_relaxed);
+	size_t group = static_cast<size_t>(hash >> 7) & table->groupMask;
+	for (size_t probe = 1; probe <= table->groupMask + 1; ++probe)
+	{
+		for (uint32_t mask = match(*table, group, tag); mask; mask &= mask - 1)
+		{
+			size_t slot = group * GROUP_SIZE + bits::ctz32(mask);
+			if (table->keys[slot].load(std::memory_order_relaxed) == key)
+			{
+				table->control[slot].store(DELETED, std::memory_order_release);
+				_Ty* value = table->values[slot].exchange(nullptr, std::memory_order_acq_rel);
+				++table->tombstones;
+				_size.fetch_sub(1, std::memory_order_relaxed);
+				epoch::retire(value);
+				return true;
+			}
+		}
+		if (match(*table, group, EMPTY))
+			return false;
+		group = (group + probe) & table->groupMask;
+	}
+	return false;
+}
+
+template<typename _Ty> template<typename _Func>
+void ChunkMap<_Ty>::forEach(_Func action) const
+{
+	const Table& table = *_table.load(std::memory_order_acquire);
+	for (size_t i = 0; i < table.capacity; ++i)
+	{
+		if (table.control[i].load(std::memory_order_acquire) & EMPTY)
+			continue;
+
+		_Ty* value = table.values[i].load(std::memory_order_acquire);
+		if (value)
+			action(unpack(table.keys[i].load(std::memory_order_acquire)), *value);
+	}
+}
+
+template<typename _Ty>
+void ChunkMap<_Ty>::rehash(size_t newCapacity)
+{
+	Table* old = _table.load(std::memory_order_relaxed);
+	Table* table = new Table{ newCapacity };
+	for (size_t i = 0; i < old->capacity; ++i)
+	{
+		if (old->control[i].load(std::memory_order_relaxed) & EMPTY)
+			continue;
+
+		uint64_t key = old->keys[i].load(std::memory_order_relaxed);
+		place(*table, key, bits::mix64(key), old->values[i].load(std::memory_order_relaxed));
+	}
+
+	// Readers still probing the old table keep it alive through their epoch guard
+	_table.store(table, std::memory_order_release);
+	epoch::retire(old);
+}
+
+template<typename _Ty>
+void ChunkMap<_Ty>::place(Table& table, uint64_t key, uint64_t hash, _Ty* value)
+{
+	size_t group = static_cast<size_t>(hash >> 7) & table.groupMask;
+	for (size_t probe = 1;; ++probe)
+	{
+		uint32_t free = match(table, group, EMPTY);
+		if (free)
+		{
+			size_t slot = group * GROUP_SIZE + bits::ctz32(free);
+			table.values[slot].store(value, std::memory_order_release);
+			table.keys[slot].store(key, std::memory_order_release);
+			table.control[slot].store(static_cast<uint8_t>(hash & 0x7f), std::memory_order_release);
+			return;
+		}
+		group = (group + probe) & table.groupMask;
+	}
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <support/vectors.h>
+#include "chunk.h"
+#include "block_registry.h"
+#include "voxel_vertex.h"
+
+class World;
+
+/*
+ * One merged rectangle of block faces, all of the same block.
+ * Spans width blocks along the first axis of the face plane and height blocks along the second:
+ * z and y for West/East faces, x and z for Bottom/Top, x and y for North/South.
+ */
+struct MeshQuad
+{
+	uint8_t x, y, z;		// Chunk-local block with the lowest coordinates
+	uint8_t width;
+	uint8_t height;
+	BlockFace face;
+	BlockId block;
+	TextureId texture;
+};
+
+struct ChunkMesh
+{
+	static constexpr int32_t WHOLE_CHUNK = -1;
+
+	vec3i coords;
+	uint64_t version;
+	int32_t section;								// See Chunk::sectionIndex(), quads stay in chunk coordinates
+	int32_t level;									// Of detail: cells of 2^level blocks, see LodMesher
+	std::vector<MeshQuad> quads;					// Grouped by face, in BlockFace order
+	uint32_t faceStart[BLOCK_FACE_COUNT + 1];		// Quads of face f are [faceStart[f], faceStart[f + 1])
+	std::vector<PackedVertex> vertices;				// Four per quad, in quad order
+	uint16_t connectivity;							// Of the section, see section_visibility; all connected for whole chunks
+
+	void clear();
+	inline size_t getQuadCount(BlockFace face) const { return faceStart[static_cast<size_t>(face) + 1] - faceStart[static_cast<size_t>(face)]; }
+};
+
+// A chunk and the 26 chunks around it, missing ones being empty, with the sky heights around it
+struct ChunkNeighborhood
+{
+	static constexpr int32_t PADDED = Chunk::SIZE + 2;
+	static constexpr int32_t CENTER = 13;
+
+	ChunkSnapshot chunks[27];
+	bool hasHeights;
+	int32_t heights[PADDED * PADDED];	// Highest opaque block of each padded column, by (z + 1, x + 1)
+
+	inline const ChunkSnapshot& center() const { return chunks[CENTER]; }
+
+	static inline int32_t index(int32_t dx, int32_t dy, int32_t dz) { return ((dy + 1) * 3 + (dz + 1)) * 3 + (dx + 1); }
+
+	// Without heightmaps in the world, everything that is not opaque counts as open to the sky
+	static void gather(const World& world, const vec3i& coords, ChunkNeighborhood& out);
+};
+
+/*
+ * Greedy mesher: visible faces are found 32 at a time with bit operations on rows of the
+ * padded chunk, then merged into the largest rectangles of the same block, slice by slice.
+ * A face is hidden by an opaque neighbor, and a transparent block also hides the faces
+ * between copies of itself (water, glass).
+ * Every vertex gets ambient occlusion from the three blocks around it in front of the face,
+ * computed for 32 faces at once from the same bit rows, and smooth light averaged over the
+ * open ones. Faces only merge along a direction in which their corners do not change, and
+ * quads are triangulated along the diagonal with the smallest difference.
+ * Sky light is 15 above the highest opaque block of a column and 0 below, until light
+ * propagates; block light is the emission of the block in front of the face.
+ * A chunk can be meshed whole, or prepared once and meshed section by section so that an edit
+ * only rebuilds the sections it touches; quads never cross a section border then.
+ * Keeps scratch buffers between builds: use one mesher per thread.
+ */
+class ChunkMesher
+{
+public:
+	static constexpr int32_t PADDED = ChunkNeighborhood::PADDED;
+
+private:
+	const BlockRegistry& _registry;
+	std::vector<BlockId> _blocks;		// PADDED^3, x then z then y, with the neighbor borders
+	std::vector<uint64_t> _solid[3];	// Per axis, one row of PADDED bits for every padded block column along it
+	std::vector<uint64_t> _opaque[3];
+	std::vector<uint64_t> _sky[3];		// Blocks above the highest opaque block of their column, same rows
+	std::vector<uint32_t> _slices;		// Visible faces of one direction, SIZE rows per layer
+	std::vector<uint64_t> _keys;		// Block, AO and light of every visible face, see meshFace()
+	bool _emissive;						// Whether any padded block emits light
+	vec3i _coords;						// Of the prepared chunk
+	uint64_t _version;
+	uint32_t _sections;					// Bit i for each non-empty section of the prepared chunk
+	size_t _faceCount;
+
+public:
+	explicit ChunkMesher(const BlockRegistry& registry);
+	ChunkMesher(const ChunkMesher&) = delete;
+	ChunkMesher& operator= (const ChunkMesher&) = delete;
+
+	void build(const ChunkNeighborhood& input, ChunkMesh& mesh);
+
+	// Copies the blocks of a chunk and its borders for buildSection()
+	void prepare(const ChunkNeighborhood& input);
+	void buildSection(int32_t section, ChunkMesh& mesh);
+
+	// Visible faces of the last build or section before merging
+	inline size_t getFaceCount() const { return _faceCount; }
+
+	static inline size_t paddedIndex(int32_t x, int32_t y, int32_t z)
+	{
+		return static_cast<size_t>(((y + 1) * PADDED + (z + 1)) * PADDED + (x + 1));
+	}
+
+	// Rows of the padded bit masks, for u and v from -1 to SIZE
+	static inline size_t rowIndex(int32_t u, int32_t v) { return static_cast<size_t>((v + 1) * PADDED + (u + 1)); }
+
+private:
+	void copyBlocks(const ChunkNeighborhood& input);
+	void buildMasks(const ChunkNeighborhood& input);
+	void meshRegion(const vec3i& from, const vec3i& to, bool solid, ChunkMesh& mesh);
+	void meshFace(BlockFace face, const vec3i& from, const vec3i& to, ChunkMesh& mesh);
+};
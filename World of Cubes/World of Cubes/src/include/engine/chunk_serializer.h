@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "chunk.h"
+
+enum class ChunkCompression : uint8_t
+{
+	None = 0,
+	RunLength = 1,
+	Palette = 2
+};
+
+constexpr uint8_t CHUNK_COMPRESSION_COUNT = 3;
+
+/*
+ * Chunk payload encoding shared by region files, saves and the network.
+ * Every payload starts with a byte mask of the non-empty sections; only those are stored.
+ * Block entities follow the sections when there are any, so chunks without them pay nothing.
+ */
+namespace chunk_io
+{
+	void encode(const ChunkSnapshot& chunk, ChunkCompression compression, std::vector<uint8_t>& out);
+
+	bool decode(const uint8_t* data, size_t size, ChunkCompression compression, Chunk& chunk);
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <unordered_map>
+
+#include <support/vectors.h>
+#include <support/time.h>
+#include "chunk.h"
+#include "chunk_map.h"
+
+class World;
+class RegionStorage;
+class TerrainGenerator;
+
+struct StreamObserver
+{
+	vec3f position;
+	vec3f velocity;
+	vec3f direction;
+};
+
+// Main thread time each stage may use per update
+struct StreamBudget
+{
+	Time load;
+	Time generate;
+	Time mesh;
+	Time unload;
+};
+
+struct StreamStats
+{
+	size_t loaded;
+	size_t generated;
+	size_t meshed;
+	size_t unloaded;
+
+	size_t loadQueue;
+	size_t generateQueue;
+	size_t meshQueue;
+	size_t tracked;
+};
+
+/*
+ * Decides which chunks around the observers get loaded, generated, meshed and unloaded.
+ * Candidates within the load radius are ordered by their distance to where each observer will
+ * be after the look-ahead time, scaled down in front of the observer, so the world fills in
+ * front to back. Chunks are only dropped beyond the unload radius, which is larger than the
+ * load radius so that observers moving along a chunk border do not thrash.
+ * Generation runs on worker threads when there are any; the main thread only adds the
+ * finished chunks to the world, within the generate budget.
+ */
+class ChunkStreamer
+{
+public:
+	typedef std::function<void(Chunk& chunk)> MeshCallback;
+
+	enum class State : uint8_t { Unloaded, Generating, Meshing, Ready };
+
+private:
+	struct Candidate
+	{
+		float priority;
+		vec3i coords;
+	};
+
+	World& _world;
+	RegionStorage* _storage;
+	const TerrainGenerator& _generator;
+	MeshCallback _mesher;
+
+	int32_t _loadRadius;
+	int32_t _unloadRadius;
+	int32_t _minY;
+	int32_t _maxY;
+	float _lookAhead;
+
+	std::vector<vec3i> _anchors;
+	std::vector<Candidate> _candidates;
+	size_t _nextCandidate;
+	std::unordered_map<uint64_t, State> _states;
+	std::deque<vec3i> _generateQueue;
+	std::deque<vec3i> _meshQueue;
+	std::vector<vec3i> _unloadQueue;
+
+	std::vector<std::thread> _workers;
+	std::mutex _jobLock;
+	std::condition_variable _jobReady;
+	std::deque<vec3i> _jobs;
+	std::vector<std::unique_ptr<Chunk>> _finished;
+	std::deque<std::unique_ptr<Chunk>> _arrived;
+	size_t _jobsInFlight;
+	bool _stopping;
+
+	StreamStats _stats;
+
+public:
+	// With no workers, chunks are generated on the calling thread
+	ChunkStreamer(World& world, RegionStorage* storage, const TerrainGenerator& generator, uint32_t workers = 2);
+	ChunkStreamer(const ChunkStreamer&) = delete;
+	ChunkStreamer& operator= (const ChunkStreamer&) = delete;
+	~ChunkStreamer();
+
+	// Radii in chunks; the unload radius is kept above the load radius
+	void setRadius(int32_t loadRadius, int32_t unloadRadius);
+	void setVerticalRange(int32_t minY, int32_t maxY);
+	inline void setLookAhead(float seconds) { _lookAhead = seconds; }
+	inline void setMesher(MeshCallback mesher) { _mesher = std::move(mesher); }
+
+	inline int32_t getLoadRadius() const { return _loadRadius; }
+	inline int32_t getUnloadRadius() const { return _unloadRadius; }
+
+	void update(const std::vector<StreamObserver>& observers, const StreamBudget& budget);
+
+	// Queues an already loaded chunk for meshing again, e.g. after an edit
+	void invalidate(const vec3i& coords);
+
+	State getState(const vec3i& coords) const;
+	inline bool isTracked(const vec3i& coords) const { return _states.count(ChunkMap<Chunk>::pack(coords)) != 0; }
+	inline const StreamStats& getStats() const { return _stats; }
+
+	inline bool isIdle() const
+	{
+		return _nextCandidate >= _candidates.size() && _generateQueue.empty() && _jobsInFlight == 0 &&
+			_meshQueue.empty() && _unloadQueue.empty();
+	}
+
+private:
+	bool refresh(const std::vector<StreamObserver>& observers);
+	void rebuild(const std::vector<StreamObserver>& observers);
+	float priority(const std::vector<StreamObserver>& observers, const vec3i& coords) const;
+
+	void runLoads(const Time& budget);
+	void runGeneration(const Time& budget);
+	void runMeshing(const Time& budget);
+	void runUnloads(const Time& budget);
+
+	void addGenerated(std::unique_ptr<Chunk> chunk);
+	void work();
+
+	bool inRange(const vec3i& coords, int32_t radius) const;
+};
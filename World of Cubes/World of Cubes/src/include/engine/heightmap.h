@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <climits>
+#include <map>
+#include <unordered_map>
+
+#include <support/vectors.h>
+#include "chunk.h"
+
+class BlockRegistry;
+
+enum class HeightmapType : uint8_t
+{
+	Opaque = 0,			// Sky light, rain shadows
+	MotionBlocking		// Solid blocks: spawning, landing, top-down maps
+};
+
+constexpr size_t HEIGHTMAP_TYPE_COUNT = 2;
+
+/*
+ * Highest block of each type in every block column of the loaded chunk columns.
+ * Each chunk keeps the local top of its own 32x32 columns, and each chunk column the world
+ * height; a block change only rescans its chunk column when it lowers the current top, and
+ * then only down to the next chunk that has a top of its own.
+ * Queries are a hash lookup plus an array read.
+ */
+class Heightmaps
+{
+public:
+	static constexpr int32_t NONE = INT32_MIN;
+
+private:
+	struct ChunkTops
+	{
+		int8_t top[HEIGHTMAP_TYPE_COUNT][Chunk::AREA];	// -1 when the chunk has none
+	};
+
+	struct Column
+	{
+		int32_t height[HEIGHTMAP_TYPE_COUNT][Chunk::AREA];
+		std::map<int32_t, ChunkTops> chunks;			// By chunk y
+	};
+
+	const uint8_t* _tables[HEIGHTMAP_TYPE_COUNT];
+	std::unordered_map<uint64_t, Column> _columns;
+
+public:
+	explicit Heightmaps(const BlockRegistry& registry);
+	Heightmaps(const Heightmaps&) = default;
+	Heightmaps(Heightmaps&&) noexcept = default;
+
+	Heightmaps& operator= (const Heightmaps&) = default;
+	Heightmaps& operator= (Heightmaps&&) noexcept = default;
+
+	void addChunk(const Chunk& chunk);
+	void removeChunk(const vec3i& coords);
+
+	// Called after the block at local changed from previous to its current id
+	void update(const Chunk& chunk, const vec3i& local, BlockId previous);
+
+	// World block coordinates; NONE where no loaded chunk of the column has a matching block
+	int32_t getHeight(HeightmapType type, int32_t x, int32_t z) const;
+
+	inline size_t getColumnCount() const { return _columns.size(); }
+	void clear();
+
+private:
+	static inline uint64_t columnKey(int32_t chunkX, int32_t chunkZ)
+	{
+		return (static_cast<uint64_t>(static_cast<uint32_t>(chunkX)) << 32) | static_cast<uint32_t>(chunkZ);
+	}
+
+	static inline size_t columnIndex(int32_t x, int32_t z) { return static_cast<size_t>(((z & Chunk::MASK) << Chunk::SIZE_BITS) | (x & Chunk::MASK)); }
+
+	// Recomputes the height of one block column from the chunk tops
+	static void rescan(Column& column, size_t type, size_t index);
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <functional>
+
+#include <support/file.h>
+#include "chunk_serializer.h"
+
+/*
+ * Write-ahead log of encoded chunks.
+ * Records are appended in memory and made durable together by commit(), one sync per batch.
+ * Each record carries a checksum, so replay() stops cleanly at a torn tail after a crash;
+ * open() truncates such a tail, so that new records follow the last intact one.
+ * Once the records were applied to the region files and those are synced, reset() empties the log.
+ */
+class Journal
+{
+public:
+	static constexpr uint32_t MAGIC = 0x4c4a4357; // "WCJL"
+
+	struct Record
+	{
+		uint32_t magic;
+		uint32_t length;
+		uint32_t checksum;
+		int32_t x;
+		int32_t y;
+		int32_t z;
+		uint64_t version;
+		uint8_t compression;
+		uint8_t reserved[7];
+	};
+
+	typedef std::function<void(const vec3i& coords, uint64_t version, ChunkCompression compression, const uint8_t* payload, size_t size)> ReplayCallback;
+
+private:
+	std::string _path;
+	File _file;
+	std::vector<uint8_t> _buffer;
+	uint64_t _size;
+
+public:
+	Journal();
+	Journal(const Journal&) = delete;
+	Journal& operator= (const Journal&) = delete;
+
+	bool open(const std::string& path);
+	void close();
+
+	inline bool isOpen() const { return _file.isOpen(); }
+	inline const std::string& getPath() const { return _path; }
+
+	// Committed bytes on disk
+	inline uint64_t size() const { return _size; }
+	inline bool hasPending() const { return !_buffer.empty(); }
+
+	void append(const vec3i& coords, uint64_t version, ChunkCompression compression, const uint8_t* payload, size_t size);
+	bool commit();
+
+	// Calls back every intact record in order and returns how many there were
+	size_t replay(const ReplayCallback& callback);
+
+	bool reset();
+};
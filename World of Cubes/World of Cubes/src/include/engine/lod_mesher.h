@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <vector>
+
+#include <support/vectors.h>
+#include "chunk.h"
+#include "block_registry.h"
+#include "chunk_mesher.h"
+
+/*
+ * Mesher for distant chunks: level L meshes cells of 2^L blocks per axis instead of blocks.
+ * A cell is solid when at least half of its blocks are, and shows the most common block of its
+ * highest non-empty layer, so that surfaces keep their top block (grass over dirt).
+ * Quads stay in block units: LOD meshes use the same vertex format as full detail ones, without
+ * AO and with full sky light.
+ * Chunks of different levels do not line up: the sides passed as skirts are closed as if the
+ * neighbor was air, which hides the cracks. The coarser chunk of each pair closes its side,
+ * see skirtSides(). Since the finer one culls its border against real blocks, the coarser one
+ * also covers the border cells the vote emptied with skirts down from their real blocks.
+ * Keeps scratch buffers between builds: use one mesher per thread.
+ */
+class LodMesher
+{
+public:
+	static constexpr int32_t MAX_LEVEL = Chunk::SIZE_BITS;
+
+private:
+	const BlockRegistry& _registry;
+	std::vector<BlockId> _cells;		// (cells + 2)^3, x then z then y, with the neighbor borders
+	std::vector<uint32_t> _counts;		// Block votes of the current cell, by id
+	std::vector<BlockId> _voted;		// Ids with a vote, to reset _counts
+	std::vector<BlockId> _faces;		// Visible faces of one layer, AIR where there is none
+	int32_t _cellCount;					// Cells per axis at the level of the last build
+
+public:
+	explicit LodMesher(const BlockRegistry& registry);
+	LodMesher(const LodMesher&) = delete;
+	LodMesher& operator= (const LodMesher&) = delete;
+
+	// level from 1 to MAX_LEVEL; bit f of skirts closes the side of face f
+	void build(const ChunkNeighborhood& input, int32_t level, uint8_t skirts, ChunkMesh& mesh);
+
+	// Full detail up to fullRadius chunks away, then one level more every time the distance
+	// doubles; distances are the largest of the coordinate differences
+	static int32_t levelForDistance(int32_t distance, int32_t fullRadius);
+
+	// Sides of a chunk facing a neighbor of a finer level, around a viewer in chunk center
+	static uint8_t skirtSides(const vec3i& coords, const vec3i& center, int32_t fullRadius);
+
+	static inline int32_t distance(const vec3i& a, const vec3i& b)
+	{
+		return std::max(std::max(std::abs(a.x - b.x), std::abs(a.y - b.y)), std::abs(a.z - b.z));
+	}
+
+private:
+	void downsample(const ChunkNeighborhood& input, int32_t level);
+	BlockId vote(const ChunkNeighborhood& input, const vec3i& from, int32_t size);
+
+	template<typename _Func>
+	BlockId vote(const vec3i& from, int32_t size, _Func block);
+	void meshFace(BlockFace face, int32_t level, bool skirt, ChunkMesh& mesh);
+	void meshSkirt(const ChunkNeighborhood& input, BlockFace face, int32_t level, ChunkMesh& mesh);
+
+	inline size_t cellIndex(int32_t x, int32_t y, int32_t z) const
+	{
+		const int32_t padded = _cellCount + 2;
+		return static_cast<size_t>(((y + 1) * padded + (z + 1)) * padded + (x + 1));
+	}
+};
+
+
+
+/* Implementation */
+
+template<typename _Func>
+BlockId LodMesher::vote(const vec3i& from, int32_t size, _Func block)
+{
+	int32_t solid = 0;
+	for (int32_t y = from.y; y < from.y + size; ++y)
+		for (int32_t z = from.z; z < from.z + size; ++z)
+			for (int32_t x = from.x; x < from.x + size; ++x)
+				solid += block(x, y, z) != blocks::AIR;
+	if (solid * 2 < size * size * size)
+		return blocks::AIR;
+
+	// The most common block of the highest layer with any, the one seen from above
+	for (int32_t y = from.y + size - 1; y >= from.y && _voted.empty(); --y)
+		for (int32_t z = from.z; z < from.z + size; ++z)
+			for (int32_t x = from.x; x < from.x + size; ++x)
+			{
+				const BlockId id = block(x, y, z);
+				if (id != blocks::AIR && _counts[id]++ == 0)
+					_voted.push_back(id);
+			}
+
+	BlockId best = _voted.front();
+	for (BlockId id : _voted)
+	{
+		if (_counts[id] > _counts[best])
+			best = id;
+	}
+	for (BlockId id : _voted)
+		_counts[id] = 0;
+	_voted.clear();
+	return best;
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <unordered_map>
+
+#include <support/vectors.h>
+#include <support/time.h>
+#include <support/clock.h>
+#include <support/mpsc_queue.h>
+#include "chunk_mesher.h"
+
+class World;
+
+// Main thread work allowed per update: uploads stop at whichever limit is hit first
+struct MeshBudget
+{
+	size_t quads;
+	Time time;
+};
+
+struct MeshPipelineStats
+{
+	// Since the pipeline started
+	size_t requested;
+	size_t cancelled;
+
+	// During the last update
+	size_t applied;
+	size_t uploadedSections;
+	size_t uploadedQuads;
+	Time latency;		// Longest time from request to upload among the applied jobs
+
+	size_t queued;		// Waiting for or being built by a worker
+	size_t ready;		// Built, waiting for an upload slot
+	size_t meshes;
+};
+
+/*
+ * Builds chunk meshes on worker threads, one mesh per 16^3 section.
+ * request() snapshots a chunk and its neighbors and queues the sections to rebuild; each worker
+ * meshes them into buffers taken from a pool owned by the main thread and hands them back
+ * through a lock-free queue.
+ * update() runs at frame start on the main thread: it swaps finished meshes in, calling the
+ * upload callback for each section, until the budget is spent.
+ * A chunk requested again before its previous job finished cancels that job and takes over its
+ * sections: workers skip it if it was not started, and its result is dropped otherwise.
+ */
+class MeshPipeline
+{
+public:
+	typedef std::function<void(const ChunkMesh& mesh)> UploadCallback;
+	typedef std::function<void(const vec3i& coords)> RemoveCallback;
+
+	static constexpr uint32_t ALL_SECTIONS = (1u << Chunk::SECTION_COUNT) - 1;
+
+private:
+	struct Job
+	{
+		vec3i coords;
+		uint32_t sections;							// Bit i to rebuild section i
+		ChunkNeighborhood input;
+		ChunkMesh* meshes[Chunk::SECTION_COUNT];	// For the sections to rebuild only
+		Time requested;								// Of the oldest request it covers
+		std::atomic<bool> cancelled;
+	};
+
+	struct SectionMeshes
+	{
+		ChunkMesh* sections[Chunk::SECTION_COUNT];
+	};
+
+	const BlockRegistry& _registry;
+	UploadCallback _upload;
+	RemoveCallback _remove;
+
+	std::vector<std::thread> _workers;
+	std::mutex _jobLock;
+	std::condition_variable _jobReady;
+	std::deque<Job*> _jobs;
+	bool _stopping;
+	MpscQueue<Job*> _finished;
+
+	// Main thread only
+	std::unordered_map<uint64_t, Job*> _pending;
+	std::unordered_map<uint64_t, SectionMeshes> _meshes;
+	std::deque<Job*> _ready;
+	std::vector<ChunkMesh*> _freeMeshes;
+	size_t _jobCount;
+	size_t _meshCount;
+	Clock _clock;
+	MeshPipelineStats _stats;
+
+public:
+	MeshPipeline(const BlockRegistry& registry, uint32_t workers = 2);
+	MeshPipeline(const MeshPipeline&) = delete;
+	MeshPipeline& operator= (const MeshPipeline&) = delete;
+	~MeshPipeline();
+
+	inline void setUploader(UploadCallback upload) { _upload = std::move(upload); }
+	inline void setRemover(RemoveCallback remove) { _remove = std::move(remove); }
+
+	void request(const World& world, const vec3i& coords, uint32_t sections = ALL_SECTIONS);
+
+	// Requests the section of a changed block and the sections it borders, diagonals included.
+	// previousHeight is the opaque height of its column before the change, see World::getHeight():
+	// the sections whose sky light changed below are requested too.
+	void requestBlock(const World& world, const vec3i& position, int32_t previousHeight);
+
+	// Drops the mesh of an unloaded chunk and cancels its pending job
+	void remove(const vec3i& coords);
+
+	void update(const MeshBudget& budget);
+
+	// Null until the first mesh of the section was applied
+	const ChunkMesh* getMesh(const vec3i& coords, int32_t section) const;
+
+	inline bool isIdle() const { return _jobCount == 0 && _ready.empty(); }
+	inline const MeshPipelineStats& getStats() const { return _stats; }
+
+private:
+	ChunkMesh* takeMesh();
+	void collect();
+	void recycle(Job* job);
+	void work();
+};
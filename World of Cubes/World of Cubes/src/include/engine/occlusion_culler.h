@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <support/vectors.h>
+#include <support/matrix44.h>
+#include <support/time.h>
+#include <support/clock.h>
+#include "block_registry.h"
+#include "chunk_mesher.h"
+
+struct OcclusionStats
+{
+	// During the last cull()
+	size_t occluders;			// Meshes rasterized into the depth buffer
+	size_t occluderTriangles;	// Front facing and in front of the near plane
+	size_t tested;
+	size_t outside;				// Culled for being off screen
+	size_t culled;				// Culled for being hidden, outside ones excluded
+	size_t tileCulled;			// Of the hidden ones, those rejected by the tile depths alone
+	Time rasterizeTime;
+	Time testTime;
+};
+
+/*
+ * Occlusion culling of chunk meshes against a low resolution depth buffer, on the CPU.
+ * The opaque faces of the meshes nearest to the eye are rasterized first, 4 pixels at a time
+ * with SIMD, keeping the nearest depth of each pixel; every TILE_SIZE square tile then keeps the
+ * farthest depth of its pixels. A mesh box is hidden when its nearest point lies behind every
+ * pixel it covers on screen: most boxes are decided by the tiles they overlap, and only tiles
+ * at a larger depth than the box are checked pixel by pixel.
+ * Occluders are sampled at pixel centers, as they would be drawn; boxes crossing the near
+ * plane are always visible. Uses the matrix conventions of SoftwareRasterizer.
+ */
+class OcclusionCuller
+{
+public:
+	static constexpr int32_t TILE_SIZE = 8;
+	static constexpr float BOX_MARGIN = 0.25f;		// In blocks, so that faces on a box side never hide it
+
+private:
+	const BlockRegistry& _registry;
+	int32_t _width;					// Multiples of TILE_SIZE
+	int32_t _height;
+	int32_t _tilesX;
+	int32_t _tilesY;
+	size_t _maxOccluders;
+	Matrix4x4 _viewProjection;
+	Matrix4x4 _viewport;
+	vec3f _eye;
+	std::vector<float> _depths;		// Nearest occluder of each pixel, 1 where there is none
+	std::vector<float> _tileDepths;	// Farthest pixel depth of each tile
+	std::vector<std::pair<float, const ChunkMesh*>> _nearest;
+	OcclusionStats _stats;
+	Clock _clock;
+
+public:
+	OcclusionCuller(const BlockRegistry& registry, int32_t width = 256, int32_t height = 128, size_t maxOccluders = 64);
+	OcclusionCuller(const OcclusionCuller&) = delete;
+	OcclusionCuller& operator= (const OcclusionCuller&) = delete;
+
+	// Rasterizes the maxOccluders meshes nearest to the eye, then appends the meshes that may be
+	// visible to the output, in input order
+	void cull(const std::vector<const ChunkMesh*>& meshes, const vec3f& eye, const Matrix4x4& viewProjection, std::vector<const ChunkMesh*>& visible);
+
+	// The steps of cull(), for callers choosing their own occluders
+	void begin(const Matrix4x4& viewProjection, const vec3f& eye);
+	void addOccluder(const ChunkMesh& mesh);
+	void updateTiles();
+	bool isVisible(const vec3f& min, const vec3f& max);
+
+	inline int32_t getWidth() const { return _width; }
+	inline int32_t getHeight() const { return _height; }
+	inline float getDepth(int32_t x, int32_t y) const { return _depths[static_cast<size_t>(y) * _width + x]; }
+	inline const OcclusionStats& getStats() const { return _stats; }
+
+	// Box of the chunk or of the section of a mesh, in blocks
+	static void bounds(const ChunkMesh& mesh, vec3f& min, vec3f& max);
+
+private:
+	void rasterize(const float (&x)[3], const float (&y)[3], const float (&z)[3]);
+};
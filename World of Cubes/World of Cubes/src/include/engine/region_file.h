@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include <support/file.h>
+#include "chunk.h"
+#include "chunk_serializer.h"
+
+/*
+ * One file holding up to 16^3 chunks.
+ * The file starts with an offset table (one Entry per chunk) followed by 4KB sectors;
+ * every chunk is a RecordHeader plus its compressed payload in a run of sectors.
+ * A rewritten chunk always goes to freshly allocated sectors and the table entry is
+ * updated last; the sectors of the previous copy are only reused after sync() made the new
+ * entry durable, so a torn write never damages the previous copy.
+ * Reads go through a read-only memory mapping of the whole file. The file grows in doubling
+ * steps, mapped before any record is written past the old end; the sectors after the last
+ * record are free.
+ */
+class RegionFile
+{
+public:
+	static constexpr int32_t SIZE_BITS = 4;
+	static constexpr int32_t SIZE = 1 << SIZE_BITS;
+	static constexpr int32_t MASK = SIZE - 1;
+	static constexpr int32_t CHUNK_COUNT = SIZE * SIZE * SIZE;
+	static constexpr uint32_t SECTOR_SIZE = 4096;
+
+	struct Entry
+	{
+		uint32_t sector;
+		uint32_t sectors;
+	};
+
+	struct RecordHeader
+	{
+		uint32_t length;
+		uint32_t checksum;
+		uint64_t version;
+		uint8_t compression;
+		uint8_t reserved[7];
+	};
+
+	static constexpr uint32_t HEADER_SECTORS = (CHUNK_COUNT * sizeof(Entry) + SECTOR_SIZE - 1) / SECTOR_SIZE;
+
+private:
+	std::string _path;
+	File _file;
+	MappedFile _map;
+	std::vector<Entry> _entries;
+	std::vector<bool> _usedSectors;
+	std::vector<Entry> _released;		// Sectors of replaced copies, free once the file is synced
+	mutable std::shared_mutex _lock;
+
+public:
+	RegionFile();
+	RegionFile(const RegionFile&) = delete;
+	RegionFile& operator= (const RegionFile&) = delete;
+
+	bool open(const std::string& path, bool create);
+	void close();
+
+	inline bool isOpen() const { return _file.isOpen(); }
+	inline const std::string& getPath() const { return _path; }
+	inline const File& getFile() const { return _file; }
+
+	bool hasChunk(const vec3i& local) const;
+
+	bool readChunk(const vec3i& local, Chunk& chunk) const;
+
+	// Where a chunk record lives in the file, for reading it without the mapping (e.g. with AsyncIO)
+	bool getRecordSpan(const vec3i& local, uint64_t& offset, size_t& size) const;
+	static bool decodeRecord(const uint8_t* record, size_t size, Chunk& chunk);
+
+	bool writeChunk(const vec3i& local, const ChunkSnapshot& chunk, ChunkCompression compression = ChunkCompression::Palette);
+	bool writeRecord(const vec3i& local, const uint8_t* payload, size_t size, ChunkCompression compression, uint64_t version);
+	bool eraseChunk(const vec3i& local);
+
+	bool sync();
+	void dropCache();
+
+	static inline size_t entryIndex(const vec3i& local)
+	{
+		return static_cast<size_t>(((local.y & MASK) << (SIZE_BITS * 2)) | ((local.z & MASK) << SIZE_BITS) | (local.x & MASK));
+	}
+
+	static inline vec3i regionCoords(const vec3i& chunkCoords)
+	{
+		return { chunkCoords.x >> SIZE_BITS, chunkCoords.y >> SIZE_BITS, chunkCoords.z >> SIZE_BITS };
+	}
+
+	static inline vec3i localCoords(const vec3i& chunkCoords)
+	{
+		return { chunkCoords.x & MASK, chunkCoords.y & MASK, chunkCoords.z & MASK };
+	}
+
+private:
+	uint32_t allocate(uint32_t sectors);
+	void markSectors(const Entry& entry, bool used);
+	// Grows the file to hold size bytes and maps it again
+	bool reserve(uint64_t size);
+	bool remap();
+};
+
+
+/*
+ * Set of region files in one directory, opened on demand.
+ */
+class RegionStorage
+{
+private:
+	std::string _directory;
+	std::unordered_map<uint64_t, std::unique_ptr<RegionFile>> _regions;
+	std::mutex _lock;
+
+public:
+	explicit RegionStorage(const std::string& directory);
+	RegionStorage(const RegionStorage&) = delete;
+	RegionStorage& operator= (const RegionStorage&) = delete;
+
+	bool loadChunk(const vec3i& chunkCoords, Chunk& chunk);
+	bool saveChunk(const ChunkSnapshot& chunk, ChunkCompression compression = ChunkCompression::Palette);
+
+	RegionFile* getRegion(const vec3i& regionCoords, bool create);
+
+	bool syncAll();
+	void dropCaches();
+	void closeAll();
+
+	inline const std::string& getDirectory() const { return _directory; }
+
+	std::string regionPath(const vec3i& regionCoords) const;
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+
+#include <support/vectors.h>
+#include "chunk.h"
+#include "block_registry.h"
+
+/*
+ * Which faces of a 16^3 section see each other through blocks that are not opaque: bit
+ * pairBit(a, b) is set when some open path inside the section joins face a to face b.
+ * Fifteen bits for the fifteen pairs of faces; an empty section connects everything.
+ */
+namespace section_visibility
+{
+	constexpr uint16_t ALL_CONNECTED = 0x7fff;
+
+	inline uint16_t pairBit(BlockFace a, BlockFace b)
+	{
+		// Pairs numbered from 0 for (West, East) to 14 for (North, South)
+		static const uint8_t PAIRS[BLOCK_FACE_COUNT][BLOCK_FACE_COUNT] = {
+			{ 15, 0, 1, 2, 3, 4 },
+			{ 0, 15, 5, 6, 7, 8 },
+			{ 1, 5, 15, 9, 10, 11 },
+			{ 2, 6, 9, 15, 12, 13 },
+			{ 3, 7, 10, 12, 15, 14 },
+			{ 4, 8, 11, 13, 14, 15 }
+		};
+		return static_cast<uint16_t>(1u << PAIRS[static_cast<size_t>(a)][static_cast<size_t>(b)] & ALL_CONNECTED);
+	}
+
+	inline bool connects(uint16_t connectivity, BlockFace a, BlockFace b) { return (connectivity & pairBit(a, b)) != 0; }
+
+	inline BlockFace opposite(BlockFace face) { return static_cast<BlockFace>(static_cast<uint8_t>(face) ^ 1); }
+
+	// Flood fills the open blocks of a section from its borders. blocks points at the block
+	// (0, 0, 0) of the section, rows along x follow each other every zStride blocks and layers
+	// every yStride, so that both a ChunkSection and a padded copy of a chunk can be read
+	uint16_t compute(const BlockId* blocks, size_t zStride, size_t yStride, const uint8_t* opaque);
+
+	inline uint16_t compute(const ChunkSection* section, const uint8_t* opaque)
+	{
+		return section ? compute(section->blocks, ChunkSection::SIZE, ChunkSection::SIZE * ChunkSection::SIZE, opaque) : ALL_CONNECTED;
+	}
+}
+
+struct VisibilityStats
+{
+	// During the last search
+	size_t visited;
+	size_t known;		// Sections in the graph
+};
+
+/*
+ * Sections of the loaded chunks linked by their face connectivity, for cave culling.
+ * findVisible() walks from the section of the eye to its neighbors, leaving a section only
+ * through a face connected to the one it was entered by, and never in a direction opposite
+ * to one already taken: a path has to go away from the eye, so that looking into a cave from
+ * outside does not reach every cave behind it. Underground, whatever is walled off by stone
+ * is never reached. Sections only seen along a path that turns back may be missed, though
+ * rarely in practice.
+ * Fed by the caller as section meshes are uploaded, see ChunkMesh::connectivity.
+ */
+class VisibilityGraph
+{
+private:
+	struct Node
+	{
+		vec3i section;
+		uint16_t connectivity;	// All connected for the eye section, which is not entered by a face
+		BlockFace entry;
+		uint8_t directions;		// Bit f once the path went through a face f
+	};
+
+	struct Entry
+	{
+		uint16_t connectivity;
+		uint32_t visited;		// Search that last reached the section
+	};
+
+	std::unordered_map<uint64_t, Entry> _sections;
+	std::vector<Node> _queue;
+	uint32_t _search;
+	VisibilityStats _stats;
+
+public:
+	VisibilityGraph();
+	VisibilityGraph(const VisibilityGraph&) = delete;
+	VisibilityGraph& operator= (const VisibilityGraph&) = delete;
+
+	// Sections in section coordinates: chunk coordinates times SECTIONS_PER_AXIS plus the
+	// section position, see sectionCoords()
+	void setSection(const vec3i& section, uint16_t connectivity);
+	void removeChunk(const vec3i& chunk);
+	inline void clear() { _sections.clear(); }
+
+	// Appends the sections reached from the eye within radius sections, the eye section first;
+	// false when that section is unknown, in which case nothing can be culled
+	bool findVisible(const vec3f& eye, int32_t radius, std::vector<vec3i>& visible);
+
+	inline const VisibilityStats& getStats() const { return _stats; }
+
+	static inline vec3i sectionCoords(const vec3i& chunk, int32_t section)
+	{
+		const vec3i origin = Chunk::sectionOrigin(section);
+		return {
+			chunk.x * Chunk::SECTIONS_PER_AXIS + origin.x / ChunkSection::SIZE,
+			chunk.y * Chunk::SECTIONS_PER_AXIS + origin.y / ChunkSection::SIZE,
+			chunk.z * Chunk::SECTIONS_PER_AXIS + origin.z / ChunkSection::SIZE
+		};
+	}
+};
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <support/color.h>
+#include <support/matrix44.h>
+#include "block_registry.h"
+#include "chunk_mesher.h"
+
+struct RasterizerStats
+{
+	// Since the last clear()
+	size_t triangles;		// Submitted, two per quad
+	size_t culled;			// Back facing, behind the near plane or off screen
+	size_t clipped;			// Crossing the near plane
+	size_t binned;			// Triangle and tile pairs
+	size_t pixels;			// That passed the depth test
+};
+
+/*
+ * Headless renderer for tests and benchmarks: draws chunk meshes on the CPU into a color
+ * and a depth buffer, with the view-projection matrices of the GL path (perspectiveFov(),
+ * then viewport() on normalized coordinates; depth runs from 0 at the near plane to 1).
+ * draw() transforms, clips against the near plane and sets triangles up on the calling thread,
+ * binning them into TILE_SIZE square tiles; flush() rasterizes the tiles in parallel, each
+ * tile drawing its triangles in submission order so that images do not depend on the threads.
+ * Edge functions are evaluated for 4 pixels at once, exactly negated on shared edges, with a
+ * top-left rule: no pixel is drawn twice or missed along the diagonal of a quad.
+ * There are no textures: a face takes the color of its texture, see setTextureColor(), times
+ * the block tint, shaded by face direction, ambient occlusion and light. No blending either,
+ * transparent blocks are drawn opaque.
+ */
+class SoftwareRasterizer
+{
+public:
+	static constexpr int32_t TILE_SIZE = 64;
+
+private:
+	struct Triangle
+	{
+		float a[3], b[3], c[3];		// Edge function a x + b y + c of the edge opposite each vertex, positive inside
+		bool topLeft[3];
+		float z[3];					// Normalized depth at vertex 0, then differences of vertices 1 and 2 to it
+		float shade[3];				// Divided by w, with invW for perspective correction, same layout
+		float invW[3];
+		float invArea;
+		uint32_t color;
+		int32_t minX, minY, maxX, maxY;
+	};
+
+	struct ClipVertex
+	{
+		float x, y, z, w;
+		float shade;
+	};
+
+	const BlockRegistry& _registry;
+	int32_t _width;
+	int32_t _height;
+	int32_t _stride;				// Row length of the buffers, a multiple of 4
+	int32_t _tilesX;
+	int32_t _tilesY;
+	Matrix4x4 _viewport;
+	std::vector<Color> _colors;
+	std::vector<float> _depths;
+	std::vector<Color> _palette;	// By TextureId
+	std::vector<Triangle> _triangles;
+	std::vector<std::vector<uint32_t>> _bins;	// Triangle indices of each tile, row by row
+	RasterizerStats _stats;
+
+	std::vector<std::thread> _workers;
+	std::mutex _lock;
+	std::condition_variable _wake;
+	std::condition_variable _done;
+	uint64_t _frame;				// Incremented by each flush to wake the workers
+	size_t _busy;					// Workers still rasterizing the current flush
+	bool _stopping;
+	std::atomic<size_t> _nextTile;
+	std::atomic<size_t> _pixels;
+
+public:
+	// threads counts the caller of flush(), 0 for one per hardware thread
+	SoftwareRasterizer(const BlockRegistry& registry, int32_t width, int32_t height, uint32_t threads = 0);
+	SoftwareRasterizer(const SoftwareRasterizer&) = delete;
+	SoftwareRasterizer& operator= (const SoftwareRasterizer&) = delete;
+	~SoftwareRasterizer();
+
+	// Textures default to distinct colors derived from their id, see defaultTextureColor()
+	void setTextureColor(TextureId texture, const Color& color);
+
+	void clear(const Color& color, float depth = 1.f);
+
+	// Queues the triangles of a mesh; quads are in chunk coordinates, placed by mesh.coords
+	void draw(const ChunkMesh& mesh, const Matrix4x4& viewProjection);
+	void flush();
+
+	inline int32_t getWidth() const { return _width; }
+	inline int32_t getHeight() const { return _height; }
+	inline const Color& getColor(int32_t x, int32_t y) const { return _colors[static_cast<size_t>(y) * _stride + x]; }
+	inline float getDepth(int32_t x, int32_t y) const { return _depths[static_cast<size_t>(y) * _stride + x]; }
+	inline const RasterizerStats& getStats() const { return _stats; }
+
+	// Binary PPM of the color buffer, alpha dropped
+	bool savePPM(const std::string& path) const;
+
+	// Hues a golden angle apart, so that neighboring ids stay apart; also the placeholders of BlockTextures
+	static vec3f defaultTextureColor(TextureId texture);
+
+private:
+	void drawTriangle(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2, uint32_t color);
+	void setup(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2, uint32_t color);
+	void rasterizeTiles();
+	size_t rasterizeTile(size_t tile);
+	void work();
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+
+#include "chunk.h"
+
+class BlockRegistry;
+
+/*
+ * Deterministic procedural terrain: a layered value noise heightmap around sea level
+ * carved by 3D cave noise. Used by new worlds and by the storage benchmarks.
+ */
+class TerrainGenerator
+{
+public:
+	static constexpr int32_t SEA_LEVEL = 64;
+
+private:
+	uint64_t _seed;
+	BlockId _stone;
+	BlockId _dirt;
+	BlockId _grass;
+	BlockId _sand;
+	BlockId _water;
+	BlockId _bedrock;
+	BlockId _snow;
+
+public:
+	TerrainGenerator(const BlockRegistry& registry, uint64_t seed);
+	TerrainGenerator(const TerrainGenerator&) = default;
+	TerrainGenerator& operator= (const TerrainGenerator&) = default;
+
+	inline uint64_t getSeed() const { return _seed; }
+
+	// Fills the chunk at its coordinates, replacing any previous content
+	void generate(Chunk& chunk) const;
+
+	// Surface height of a world column
+	int32_t getHeight(int32_t x, int32_t z) const;
+
+private:
+	float noise2(float x, float z, uint64_t salt) const;
+	float noise3(float x, float y, float z, uint64_t salt) const;
+	bool isCave(int32_t x, int32_t y, int32_t z) const;
+};
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+
+#include <support/vectors.h>
+#include "chunk.h"
+
+/*
+ * Sparse voxel DAG over a cubic area of (1 << chunksPerSideLog2)^3 chunks.
+ * Every node has 8 child references; a reference with UNIFORM_FLAG set is not a node
+ * but a whole homogeneous subtree of one BlockId, so empty and solid areas cost nothing.
+ * Identical subtrees are shared across the whole DAG (hash-consing).
+ */
+class VoxelDAG
+{
+public:
+	typedef uint32_t NodeRef;
+	typedef std::function<const Chunk*(const vec3i&)> ChunkProvider;
+
+	static constexpr NodeRef UNIFORM_FLAG = 0x80000000u;
+
+	struct RayHit
+	{
+		bool hit;
+		vec3i position;
+		vec3i normal;
+		BlockId block;
+		float distance;
+	};
+
+private:
+	struct Node
+	{
+		NodeRef children[8];
+	};
+
+	struct NodeHash { size_t operator() (const Node& node) const; };
+	struct NodeEqual { bool operator() (const Node& n0, const Node& n1) const; };
+
+	typedef std::unordered_map<Node, NodeRef, NodeHash, NodeEqual> NodeTable;
+
+	struct Builder
+	{
+		std::vector<Node> nodes;
+		NodeTable lookup;
+
+		NodeRef intern(const Node& node);
+	};
+
+	vec3i _originChunk;
+	uint32_t _chunksLog2;
+	uint32_t _levels;
+	NodeRef _root;
+	Builder _data;
+
+public:
+	VoxelDAG();
+	VoxelDAG(const vec3i& originChunk, uint32_t chunksPerSideLog2);
+	VoxelDAG(const VoxelDAG&) = default;
+	VoxelDAG(VoxelDAG&&) noexcept = default;
+
+	VoxelDAG& operator= (const VoxelDAG&) = default;
+	VoxelDAG& operator= (VoxelDAG&&) noexcept = default;
+
+	inline const vec3i& getOriginChunk() const { return _originChunk; }
+	inline vec3i getOrigin() const { return Chunk::origin(_originChunk); }
+	inline int32_t getSideLength() const { return 1 << _levels; }
+	inline uint32_t getLevels() const { return _levels; }
+
+	void insertChunk(const Chunk& chunk);
+
+	BlockId getBlock(const vec3i& blockPos) const;
+	void setBlock(const vec3i& blockPos, BlockId id);
+
+	RayHit raycast(const vec3f& origin, const vec3f& direction, float maxDistance) const;
+
+	// Drops the nodes left unreachable by incremental updates
+	void compact();
+
+	inline size_t getNodeCount() const { return _data.nodes.size(); }
+	inline size_t getMemoryUsage() const { return _data.nodes.size() * sizeof(Node); }
+	size_t getDenseMemoryUsage() const;
+
+
+	static VoxelDAG build(const vec3i& originChunk, uint32_t chunksPerSideLog2, const ChunkProvider& provider, unsigned int threads = 0);
+
+	static inline bool isUniform(NodeRef ref) { return (ref & UNIFORM_FLAG) != 0; }
+	static inline NodeRef uniform(BlockId id) { return UNIFORM_FLAG | id; }
+	static inline BlockId uniformBlock(NodeRef ref) { return static_cast<BlockId>(ref & 0xffffu); }
+
+private:
+	bool toLocal(const vec3i& blockPos, vec3i& local) const;
+
+	NodeRef replace(NodeRef node, uint32_t level, const vec3i& local, uint32_t targetLevel, NodeRef replacement);
+
+	NodeRef findUniform(const vec3i& local, uint32_t& level) const;
+
+	NodeRef buildTop(std::vector<NodeRef>& grid, uint32_t sideLog2);
+
+	static NodeRef buildChunk(Builder& builder, const Chunk& chunk, int32_t x, int32_t y, int32_t z, int32_t size);
+
+	static void merge(Builder& target, const Builder& source, std::vector<NodeRef>& remap);
+
+	static inline uint32_t childIndex(const vec3i& local, uint32_t level)
+	{
+		return ((local.x >> level) & 1) | (((local.y >> level) & 1) << 1) | (((local.z >> level) & 1) << 2);
+	}
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "block_registry.h"
+
+struct MeshQuad;
+
+/*
+ * Chunk mesh vertex packed into two words, a fifth of a float position, normal, UV and color.
+ *   position: x, y, z in 6 bits each (corners run from 0 to 32), face in 3, ambient occlusion in 2
+ *   material: texture layer in 16 bits, sky light in 4, block light in 4
+ * Texture coordinates follow from the position and the face, so that merged quads repeat
+ * their texture once per block.
+ */
+struct PackedVertex
+{
+	uint32_t position;
+	uint32_t material;
+};
+
+static_assert(sizeof(PackedVertex) == 8, "PackedVertex must stay 8 bytes");
+
+// Unpacked form, for building vertices and for checking them
+struct VoxelVertex
+{
+	uint8_t x, y, z;
+	BlockFace face;
+	uint8_t ao;				// 0 fully occluded to 3 open
+	TextureId texture;
+	uint8_t skyLight;
+	uint8_t blockLight;
+};
+
+namespace voxel_vertex
+{
+	constexpr uint32_t POSITION_BITS = 6;
+	constexpr uint32_t MAX_AO = 3;
+	constexpr uint32_t MAX_LIGHT = 15;
+
+	inline PackedVertex pack(const VoxelVertex& v)
+	{
+		return {
+			static_cast<uint32_t>(v.x) | static_cast<uint32_t>(v.y) << 6 | static_cast<uint32_t>(v.z) << 12 |
+				static_cast<uint32_t>(v.face) << 18 | static_cast<uint32_t>(v.ao & MAX_AO) << 21,
+			static_cast<uint32_t>(v.texture) | static_cast<uint32_t>(v.skyLight & MAX_LIGHT) << 16 |
+				static_cast<uint32_t>(v.blockLight & MAX_LIGHT) << 20
+		};
+	}
+
+	inline VoxelVertex unpack(const PackedVertex& p)
+	{
+		return {
+			static_cast<uint8_t>(p.position & 63), static_cast<uint8_t>(p.position >> 6 & 63), static_cast<uint8_t>(p.position >> 12 & 63),
+			static_cast<BlockFace>(p.position >> 18 & 7), static_cast<uint8_t>(p.position >> 21 & MAX_AO),
+			static_cast<TextureId>(p.material & 0xffff),
+			static_cast<uint8_t>(p.material >> 16 & MAX_LIGHT), static_cast<uint8_t>(p.material >> 20 & MAX_LIGHT)
+		};
+	}
+
+	// Corners of a quad in u, v order: (0, 0), (width, 0), (width, height), (0, height)
+	void corners(const MeshQuad& quad, uint8_t out[4][3]);
+
+	// Appends the four corners of a quad, counter-clockwise seen from outside the block, as two
+	// triangles sharing the diagonal from the first to the third; the values are per corner,
+	// in corners() order
+	void emitQuad(const MeshQuad& quad, const uint8_t ao[4], const uint8_t skyLight[4], const uint8_t blockLight[4], std::vector<PackedVertex>& out);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <unordered_set>
+
+#include "chunk.h"
+#include "chunk_map.h"
+#include "heightmap.h"
+
+class BlockRegistry;
+
+/*
+ * The loaded part of the world, owned by the main thread.
+ * Other threads only see chunks through snapshots, or through find() under an epoch::Guard.
+ * Every modification marks its chunk dirty until the next collectDirty().
+ * Given a block registry, the world also keeps column heightmaps up to date; edits made
+ * directly on a loaded chunk bypass them.
+ */
+class World
+{
+private:
+	ChunkMap<Chunk> _chunks;
+	std::unordered_set<uint64_t> _dirty;
+	std::vector<ChunkSnapshot> _evicted;
+	std::unique_ptr<Heightmaps> _heights;
+
+public:
+	explicit World(const BlockRegistry* registry = nullptr);
+	World(const World&) = delete;
+	World& operator= (const World&) = delete;
+
+	inline Chunk* getChunk(const vec3i& coords) const { return _chunks.find(coords); }
+	inline const ChunkMap<Chunk>& getChunks() const { return _chunks; }
+	inline size_t getChunkCount() const { return _chunks.size(); }
+
+	// Fails if a chunk is already loaded at the same coordinates
+	bool addChunk(std::unique_ptr<Chunk> chunk, bool dirty = false);
+
+	// Dirty chunks leave a snapshot behind for the next collectDirty()
+	bool removeChunk(const vec3i& coords);
+
+	BlockId getBlock(const vec3i& position) const;
+	bool setBlock(const vec3i& position, BlockId id);
+
+	// Highest block of that type at world column (x, z), Heightmaps::NONE if unknown
+	inline int32_t getHeight(HeightmapType type, int32_t x, int32_t z) const { return _heights ? _heights->getHeight(type, x, z) : Heightmaps::NONE; }
+	inline const Heightmaps* getHeightmaps() const { return _heights.get(); }
+
+	void markDirty(const vec3i& coords);
+	inline bool isDirty(const vec3i& coords) const { return _dirty.count(ChunkMap<Chunk>::pack(coords)) != 0; }
+	inline size_t getDirtyCount() const { return _dirty.size() + _evicted.size(); }
+
+	// Appends a snapshot of every dirty chunk to out and clears the dirty set
+	size_t collectDirty(std::vector<ChunkSnapshot>& out);
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <support/time.h>
+#include "journal.h"
+#include "region_file.h"
+
+class World;
+
+struct SaveStats
+{
+	uint64_t chunks;
+	uint64_t batches;
+	uint64_t checkpoints;
+	Time lastBatch;
+	Time lastStall;
+};
+
+/*
+ * Background world saving.
+ * The main thread only hands over chunk snapshots; a saver thread batches them, appends the
+ * batch to the journal with a single sync and then writes the chunks into their region files.
+ * The region files are only synced and the journal emptied at checkpoints, so a crash at any
+ * point is repaired by recover() replaying the journal on the next start.
+ */
+class WorldSaver
+{
+public:
+	static constexpr uint64_t CHECKPOINT_BYTES = 16 << 20;
+
+private:
+	RegionStorage& _storage;
+	std::string _journalPath;
+	Journal _journal;
+	ChunkCompression _compression;
+	Time _batchDelay;
+
+	std::thread _thread;
+	mutable std::mutex _lock;
+	std::condition_variable _wake;
+	std::condition_variable _done;
+	std::vector<ChunkSnapshot> _pending;
+	uint64_t _submitted;
+	uint64_t _completed;
+	bool _flushing;
+	bool _running;
+	bool _failed;
+	SaveStats _stats;
+
+	std::vector<ChunkSnapshot> _handoff;
+	std::vector<std::vector<uint8_t>> _payloads;
+
+public:
+	WorldSaver(RegionStorage& storage, const std::string& journalPath, ChunkCompression compression = ChunkCompression::Palette);
+	WorldSaver(const WorldSaver&) = delete;
+	WorldSaver& operator= (const WorldSaver&) = delete;
+	~WorldSaver();
+
+	// Applies whatever an interrupted session left in the journal; call before start()
+	bool recover();
+
+	bool start();
+	// Saves everything still pending and checkpoints
+	void stop();
+
+	inline bool isRunning() const { return _running; }
+
+	// How long the saver waits after the first pending chunk so that more join the batch
+	inline void setBatchDelay(const Time& delay) { _batchDelay = delay; }
+
+	void submit(ChunkSnapshot snapshot);
+	void submit(std::vector<ChunkSnapshot>& snapshots);
+
+	// Hands the dirty chunks of the world over and returns how long the caller was blocked
+	Time autosave(World& world);
+
+	// Blocks until everything submitted so far is in the journal
+	bool flush();
+
+	SaveStats getStats() const;
+
+private:
+	void run();
+	bool save(std::vector<ChunkSnapshot>& batch);
+	bool openJournal();
+	bool checkpoint();
+};
@@ -1,17 +1,73 @@
 #pragma once
 
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
 
+#include "render_commands.h"
 
 namespace gl
 {
-	/*bool is_initiated();
+	bool is_initiated();
 
+	// Loads the entry points and extensions with GLEW, for the current context
 	bool initiate();
 
-	void quit();*/
+	void quit();
 }
 
 namespace gl
 {
+	// Polls glGetError, which may wait for the driver to catch up: debug builds only, release
+	// builds use debug output instead
+#ifdef NDEBUG
+	inline bool check_errors() { return true; }
+#else
 	bool check_errors();
+#endif
 }
+
+namespace gl
+{
+	struct DebugMessage
+	{
+		uint32_t source;
+		uint32_t type;
+		uint32_t id;
+		uint32_t severity;
+		std::string text;
+	};
+
+	/*
+	 * Diagnostics through KHR_debug: the driver reports errors and warnings to a callback, which
+	 * may run on a driver thread and only pushes them to a lock-free queue; drain_debug_messages()
+	 * empties it once per frame. Notifications are not reported.
+	 * synchronous makes the driver report from the call at fault, for debugging, at a cost.
+	 */
+	bool enable_debug_output(bool synchronous = false);
+	void disable_debug_output();
+	bool is_debug_output_enabled();
+
+	// Prints the queued messages and appends them to the output if any; returns how many there were
+	size_t drain_debug_messages(std::vector<DebugMessage>* messages = nullptr);
+
+	std::string to_string(const DebugMessage& message);
+}
+
+/*
+ * RenderBackend over the current OpenGL context, which needs GLEW initialized.
+ * Textures are 2D arrays, like BlockTextures, bound to unit 0; draws read 32 bit indices from the element buffer of the vertex array.
+ */
+class GLRenderBackend : public RenderBackend
+{
+public:
+	GLRenderBackend() = default;
+
+	void useProgram(uint32_t program) override;
+	void bindTexture(uint32_t texture) override;
+	void bindVertexArray(uint32_t vertexArray) override;
+	void setDepth(bool test, bool write) override;
+	void setBlend(bool enabled) override;
+	void draw(uint32_t first, uint32_t count) override;
+};
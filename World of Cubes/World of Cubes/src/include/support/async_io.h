@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <functional>
+
+#include "file.h"
+
+/*
+ * Asynchronous positional reads and writes.
+ * Requests are queued by read()/write() and handed to the backend together by submit();
+ * at most queueDepth of them are in flight, the rest wait in a backlog.
+ * Callbacks run on the owning thread from poll()/wait(), with the number of bytes
+ * transferred or a negative error code.
+ * On Linux the backend is io_uring when the kernel allows it, elsewhere a pool of threads
+ * doing blocking I/O.
+ * An AsyncIO object must only be used from one thread.
+ */
+class AsyncIO
+{
+public:
+	enum class Backend { Auto, Uring, ThreadPool };
+
+	typedef std::function<void(int64_t result)> Callback;
+	typedef std::pair<void*, size_t> Buffer;
+
+protected:
+	enum class Op : uint8_t { Read, Write };
+
+	struct Request
+	{
+		Op op;
+		File* file;
+		uint64_t offset;
+		void* buffer;
+		size_t size;
+		int32_t bufferIndex;
+		uint32_t slot;
+	};
+
+	struct Completion
+	{
+		uint32_t slot;
+		int64_t result;
+	};
+
+private:
+	uint32_t _depth;
+	size_t _inFlight;
+	std::vector<Callback> _callbacks;
+	std::vector<uint32_t> _freeSlots;
+	std::vector<Buffer> _buffers;
+	std::deque<Request> _backlog;
+	std::vector<Completion> _completions;
+
+public:
+	static std::unique_ptr<AsyncIO> create(uint32_t queueDepth, Backend backend = Backend::Auto);
+
+	AsyncIO(const AsyncIO&) = delete;
+	AsyncIO& operator= (const AsyncIO&) = delete;
+	virtual ~AsyncIO();
+
+	virtual const char* getName() const = 0;
+
+	inline uint32_t getQueueDepth() const { return _depth; }
+	inline size_t getInFlight() const { return _inFlight; }
+	inline size_t getPending() const { return _inFlight + _backlog.size(); }
+
+	// Pins the buffers for the lifetime of this object so that requests inside them skip per-call
+	// page mapping; false if the backend cannot pin memory
+	bool registerBuffers(const std::vector<Buffer>& buffers);
+
+	void read(const File& file, uint64_t offset, void* buffer, size_t size, Callback callback);
+	void write(File& file, uint64_t offset, const void* buffer, size_t size, Callback callback);
+
+	size_t submit();
+
+	// Runs the callbacks of finished requests without blocking and returns how many ran
+	size_t poll();
+
+	// Like poll(), but first blocks until at least one request finished
+	size_t wait();
+
+	void drain();
+
+protected:
+	explicit AsyncIO(uint32_t queueDepth);
+
+	virtual bool pinBuffers(const std::vector<Buffer>& buffers) = 0;
+
+	// Called at most queueDepth times between completions, then flush() once per batch
+	virtual void enqueue(const Request& request) = 0;
+	virtual void flush() = 0;
+
+	virtual void reap(std::vector<Completion>& completions, bool block) = 0;
+
+private:
+	void queue(Op op, File& file, uint64_t offset, void* buffer, size_t size, Callback callback);
+	int32_t findBuffer(const void* buffer, size_t size) const;
+	size_t dispatch();
+};
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace bits
+{
+	// Results are undefined for a zero input, as with the underlying intrinsics
+
+	inline uint32_t ctz32(uint32_t value)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, value);
+		return static_cast<uint32_t>(index);
+#else
+		return static_cast<uint32_t>(__builtin_ctz(value));
+#endif
+	}
+
+	inline uint32_t ctz64(uint64_t value)
+	{
+#if defined(_MSC_VER) && defined(_M_X64)
+		unsigned long index;
+		_BitScanForward64(&index, value);
+		return static_cast<uint32_t>(index);
+#elif defined(_MSC_VER)
+		uint32_t low = static_cast<uint32_t>(value);
+		return low ? ctz32(low) : 32 + ctz32(static_cast<uint32_t>(value >> 32));
+#else
+		return static_cast<uint32_t>(__builtin_ctzll(value));
+#endif
+	}
+
+	inline uint32_t clz32(uint32_t value)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanReverse(&index, value);
+		return 31u - static_cast<uint32_t>(index);
+#else
+		return static_cast<uint32_t>(__builtin_clz(value));
+#endif
+	}
+
+	inline uint32_t popcount32(uint32_t value)
+	{
+#ifdef _MSC_VER
+		return static_cast<uint32_t>(__popcnt(value));
+#else
+		return static_cast<uint32_t>(__builtin_popcount(value));
+#endif
+	}
+
+	inline uint32_t popcount64(uint64_t value)
+	{
+#if defined(_MSC_VER) && defined(_M_X64)
+		return static_cast<uint32_t>(__popcnt64(value));
+#elif defined(_MSC_VER)
+		return popcount32(static_cast<uint32_t>(value)) + popcount32(static_cast<uint32_t>(value >> 32));
+#else
+		return static_cast<uint32_t>(__builtin_popcountll(value));
+#endif
+	}
+
+	// In place transpose of a 64x64 bit matrix: bit j of rows[i] becomes bit i of rows[j]
+	inline void transpose64(uint64_t* rows)
+	{
+		uint64_t mask = 0x00000000ffffffffull;
+		for (uint32_t width = 32; width != 0; width >>= 1, mask ^= mask << width)
+			for (uint32_t i = 0; i < 64; i = ((i | width) + 1) & ~width)
+			{
+				const uint64_t swap = ((rows[i] >> width) ^ rows[i | width]) & mask;
+				rows[i] ^= swap << width;
+				rows[i | width] ^= swap;
+			}
+	}
+
+	inline uint64_t mix64(uint64_t value)
+	{
+		value ^= value >> 33;
+		value *= 0xff51afd7ed558ccdull;
+		value ^= value >> 33;
+		value *= 0xc4ceb9fe1a85ec53ull;
+		value ^= value >> 33;
+		return value;
+	}
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace checksum
+{
+	// CRC-32 (IEEE 802.3); pass the previous result as crc to checksum data in pieces
+	uint32_t crc32(const void* data, size_t size, uint32_t crc = 0);
+}
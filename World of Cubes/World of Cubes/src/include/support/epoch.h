@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * Epoch based reclamation for lock-free readers.
+ * Readers hold a Guard while they touch shared pointers; writers unlink an object and
+ * retire() it, and it is only destroyed once every guard that could have seen it is gone.
+ */
+namespace epoch
+{
+	// Threads holding a record at once; a thread takes one at its first Guard and keeps it until
+	// it exits, and going over the limit aborts
+	constexpr size_t MAX_THREADS = 128;
+
+	class Guard
+	{
+	public:
+		Guard();
+		~Guard();
+
+		Guard(const Guard&) = delete;
+		Guard& operator= (const Guard&) = delete;
+	};
+
+	typedef void (*Deleter)(void*);
+
+	void retire(void* ptr, Deleter deleter);
+
+	template<typename _Ty>
+	inline void retire(_Ty* ptr)
+	{
+		if (ptr)
+			retire(static_cast<void*>(ptr), [](void* p) { delete static_cast<_Ty*>(p); });
+	}
+
+	// Advances the global epoch and destroys every retired object no guard can reach.
+	size_t collect();
+
+	uint64_t current();
+
+	size_t pending();
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+/*
+ * Thin wrappers over the native file APIs (Win32 handles / POSIX descriptors)
+ * for positional I/O, durable syncs and read-only memory mappings.
+ */
+class File
+{
+public:
+	enum class Mode { Read, ReadWrite, Create };
+
+private:
+#ifdef _WIN32
+	void* _handle;
+#else
+	int _fd;
+#endif
+
+public:
+	File();
+	File(const File&) = delete;
+	File(File&& f) noexcept;
+	~File();
+
+	File& operator= (const File&) = delete;
+	File& operator= (File&& f) noexcept;
+
+	bool open(const std::string& path, Mode mode);
+	void close();
+
+	bool isOpen() const;
+
+	size_t readAt(uint64_t offset, void* buffer, size_t size) const;
+	size_t writeAt(uint64_t offset, const void* buffer, size_t size);
+
+	uint64_t size() const;
+	bool resize(uint64_t size);
+
+	// Flushes written data down to the storage device
+	bool sync();
+
+	// Best effort hint to evict this file from the OS page cache
+	void dropCache();
+
+#ifdef _WIN32
+	inline void* nativeHandle() const { return _handle; }
+#else
+	inline int nativeHandle() const { return _fd; }
+#endif
+
+	static bool exists(const std::string& path);
+	static bool remove(const std::string& path);
+	static bool rename(const std::string& from, const std::string& to);
+	static bool createDirectory(const std::string& path);
+};
+
+
+class MappedFile
+{
+private:
+	const uint8_t* _data;
+	size_t _size;
+#ifdef _WIN32
+	void* _mapping;
+#endif
+
+public:
+	MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile(MappedFile&& m) noexcept;
+	~MappedFile();
+
+	MappedFile& operator= (const MappedFile&) = delete;
+	MappedFile& operator= (MappedFile&& m) noexcept;
+
+	// Maps the first size bytes of the file (or all of it when size is 0) read-only
+	bool map(const File& file, size_t size = 0);
+	void unmap();
+
+	inline bool isMapped() const { return _data != nullptr; }
+	inline const uint8_t* data() const { return _data; }
+	inline size_t size() const { return _size; }
+};
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+/*
+ * Small byte-oriented LZ77 codec in the style of LZ4 blocks: a token with literal and match
+ * lengths, the literals, then a 16-bit back reference. No entropy stage, decoding is a copy loop.
+ */
+namespace lz
+{
+	// Appends the compressed form of the data to out and returns the number of bytes written
+	size_t compress(const uint8_t* data, size_t size, std::vector<uint8_t>& out);
+
+	// Fails unless the input decodes to exactly outSize bytes
+	bool decompress(const uint8_t* data, size_t size, uint8_t* out, size_t outSize);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+/*
+ * Unbounded lock-free queue for many producers and a single consumer.
+ * push() is one atomic exchange and never blocks; pop() must only be called from the consumer
+ * thread and may briefly miss an element whose push() has not completed yet.
+ */
+template<typename _Ty>
+class MpscQueue
+{
+private:
+	struct Node
+	{
+		std::atomic<Node*> next;
+		_Ty value;
+	};
+
+	std::atomic<Node*> _head;	// Last pushed, shared by the producers
+	Node* _tail;				// Already consumed, its successor is the front
+
+public:
+	MpscQueue();
+	~MpscQueue();
+
+	MpscQueue(const MpscQueue&) = delete;
+	MpscQueue& operator= (const MpscQueue&) = delete;
+
+	void push(_Ty value);
+	bool pop(_Ty& value);
+
+	inline bool empty() const { return _tail->next.load(std::memory_order_acquire) == nullptr; }
+};
+
+
+
+/* Implementation */
+
+template<typename _Ty>
+MpscQueue<_Ty>::MpscQueue() :
+	_head{ nullptr },
+	_tail{ new Node{ { nullptr }, _Ty{} } }
+{
+	_head.store(_tail, std::memory_order_relaxed);
+}
+
+template<typename _Ty>
+MpscQueue<_Ty>::~MpscQueue()
+{
+	for (Node* node = _tail; node;)
+	{
+		Node* next = node->next.load(std::memory_order_relaxed);
+		delete node;
+		node = next;
+	}
+}
+
+template<typename _Ty>
+void MpscQueue<_Ty>::push(_Ty value)
+{
+	Node* node = new Node{ { nullptr }, std::move(value) };
+	Node* previous = _head.exchange(node, std::memory_order_acq_rel);
+	previous->next.store(node, std::memory_order_release);
+}
+
+template<typename _Ty>
+bool MpscQueue<_Ty>::pop(_Ty& value)
+{
+	Node* next = _tail->next.load(std::memory_order_acquire);
+	if (!next)
+		return false;
+
+	// The popped node becomes the new consumed marker
+	value = std::move(next->value);
+	delete _tail;
+	_tail = next;
+	return true;
+}
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <utility>
+
+struct PoolStats
+{
+	size_t reservedBytes;
+	size_t usedBytes;
+	size_t peakUsedBytes;
+	size_t allocations;
+	size_t deallocations;
+	size_t cacheHits;
+	size_t failedAllocations;
+	size_t slabs;
+
+	PoolStats& operator+= (const PoolStats& other);
+};
+
+
+class MemoryBudget
+{
+private:
+	std::atomic<size_t> _reserved;
+	size_t _limit;
+
+public:
+	explicit MemoryBudget(size_t limit = 0);
+
+	MemoryBudget(const MemoryBudget&) = delete;
+	MemoryBudget& operator= (const MemoryBudget&) = delete;
+
+	bool tryReserve(size_t bytes);
+	void release(size_t bytes);
+
+	inline size_t getReserved() const { return _reserved.load(std::memory_order_relaxed); }
+	inline size_t getLimit() const { return _limit; }
+	inline bool isLimited() const { return _limit != 0; }
+};
+
+
+/*
+ * Pool of fixed-size blocks carved out of large slabs.
+ * Each thread allocates through a small cache that is refilled from, and flushed to, the
+ * shared free list in batches. A slab whose blocks are all back in the shared free list is
+ * returned to the system and to the budget once more than RETAINED_SLABS are, or by trim();
+ * slabs made by reserve() stay until destruction.
+ * allocate() returns nullptr once the budget's hard limit is reached.
+ */
+class SlabPool
+{
+public:
+	static constexpr size_t ALIGNMENT = 64;
+	static constexpr size_t THREAD_CACHES = 32;
+	static constexpr size_t CACHE_SIZE = 32;
+	static constexpr size_t RETAINED_SLABS = 2;		// Empty slabs kept for the next allocations
+
+private:
+	struct alignas(64) ThreadCache
+	{
+		std::atomic_flag lock = ATOMIC_FLAG_INIT;
+		size_t count = 0;
+		void* blocks[CACHE_SIZE];
+	};
+
+	struct Slab
+	{
+		uint8_t* data;
+		size_t freeCount;		// Blocks in the shared free list
+		bool kept;				// Made by reserve()
+	};
+
+	size_t _blockSize;
+	size_t _blocksPerSlab;
+
+	std::unique_ptr<MemoryBudget> _ownBudget;
+	MemoryBudget* _budget;
+
+	mutable std::mutex _lock;
+	std::vector<Slab> _slabs;			// Sorted by address
+	std::vector<void*> _freeBlocks;
+	size_t _emptySlabs;					// That could be released
+
+	std::unique_ptr<ThreadCache[]> _caches;
+
+	std::atomic<size_t> _used;
+	std::atomic<size_t> _peak;
+	std::atomic<size_t> _allocations;
+	std::atomic<size_t> _deallocations;
+	std::atomic<size_t> _cacheHits;
+	std::atomic<size_t> _failed;
+
+public:
+	SlabPool(size_t blockSize, size_t slabBytes = 1 << 20, size_t memoryLimit = 0);
+	SlabPool(size_t blockSize, size_t slabBytes, MemoryBudget& sharedBudget);
+	~SlabPool();
+
+	SlabPool(const SlabPool&) = delete;
+	SlabPool& operator= (const SlabPool&) = delete;
+
+	void* allocate();
+	void deallocate(void* block);
+
+	// Returns many blocks with a single lock, e.g. when a whole region is unloaded
+	void deallocate(void* const* blocks, size_t count);
+
+	// Moves every thread cached block back to the shared free list
+	void flushCaches();
+
+	PoolStats getStats() const;
+
+	inline size_t getBlockSize() const { return _blockSize; }
+
+	// Allocates slabs up front until the pool holds at least that many blocks
+	bool reserve(size_t blocks);
+
+	// Address and size of every slab, e.g. to register them as I/O buffers
+	std::vector<std::pair<void*, size_t>> getSlabs() const;
+
+	// Releases every empty slab not made by reserve(), e.g. when memory runs short; returns the bytes freed
+	size_t trim();
+
+private:
+	ThreadCache& localCache();
+
+	size_t refill(void** out, size_t count);
+
+	bool grow(bool kept = false);
+
+	Slab& findSlab(const void* block);
+	void pushFree(void* block);
+	size_t releaseEmpty(size_t keep);
+
+	void countAllocation(bool cached);
+};
+
+
+/*
+ * Variable-size buffers rounded up to power of two size classes, each class backed by a SlabPool.
+ * All classes share one hard memory limit.
+ */
+class SizeClassPool
+{
+public:
+	static constexpr size_t MIN_CLASS_BITS = 8;
+	static constexpr size_t MAX_CLASS_BITS = 24;
+	static constexpr size_t CLASS_COUNT = MAX_CLASS_BITS - MIN_CLASS_BITS + 1;
+
+private:
+	MemoryBudget _budget;
+	std::unique_ptr<SlabPool> _classes[CLASS_COUNT];
+
+public:
+	explicit SizeClassPool(size_t memoryLimit = 0, size_t slabBytes = 1 << 20);
+
+	SizeClassPool(const SizeClassPool&) = delete;
+	SizeClassPool& operator= (const SizeClassPool&) = delete;
+
+	// size must be passed back to deallocate; capacity (if given) receives the usable size
+	void* allocate(size_t size, size_t* capacity = nullptr);
+	void deallocate(void* ptr, size_t size);
+
+	void flushCaches();
+
+	PoolStats getStats() const;
+	PoolStats getClassStats(size_t sizeClass) const;
+
+	static size_t classOf(size_t size);
+	static inline size_t classSize(size_t sizeClass) { return size_t(1) << (sizeClass + MIN_CLASS_BITS); }
+};
+
+
+class PoolBuffer
+{
+private:
+	SizeClassPool* _pool;
+	uint8_t* _data;
+	size_t _size;
+	size_t _capacity;
+
+public:
+	PoolBuffer();
+	explicit PoolBuffer(SizeClassPool& pool, size_t reserve = 0);
+	PoolBuffer(PoolBuffer&& b) noexcept;
+	~PoolBuffer();
+
+	PoolBuffer(const PoolBuffer&) = delete;
+	PoolBuffer& operator= (const PoolBuffer&) = delete;
+
+	PoolBuffer& operator= (PoolBuffer&& b) noexcept;
+
+	bool reserve(size_t capacity);
+	bool append(const void* data, size_t bytes);
+	inline void clear() { _size = 0; }
+	void release();
+
+	inline uint8_t* data() { return _data; }
+	inline const uint8_t* data() const { return _data; }
+	inline size_t size() const { return _size; }
+	inline size_t capacity() const { return _capacity; }
+	inline bool empty() const { return _size == 0; }
+};
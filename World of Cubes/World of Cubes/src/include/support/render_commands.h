@@ -0,0 +1,174 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Passes are drawn in this order, each with its own depth and blending state
+enum class RenderPass : uint8_t
+{
+	Opaque,
+	Cutout,			// Alpha tested by the shader, drawn as opaque
+	Translucent,	// Blended back to front, without depth writes
+	Overlay			// Blended over everything, without depth test
+};
+
+struct RenderCommand
+{
+	uint64_t key;
+	uint32_t program;
+	uint32_t texture;
+	uint32_t vertexArray;
+	uint32_t first;			// Index range of the element buffer of the vertex array
+	uint32_t count;
+	RenderPass pass;
+};
+
+/*
+ * Receives the state changes that RenderStateCache did not skip and the draws.
+ * Implemented over OpenGL by GLRenderBackend, and by MockRenderBackend to count calls without a GPU.
+ */
+class RenderBackend
+{
+public:
+	RenderBackend() = default;
+	RenderBackend(const RenderBackend&) = delete;
+	RenderBackend& operator= (const RenderBackend&) = delete;
+	virtual ~RenderBackend() = default;
+
+	virtual void useProgram(uint32_t program) = 0;
+	virtual void bindTexture(uint32_t texture) = 0;
+	virtual void bindVertexArray(uint32_t vertexArray) = 0;
+	virtual void setDepth(bool test, bool write) = 0;
+	virtual void setBlend(bool enabled) = 0;
+	virtual void draw(uint32_t first, uint32_t count) = 0;
+};
+
+/*
+ * Last state set on a backend, so that setting it again costs nothing.
+ * Every value starts unknown; invalidate() forgets them after other code touched the state.
+ */
+class RenderStateCache
+{
+private:
+	static constexpr uint32_t UNKNOWN = 0xffffffffu;
+
+	RenderBackend& _backend;
+	uint32_t _program;
+	uint32_t _texture;
+	uint32_t _vertexArray;
+	uint32_t _depth;		// Test in bit 0, write in bit 1
+	uint32_t _blend;
+
+public:
+	explicit RenderStateCache(RenderBackend& backend);
+	RenderStateCache(const RenderStateCache&) = delete;
+	RenderStateCache& operator= (const RenderStateCache&) = delete;
+
+	void invalidate();
+
+	void setPass(RenderPass pass);
+	void useProgram(uint32_t program);
+	void bindTexture(uint32_t texture);
+	void bindVertexArray(uint32_t vertexArray);
+	inline void draw(uint32_t first, uint32_t count) { _backend.draw(first, count); }
+
+	inline RenderBackend& getBackend() { return _backend; }
+};
+
+/*
+ * Draws recorded during a frame, then sorted by a 64 bit key and submitted together.
+ * The key holds, from the highest bits, the pass in 4 bits, then the low 12 bits of the program,
+ * the low 16 bits of the texture and the depth as float bits, so that draws sharing state follow
+ * each other and opaque ones go front to back. Blended passes put the inverted depth before the
+ * program, to draw back to front. Ids beyond the key bits only sort less well: the state sent
+ * comes from the command itself.
+ * The sort is a stable LSD radix sort over 8 bit digits, skipping digits all keys share.
+ */
+class RenderCommandBuffer
+{
+private:
+	struct SortEntry
+	{
+		uint64_t key;
+		uint32_t index;
+	};
+
+	std::vector<RenderCommand> _commands;
+	std::vector<SortEntry> _order;
+	std::vector<SortEntry> _scratch;
+	bool _sorted;
+
+public:
+	RenderCommandBuffer();
+	RenderCommandBuffer(const RenderCommandBuffer&) = delete;
+	RenderCommandBuffer& operator= (const RenderCommandBuffer&) = delete;
+
+	// depth is the distance from the eye, negative ones count as 0
+	void draw(RenderPass pass, uint32_t program, uint32_t texture, uint32_t vertexArray, uint32_t first, uint32_t count, float depth);
+
+	void sort();
+
+	// In key order after sort(), in recording order otherwise
+	void submit(RenderStateCache& cache) const;
+
+	void clear();
+
+	inline size_t size() const { return _commands.size(); }
+	inline const RenderCommand& operator[] (size_t index) const { return _commands[index]; }
+
+	static uint64_t makeKey(RenderPass pass, uint32_t program, uint32_t texture, float depth);
+};
+
+struct RenderCounters
+{
+	size_t programs;
+	size_t textures;
+	size_t vertexArrays;
+	size_t depthStates;
+	size_t blendStates;
+	size_t draws;
+
+	inline size_t stateChanges() const { return programs + textures + vertexArrays + depthStates + blendStates; }
+};
+
+/*
+ * Backend counting the calls it receives and recording the state each draw ran with.
+ */
+class MockRenderBackend : public RenderBackend
+{
+public:
+	struct Draw
+	{
+		uint32_t program;
+		uint32_t texture;
+		uint32_t vertexArray;
+		uint32_t first;
+		uint32_t count;
+		bool depthTest;
+		bool depthWrite;
+		bool blend;
+	};
+
+private:
+	RenderCounters _counters;
+	Draw _current;
+	std::vector<Draw> _draws;
+	bool _record;
+
+public:
+	explicit MockRenderBackend(bool record = true);
+
+	void useProgram(uint32_t program) override;
+	void bindTexture(uint32_t texture) override;
+	void bindVertexArray(uint32_t vertexArray) override;
+	void setDepth(bool test, bool write) override;
+	void setBlend(bool enabled) override;
+	void draw(uint32_t first, uint32_t count) override;
+
+	// Counters and draws only, the current state is kept like a real context would
+	void reset();
+
+	inline const RenderCounters& getCounters() const { return _counters; }
+	inline const std::vector<Draw>& getDraws() const { return _draws; }
+};
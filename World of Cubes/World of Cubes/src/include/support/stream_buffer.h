@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+
+#include "time.h"
+#include "clock.h"
+
+struct StreamRange
+{
+	uint8_t* data;		// Mapped memory to write, nullptr when the region had no room left
+	size_t offset;		// In the buffer, for binding the range and sourcing draws or copies
+	size_t size;
+
+	inline explicit operator bool() const { return data != nullptr; }
+};
+
+struct StreamBufferStats
+{
+	// During the last frame
+	size_t allocated;		// Bytes handed out
+	size_t allocations;
+	size_t failed;			// Allocations that did not fit
+	// Since create()
+	size_t frames;
+	size_t waits;			// Frames whose region was still read by the GPU
+	Time waitTime;
+};
+
+/*
+ * Buffer for data written every frame, mapped once for its whole lifetime with
+ * ARB_buffer_storage (persistent and coherent) and split in REGIONS regions used by successive
+ * frames, so the GPU reads one while the CPU writes another and no upload waits for a draw.
+ * A fence placed by endFrame() guards each region: beginFrame() only waits when the GPU is more
+ * than REGIONS - 1 frames late.
+ * allocate() may be called from any thread between beginFrame() and endFrame(), and the range
+ * written directly; the writes must be done before the GL commands reading them are issued.
+ * Everything else needs the GL context, on its thread.
+ */
+class StreamBuffer
+{
+public:
+	static constexpr uint32_t REGIONS = 3;
+
+private:
+	uint32_t _buffer;
+	uint8_t* _mapped;
+	size_t _regionSize;
+	uint32_t _region;
+	std::atomic<size_t> _head;			// In the current region
+	std::atomic<size_t> _allocations;
+	std::atomic<size_t> _failed;
+	void* _fences[REGIONS];				// GLsync of the last frame that used each region
+	size_t _uniformAlignment;
+	StreamBufferStats _stats;
+	Clock _clock;
+
+public:
+	StreamBuffer();
+	~StreamBuffer();
+
+	StreamBuffer(const StreamBuffer&) = delete;
+	StreamBuffer& operator= (const StreamBuffer&) = delete;
+
+	// False without ARB_buffer_storage or when the buffer cannot be mapped
+	bool create(size_t regionSize);
+	void destroy();
+
+	void beginFrame();
+	void endFrame();
+
+	// alignment must be a power of 2; use getUniformAlignment() for uniform blocks
+	StreamRange allocate(size_t size, size_t alignment = 16);
+
+	inline bool isCreated() const { return _mapped != nullptr; }
+	inline uint32_t getBuffer() const { return _buffer; }
+	inline size_t getRegionSize() const { return _regionSize; }
+	inline size_t getUniformAlignment() const { return _uniformAlignment; }
+	inline const StreamBufferStats& getStats() const { return _stats; }
+};
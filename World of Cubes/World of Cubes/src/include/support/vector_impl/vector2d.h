@@ -259,7 +259,7 @@ Vector2<_Ty> operator+ (const Vector2<_Ty>& v0, const Vector2<_Ty>& v1)
 template<typename _Ty>
 Vector2<_Ty> operator- (const Vector2<_Ty>& v0, const Vector2<_Ty>& v1)
 {
-	return { v0.x + v1.x, v0.y + v1.y };
+	return { v0.x - v1.x, v0.y - v1.y };
 }
 
 template<typename _Ty>
@@ -331,7 +331,7 @@ Vector3<_Ty> operator+ (const Vector3<_Ty>& v0, const Vector3<_Ty>& v1)
 template<typename _Ty>
 Vector3<_Ty> operator- (const Vector3<_Ty>& v0, const Vector3<_Ty>& v1)
 {
-	return { v0.x + v1.x, v0.y + v1.y, v0.z - v1.z };
+	return { v0.x - v1.x, v0.y - v1.y, v0.z - v1.z };
 }
 
 template<typename _Ty>
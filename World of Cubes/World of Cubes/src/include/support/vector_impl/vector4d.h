@@ -331,7 +331,7 @@ Vector4<_Ty> operator+ (const Vector4<_Ty>& v0, const Vector4<_Ty>& v1)
 template<typename _Ty>
 Vector4<_Ty> operator- (const Vector4<_Ty>& v0, const Vector4<_Ty>& v1)
 {
-	return { v0.x + v1.x, v0.y + v1.y, v0.z - v1.z, v0.w - v1.w };
+	return { v0.x - v1.x, v0.y - v1.y, v0.z - v1.z, v0.w - v1.w };
 }
 
 template<typename _Ty>